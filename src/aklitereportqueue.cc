@@ -1,21 +1,167 @@
-#include "curl/curl.h"
-
 #include "aklitereportqueue.h"
 
+#include <algorithm>
+#include <memory>
+
+#include "compression.h"
+#include "logging/logging.h"
+#include "storage/invstorage.h"
+#include "utilities/utils.h"
+
+AkLiteReportQueue::AkLiteReportQueue(const Config& config_in, std::shared_ptr<HttpInterface> http_client,
+                                     std::shared_ptr<INvStorage> storage_in, int run_pause_s, int event_number_limit,
+                                     EventBatchConfig batch_config,
+                                     std::shared_ptr<ConnectivityMonitor> connectivity_monitor)
+    : AkLiteReportQueue(config_in, std::make_shared<EventSender>(std::move(http_client), std::move(batch_config)),
+                        std::move(storage_in), run_pause_s, event_number_limit, std::move(connectivity_monitor)) {}
+
+AkLiteReportQueue::AkLiteReportQueue(const Config& config_in, const std::shared_ptr<EventSender>& sender,
+                                     std::shared_ptr<INvStorage> storage_in, int run_pause_s, int event_number_limit,
+                                     std::shared_ptr<ConnectivityMonitor> connectivity_monitor)
+    : ReportQueue(config_in, sender, storage_in, run_pause_s,
+                  sender->batchConfig().batch_size > 0 ? sender->batchConfig().batch_size : event_number_limit),
+      sender_{sender},
+      storage_{std::move(storage_in)},
+      connectivity_monitor_{std::move(connectivity_monitor)} {
+  if (connectivity_monitor_) {
+    std::weak_ptr<EventSender> weak_sender{sender_};
+    connectivity_monitor_->addListener([weak_sender](bool has_default_route) {
+      const auto event_sender{weak_sender.lock()};
+      if (has_default_route && event_sender) {
+        event_sender->resetBackoff();
+      }
+    });
+  }
+}
+
 bool AkLiteReportQueue::checkConnectivity(const std::string& server) const {
-  // Check if the device has Internet access in a fast way, without establishing a full TLS connection
-  bool ret = true;
-  CURL* curl = curl_easy_init();
-  if (curl != nullptr) {
-    curl_easy_setopt(curl, CURLOPT_URL, (server).c_str());
-    curl_easy_setopt(curl, CURLOPT_CONNECT_ONLY, 1L);
-    auto curl_ret = curl_easy_perform(curl);
-    // Only assume the device is offline if the CURLE_COULDNT_RESOLVE_HOST is returned.
-    // If the device is online, CURLE_PEER_FAILED_VERIFICATION is typically returned.
-    if (curl_ret == CURLE_COULDNT_RESOLVE_HOST) {
-      ret = false;
+  if (sender_->batchConfig().batch_size > 0) {
+    // the events to be sent have been loaded already, so they are held back if some of them have been dropped,
+    // the next attempt loads the events left in the storage
+    if (dropOldestEvents() || !sender_->isSendAllowed()) {
+      return false;
     }
-    curl_easy_cleanup(curl);
   }
-  return ret;
+
+  if (connectivity_monitor_) {
+    return connectivity_monitor_->isReachable(server);
+  }
+  return ConnectivityMonitor::probe(server);
+}
+
+bool AkLiteReportQueue::dropOldestEvents() const {
+  // The storage can't count the events, so no more than twice the maximum number of events is loaded at once to find
+  // out how many events are over the maximum.
+  const auto max_queued_events{sender_->batchConfig().max_queued_events};
+  const auto load_limit{static_cast<int>(2 * max_queued_events)};
+  size_t dropped_numb{0};
+  while (true) {
+    Json::Value events{Json::arrayValue};
+    int64_t id_max{0};
+    storage_->loadReportEvents(&events, &id_max, load_limit);
+    if (events.size() <= max_queued_events) {
+      break;
+    }
+    // the oldest events come first, the ID of the last event to drop is found by loading just the events to drop
+    const auto drop_numb{events.size() - max_queued_events};
+    Json::Value dropped_events{Json::arrayValue};
+    storage_->loadReportEvents(&dropped_events, &id_max, static_cast<int>(drop_numb));
+    storage_->deleteReportEvents(id_max);
+    dropped_numb += dropped_events.size();
+    if (events.size() < static_cast<size_t>(load_limit)) {
+      break;
+    }
+  }
+  if (dropped_numb > 0) {
+    LOG_WARNING << "The number of queued events exceeds " << max_queued_events << ", dropped " << dropped_numb
+                << " oldest events";
+  }
+  return dropped_numb > 0;
+}
+
+AkLiteReportQueue::EventSender::EventSender(std::shared_ptr<HttpInterface> http_client, EventBatchConfig batch_config)
+    : http_client_{std::move(http_client)}, batch_config_{std::move(batch_config)} {}
+
+bool AkLiteReportQueue::EventSender::isSendAllowed() {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return std::chrono::steady_clock::now() >= next_send_time_;
+}
+
+void AkLiteReportQueue::EventSender::resetBackoff() {
+  std::lock_guard<std::mutex> lock{mutex_};
+  if (backoff_.count() > 0) {
+    backoff_ = std::chrono::seconds{0};
+    next_send_time_ = std::chrono::steady_clock::now();
+  }
+}
+
+void AkLiteReportQueue::EventSender::onSent(const HttpResponse& resp) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  const auto now{std::chrono::steady_clock::now()};
+  // Device Gateway is considered unreachable if a request fails at the transport level or it fails to handle it,
+  // otherwise the events are either accepted or rejected by Device Gateway, a retry won't help in the latter case.
+  const bool unreachable{resp.curl_code != CURLE_OK || resp.http_status_code >= 500 || resp.http_status_code == 429};
+  if (!unreachable) {
+    backoff_ = std::chrono::seconds{0};
+    next_send_time_ = now + batch_config_.min_interval;
+    return;
+  }
+  backoff_ = backoff_.count() == 0 ? BackoffMin : std::min(backoff_ * 2, BackoffMax);
+  // half of the backoff is fixed and the other half is random, so devices that lost connection to Device Gateway at
+  // the same time don't retry at the same time
+  std::uniform_int_distribution<int64_t> jitter{0, backoff_.count() / 2};
+  const std::chrono::seconds delay{backoff_.count() - backoff_.count() / 2 + jitter(random_engine_)};
+  next_send_time_ = now + delay;
+  LOG_WARNING << "Failed to send events to Device Gateway: " << resp.getStatusStr() << ", next attempt in "
+              << delay.count() << " seconds";
+}
+
+HttpResponse AkLiteReportQueue::EventSender::get(const std::string& url, int64_t maxsize) {
+  return http_client_->get(url, maxsize);
+}
+
+HttpResponse AkLiteReportQueue::EventSender::post(const std::string& url, const std::string& content_type,
+                                                  const std::string& data) {
+  return http_client_->post(url, content_type, data);
+}
+
+HttpResponse AkLiteReportQueue::EventSender::post(const std::string& url, const Json::Value& data) {
+  if (batch_config_.batch_size <= 0) {
+    return http_client_->post(url, data);
+  }
+  const auto resp{batch_config_.gzip_http_client
+                      ? batch_config_.gzip_http_client->post(url, "application/json",
+                                                             gzip(Utils::jsonToCanonicalStr(data)))
+                      : http_client_->post(url, data)};
+  onSent(resp);
+  return resp;
+}
+
+HttpResponse AkLiteReportQueue::EventSender::put(const std::string& url, const std::string& content_type,
+                                                 const std::string& data) {
+  return http_client_->put(url, content_type, data);
+}
+
+HttpResponse AkLiteReportQueue::EventSender::put(const std::string& url, const Json::Value& data) {
+  return http_client_->put(url, data);
+}
+
+HttpResponse AkLiteReportQueue::EventSender::download(const std::string& url, curl_write_callback write_cb,
+                                                      curl_xferinfo_callback progress_cb, void* userp,
+                                                      curl_off_t from) {
+  return http_client_->download(url, write_cb, progress_cb, userp, from);
+}
+
+std::future<HttpResponse> AkLiteReportQueue::EventSender::downloadAsync(const std::string& url,
+                                                                        curl_write_callback write_cb,
+                                                                        curl_xferinfo_callback progress_cb,
+                                                                        void* userp, curl_off_t from,
+                                                                        CurlHandler* easyp) {
+  return http_client_->downloadAsync(url, write_cb, progress_cb, userp, from, easyp);
+}
+
+void AkLiteReportQueue::EventSender::setCerts(const std::string& ca, CryptoSource ca_source, const std::string& cert,
+                                              CryptoSource cert_source, const std::string& pkey,
+                                              CryptoSource pkey_source) {
+  http_client_->setCerts(ca, ca_source, cert, cert_source, pkey, pkey_source);
 }
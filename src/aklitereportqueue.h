@@ -1,13 +1,42 @@
 #ifndef AKTUALIZR_LITE_REPORT_QUEUE_H_
 #define AKTUALIZR_LITE_REPORT_QUEUE_H_
 
+#include <chrono>
+#include <mutex>
+#include <random>
+
+#include "connectivitymonitor.h"
 #include "primary/reportqueue.h"
 
+// Settings of the AkLiteReportQueue batching mode, the mode is enabled if `batch_size` is greater than zero
+struct EventBatchConfig {
+  int batch_size{0};
+  std::chrono::seconds min_interval{60};
+  size_t max_queued_events{1000};
+  // an http client that adds the `Content-Encoding: gzip` header to requests
+  std::shared_ptr<HttpInterface> gzip_http_client;
+};
+
+/**
+ * @brief AkLiteReportQueue, the queue of events reported to Device Gateway
+ *
+ * By default it behaves as the upstream ReportQueue, i.e. queued events are sent as soon as they are enqueued.
+ * In the batching mode, enabled by setting `EventBatchConfig::batch_size`, the queue:
+ * - coalesces events enqueued in a burst (e.g. during an update installation) into one request by sending them no
+ *   more often than each `EventBatchConfig::min_interval`, up to `batch_size` events per request;
+ * - backs off exponentially, with a random jitter, after Device Gateway has failed to receive events;
+ * - keeps no more than `EventBatchConfig::max_queued_events` events in the storage, the oldest ones are dropped;
+ * - sends events compressed through `EventBatchConfig::gzip_http_client` if it's set.
+ */
 class AkLiteReportQueue : public ReportQueue {
  public:
+  static constexpr std::chrono::seconds BackoffMin{10};
+  static constexpr std::chrono::seconds BackoffMax{15 * 60};
+
   AkLiteReportQueue(const Config& config_in, std::shared_ptr<HttpInterface> http_client,
-                    std::shared_ptr<INvStorage> storage_in, int run_pause_s = 10, int event_number_limit = -1)
-      : ReportQueue(config_in, std::move(http_client), std::move(storage_in), run_pause_s, event_number_limit) {}
+                    std::shared_ptr<INvStorage> storage_in, int run_pause_s = 10, int event_number_limit = -1,
+                    EventBatchConfig batch_config = EventBatchConfig(),
+                    std::shared_ptr<ConnectivityMonitor> connectivity_monitor = nullptr);
 
   ~AkLiteReportQueue() override = default;
   AkLiteReportQueue(const AkLiteReportQueue&) = delete;
@@ -16,7 +45,54 @@ class AkLiteReportQueue : public ReportQueue {
   AkLiteReportQueue& operator=(AkLiteReportQueue&&) = delete;
 
  private:
+  // Sends batches of events on behalf of the upstream queue and keeps track of the send attempts
+  class EventSender : public HttpInterface {
+   public:
+    EventSender(std::shared_ptr<HttpInterface> http_client, EventBatchConfig batch_config);
+
+    HttpResponse get(const std::string& url, int64_t maxsize) override;
+    HttpResponse post(const std::string& url, const std::string& content_type, const std::string& data) override;
+    HttpResponse post(const std::string& url, const Json::Value& data) override;
+    HttpResponse put(const std::string& url, const std::string& content_type, const std::string& data) override;
+    HttpResponse put(const std::string& url, const Json::Value& data) override;
+    HttpResponse download(const std::string& url, curl_write_callback write_cb, curl_xferinfo_callback progress_cb,
+                          void* userp, curl_off_t from) override;
+    std::future<HttpResponse> downloadAsync(const std::string& url, curl_write_callback write_cb,
+                                            curl_xferinfo_callback progress_cb, void* userp, curl_off_t from,
+                                            CurlHandler* easyp) override;
+    void setCerts(const std::string& ca, CryptoSource ca_source, const std::string& cert, CryptoSource cert_source,
+                  const std::string& pkey, CryptoSource pkey_source) override;
+
+    const EventBatchConfig& batchConfig() const { return batch_config_; }
+    // Returns false if events should be held back, either to be coalesced with the following ones or to back off
+    bool isSendAllowed();
+    // lets the held back events go as soon as connectivity is restored
+    void resetBackoff();
+
+   private:
+    void onSent(const HttpResponse& resp);
+
+    std::shared_ptr<HttpInterface> http_client_;
+    const EventBatchConfig batch_config_;
+    std::mutex mutex_;
+    std::chrono::steady_clock::time_point next_send_time_;
+    std::chrono::seconds backoff_{0};
+    std::mt19937 random_engine_{std::random_device{}()};
+  };
+
+  AkLiteReportQueue(const Config& config_in, const std::shared_ptr<EventSender>& sender,
+                    std::shared_ptr<INvStorage> storage_in, int run_pause_s, int event_number_limit,
+                    std::shared_ptr<ConnectivityMonitor> connectivity_monitor);
+
+  // The upstream queue checks connectivity just before sending queued events, so it's the point where the batching
+  // mode decides whether events are sent now and trims the storage.
   bool checkConnectivity(const std::string& server) const override;
+  // returns true if any events have been dropped
+  bool dropOldestEvents() const;
+
+  std::shared_ptr<EventSender> sender_;
+  std::shared_ptr<INvStorage> storage_;
+  std::shared_ptr<ConnectivityMonitor> connectivity_monitor_;
 };
 
 #endif
@@ -26,6 +26,7 @@
 #include "tuf/akhttpsreposource.h"
 #include "tuf/akrepo.h"
 #include "tuf/localreposource.h"
+#include "tuf/targetindex.h"
 #include "uptane/exceptions.h"
 
 class BundleMetaError : public std::logic_error {
@@ -187,35 +188,16 @@ AkliteClient::~AkliteClient() {
   unlink("/var/lock/aklite.lock");
 }
 
-static bool compareTargets(const TufTarget& a, const TufTarget& b) { return a.Version() < b.Version(); }
-
 // Returns a sorted list of OSTREE targets matching tags if configured and hwid (or one of secondary_hwids)
-static std::vector<TufTarget> filterTargets(const std::vector<TufTarget>& allTargets, const std::string& hwidToFind,
-                                            const std::vector<std::string>& tags,
-                                            const std::vector<std::string>& secondary_hwids) {
-  std::vector<TufTarget> targets;
-  for (const auto& t : allTargets) {
-    if (t.Custom()["targetFormat"] != "OSTREE") {
-      LOG_WARNING << "Unexpected target format: \"" << t.Custom()["targetFormat"] << "\" target: " << t.Name();
-      continue;
-    }
-
-    if (!tags.empty() && !t.HasOneOfTags(tags)) {
-      continue;
-    }
-    if (t.HardwareId() == hwidToFind) {
-      targets.push_back(t);
-      continue;
-    }
-    for (const auto& hwid : secondary_hwids) {
-      if (t.HardwareId() == hwid) {
-        targets.push_back(t);
-        break;
-      }
-    }
-  }
-  std::sort(targets.begin(), targets.end(), compareTargets);
-  return targets;
+static std::vector<TufTarget> findTargets(aklite::tuf::Repo& repo, const std::string& hwid,
+                                          const std::vector<std::string>& tags,
+                                          const std::vector<std::string>& secondary_hwids) {
+  // AkRepo keeps the index of its Targets until the targets metadata change
+  auto* ak_repo{dynamic_cast<aklite::tuf::AkRepo*>(&repo)};
+  if (ak_repo != nullptr) {
+    return ak_repo->GetTargetIndex().Find(hwid, tags, secondary_hwids);
+  }
+  return aklite::tuf::TargetIndex(repo.GetTargets()).Find(hwid, tags, secondary_hwids);
 }
 
 static CheckInResult checkInFailure(const std::shared_ptr<LiteClient>& client_, const std::string& hw_id_,
@@ -325,7 +307,7 @@ CheckInResult AkliteClient::CheckIn() const {
   }
 
   LOG_INFO << "Searching for matching TUF Targets...";
-  auto matchingTargets = filterTargets(tuf_repo_->GetTargets(), hw_id_, client_->tags, secondary_hwids_);
+  auto matchingTargets = findTargets(*tuf_repo_, hw_id_, client_->tags, secondary_hwids_);
   if (matchingTargets.empty()) {
     // TODO: consider reporting about it to the backend to make it easier to figure out
     // why specific devices are not picking up a new Target
@@ -553,7 +535,9 @@ CheckInResult AkliteClient::CheckInLocal(const LocalUpdateSource* local_update_s
 
   LOG_INFO << "Searching for TUF Targets matching a device's hardware ID and tag; hw-id: " + hw_id_ +
                   ", tag: " + (client_->tags.empty() ? "<not set>" : boost::algorithm::join(client_->tags, ","));
-  auto matchingTargets = filterTargets(trusted_targets, hw_id_, client_->tags, secondary_hwids_);
+  // the bundle Targets are a subset of the TUF Targets, so they are indexed for this check-in only
+  auto matchingTargets =
+      aklite::tuf::TargetIndex(std::move(trusted_targets)).Find(hw_id_, client_->tags, secondary_hwids_);
   if (matchingTargets.empty()) {
     err_msg =
         "Couldn't find Targets matching the device's hardware ID; check a tag or a hardware ID of the device and the "
@@ -595,7 +579,7 @@ CheckInResult AkliteClient::CheckInCurrent(const LocalUpdateSource* local_update
   }
 
   LOG_INFO << "Searching for matching TUF Targets...";
-  auto matchingTargets = filterTargets(tuf_repo_->GetTargets(), hw_id_, client_->tags, secondary_hwids_);
+  auto matchingTargets = findTargets(*tuf_repo_, hw_id_, client_->tags, secondary_hwids_);
   if (matchingTargets.empty()) {
     // TODO: consider reporting about it to the backend to make it easier to figure out
     // why specific devices are not picking up a new Target
@@ -1012,7 +996,9 @@ class LocalLiteInstall : public LiteInstall {
         },
         false, /* don't create containers on install because it makes dockerd check if pinned images
       present in its store what we should avoid until images are registered (hacked) in dockerd store */
-        true   /* indicate that this is an offline client */
+        true,  /* indicate that this is an offline client */
+        false, /* verify blobs by means of the blob index */
+        offline_registry->blobsDir() /* share the local update blobs with the store instead of copying them */
         )};
 #endif
 
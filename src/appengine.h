@@ -64,6 +64,8 @@ class AppEngine {
     ID status;
     std::string err;
     storage::Volume::UsageInfo stat{.err = "undefined"};
+    // statistics of an App fetch (see FetchStats), set by the engines capable of collecting them
+    Json::Value fetch_stats;
   };
 
   using Apps = std::vector<App>;
@@ -80,6 +82,35 @@ class AppEngine {
   virtual Apps getInstalledApps() const = 0;
   virtual Json::Value getRunningAppsInfo() const = 0;
   virtual void prune(const Apps& app_shortlist) = 0;
+  // A hint that the status of the given apps is about to be checked, so an engine can query the status of all of them
+  // at once and serve the following isFetched() and isRunning() calls from the query result until
+  // clearAppsStatusCache() is called. Only the fetch status is queried if `fetch_status_only` is set.
+  virtual void cacheAppsStatus(const Apps& apps, bool fetch_status_only = false) {
+    (void)apps;
+    (void)fetch_status_only;
+  }
+  virtual void clearAppsStatusCache() {}
+
+  // Caches the status of the given apps for its lifetime, so the cache is cleared even if a status check throws
+  class AppsStatusCache {
+   public:
+    AppsStatusCache(AppEngine& engine, const Apps& apps, bool fetch_status_only = false) : engine_{engine} {
+      try {
+        engine_.cacheAppsStatus(apps, fetch_status_only);
+      } catch (...) {
+        engine_.clearAppsStatusCache();
+        throw;
+      }
+    }
+    ~AppsStatusCache() { engine_.clearAppsStatusCache(); }
+    AppsStatusCache(const AppsStatusCache&) = delete;
+    AppsStatusCache(AppsStatusCache&&) = delete;
+    AppsStatusCache& operator=(const AppsStatusCache&) = delete;
+    AppsStatusCache& operator=(AppsStatusCache&&) = delete;
+
+   private:
+    AppEngine& engine_;
+  };
 
   virtual ~AppEngine() = default;
   AppEngine(const AppEngine&&) = delete;
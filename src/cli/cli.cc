@@ -7,11 +7,13 @@
 #include "aktualizr-lite/api.h"
 
 #include "aktualizr-lite/aklite_client_ext.h"
+#include "fetchstats.h"
 #include "json/reader.h"
 #include "json/value.h"
 #include "logging/logging.h"
 #include "storage/invstorage.h"
 #include "target.h"
+#include "utilities/utils.h"
 
 namespace aklite::cli {
 
@@ -460,6 +462,16 @@ Json::Value GetStatusJson(AkliteClientExt &akclient) {
     json_root["pending_target"] = getTargetStatusJson(akclient, *pending_target, app_shortlist);
   }
 
+  // Statistics of the last Apps download
+  const auto download_stats_file{sc.path / FetchStats::Filename};
+  if (boost::filesystem::exists(download_stats_file)) {
+    try {
+      json_root["last_download"] = Utils::parseJSONFile(download_stats_file);
+    } catch (const std::exception &exc) {
+      LOG_WARNING << "Failed to read the download statistics: " << exc.what();
+    }
+  }
+
   return json_root;
 }
 
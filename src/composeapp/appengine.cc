@@ -4,6 +4,7 @@
 
 #include "aktualizr-lite/storage/stat.h"
 #include "exec.h"
+#include "fetchstats.h"
 
 namespace composeapp {
 enum class ExitCode { ExitCodeInsufficientSpace = 100 };
@@ -12,14 +13,22 @@ static bool checkAppStatus(const AppEngine::App& app, const Json::Value& status)
 static bool checkAppInstallationStatus(const AppEngine::App& app, const Json::Value& status);
 static bool isNullOrEmptyOrUnset(const Json::Value& val, const std::string& field);
 static Json::Value parseJSON(const std::string& json_str);
+static std::map<std::string, uint64_t> listStoreBlobs(const boost::filesystem::path& blobs_dir);
 
 AppEngine::Result AppEngine::fetch(const App& app) {
   Result res{false};
   bool was_proxy_set{false};
+  FetchStats stats;
+  // The blobs of an App not fetched yet can't be listed before its manifests are fetched, so the fetched blobs are
+  // figured out by the store content change, and their timings by the fetch output.
+  const auto blobs_dir{storeRoot() / "blobs" / "sha256"};
+  const auto blobs_before{listStoreBlobs(blobs_dir)};
+  const auto on_output_line{[&stats](const std::string& line) { stats.onOutputLine(line); }};
   try {
     // If a given app was fetched before, then don't consider it as a fetched app if a caller tries to fetch it again
     // for one reason or another - hence remove it from the set of fetched apps.
-    fetched_apps_.erase(app.uri);
+    removeFromFetchedApps(app.uri);
+    dropCachedAppStatus(app.uri);
     if (local_source_path_.empty()) {
       if (proxy_) {
         // If the proxy provider is set, then obtain the proxy URL and CA from it,
@@ -31,16 +40,16 @@ AppEngine::Result AppEngine::fetch(const App& app) {
           was_proxy_set = true;
         }
       }
-      exec(boost::format{"%s --store %s pull -p %s --storage-usage-watermark %d"} % composectl_cmd_ % storeRoot() %
-               app.uri % storage_watermark_,
-           "failed to pull compose app", "", nullptr, "4h", true);
+      execStreaming(boost::str(boost::format{"%s --store %s pull -p %s --storage-usage-watermark %d"} %
+                               composectl_cmd_ % storeRoot() % app.uri % storage_watermark_),
+                    "failed to pull compose app", on_output_line, "", "4h", true);
     } else {
-      exec(boost::format{"%s --store %s pull -p %s -l %s --storage-usage-watermark %d"} % composectl_cmd_ %
-               storeRoot() % app.uri % local_source_path_ % storage_watermark_,
-           "failed to pull compose app", "", nullptr, "4h", true);
+      execStreaming(boost::str(boost::format{"%s --store %s pull -p %s -l %s --storage-usage-watermark %d"} %
+                               composectl_cmd_ % storeRoot() % app.uri % local_source_path_ % storage_watermark_),
+                    "failed to pull compose app", on_output_line, "", "4h", true);
     }
     res = true;
-    fetched_apps_.insert(app.uri);
+    addToFetchedApps(app.uri);
   } catch (const ExecError& exc) {
     if (exc.ExitCode == static_cast<int>(ExitCode::ExitCodeInsufficientSpace)) {
       const auto usage_stat{Utils::parseJSON(exc.StdErr)};
@@ -56,12 +65,34 @@ AppEngine::Result AppEngine::fetch(const App& app) {
     ::unsetenv("COMPOSE_APPS_PROXY");
     ::unsetenv("COMPOSE_APPS_PROXY_CA");
   }
+  for (const auto& blob : listStoreBlobs(blobs_dir)) {
+    if (blobs_before.count(blob.first) == 0) {
+      stats.addFetchedBlob(blob.first, blob.second);
+    }
+  }
+  if (!res) {
+    try {
+      // the blobs still missing after a failed fetch make the total size of the fetch
+      std::string output;
+      exec(boost::format{"%s --store %s check %s --local --format json"} % composectl_cmd_ % storeRoot() % app.uri,
+           "", "", &output);
+      const auto app_fetch_status{parseJSON(output)};
+      for (const auto& blob : app_fetch_status.get("fetch_check", Json::Value()).get("missing_blobs", Json::Value())) {
+        stats.addExpectedBlob(blob["descriptor"]["digest"].asString(), blob["descriptor"]["size"].asUInt64());
+      }
+    } catch (const std::exception& exc) {
+      LOG_DEBUG << "Failed to get the list of blobs missing after the fetch: " << exc.what();
+    }
+  }
+  stats.finish([&blobs_dir](const std::string& hash) { return boost::filesystem::exists(blobs_dir / hash); });
+  res.fetch_stats = stats.toJson();
   return res;
 }
 
 void AppEngine::remove(const App& app) {
   try {
-    fetched_apps_.erase(app.uri);
+    removeFromFetchedApps(app.uri);
+    dropCachedAppStatus(app.uri);
     // "App removal" in this context refers to deleting app images from the Docker store
     // and removing the app compose project (app uninstall).
     // Unused app blobs will be removed from the blob store via the prune() method,
@@ -82,11 +113,14 @@ void AppEngine::remove(const App& app) {
 bool AppEngine::isRunning(const App& app) const {
   bool res{false};
   try {
-    std::string output;
-    exec(boost::format{"%s --store %s --compose %s ps %s --format json"} % composectl_cmd_ % storeRoot() %
-             installRoot() % app.uri,
-         "", "", &output);
-    const auto app_status{parseJSON(output)};
+    Json::Value app_status;
+    if (!getCachedAppStatus(app, app_status)) {
+      std::string output;
+      exec(boost::format{"%s --store %s --compose %s ps %s --format json"} % composectl_cmd_ % storeRoot() %
+               installRoot() % app.uri,
+           "", "", &output);
+      app_status = parseJSON(output);
+    }
     // Make sure app images and bundle are properly installed
     res = checkAppInstallationStatus(app, app_status);
     if (res) {
@@ -139,7 +173,7 @@ void AppEngine::prune(const Apps& app_shortlist) {
       }
     }
     for (const auto& app : apps_to_prune) {
-      fetched_apps_.erase(app.uri);
+      removeFromFetchedApps(app.uri);
       exec(boost::format{"%s --store %s rm %s --prune=false --quiet"} % composectl_cmd_ % storeRoot() % app.uri,
            "failed to remove app");
     }
@@ -166,9 +200,66 @@ void AppEngine::prune(const Apps& app_shortlist) {
   }
 }
 
+void AppEngine::cacheAppsStatus(const Apps& apps, bool fetch_status_only) {
+  clearAppsStatusCache();
+  if (apps.empty()) {
+    return;
+  }
+
+  // `composectl check` reports the blobs missing from the store for all the given apps altogether, so the result can
+  // be attributed to each app only if nothing is missing. Otherwise, the apps are checked one by one later on.
+  std::string uris_to_check;
+  for (const auto& app : apps) {
+    if (!isInFetchedApps(app.uri)) {
+      uris_to_check += " " + app.uri;
+    }
+  }
+  if (!uris_to_check.empty()) {
+    try {
+      std::string output;
+      exec(boost::format{"%s --store %s check%s --local --format json"} % composectl_cmd_ % storeRoot() %
+               uris_to_check,
+           "", "", &output);
+      const auto fetch_status{parseJSON(output)};
+      if (fetch_status.isMember("fetch_check") && fetch_status["fetch_check"].isMember("missing_blobs") &&
+          fetch_status["fetch_check"]["missing_blobs"].empty()) {
+        for (const auto& app : apps) {
+          addToFetchedApps(app.uri);
+        }
+      }
+    } catch (const std::exception& exc) {
+      LOG_DEBUG << "not all apps are fully fetched, checking them one by one; status: " << exc.what();
+    }
+  }
+
+  if (fetch_status_only) {
+    return;
+  }
+  // `composectl ps` reports the status of each app under its URI
+  std::string uris;
+  for (const auto& app : apps) {
+    uris += " " + app.uri;
+  }
+  try {
+    std::string output;
+    exec(boost::format{"%s --store %s --compose %s ps%s --format json"} % composectl_cmd_ % storeRoot() %
+             installRoot() % uris,
+         "", "", &output);
+    const auto apps_status{parseJSON(output)};
+    std::lock_guard<std::mutex> lock{apps_status_mutex_};
+    for (const auto& app : apps) {
+      if (apps_status.isMember(app.uri)) {
+        apps_status_[app.uri] = apps_status[app.uri];
+      }
+    }
+  } catch (const std::exception& exc) {
+    LOG_DEBUG << "failed to get status of apps, checking them one by one; err: " << exc.what();
+  }
+}
+
 bool AppEngine::isAppFetched(const App& app) const {
   bool res{false};
-  if (fetched_apps_.count(app.uri) > 0) {
+  if (isInFetchedApps(app.uri)) {
     return true;
   }
   try {
@@ -179,7 +270,7 @@ bool AppEngine::isAppFetched(const App& app) const {
     if (app_fetch_status.isMember("fetch_check") && app_fetch_status["fetch_check"].isMember("missing_blobs")) {
       if (app_fetch_status["fetch_check"]["missing_blobs"].empty()) {
         res = true;
-        fetched_apps_.insert(app.uri);
+        addToFetchedApps(app.uri);
       } else {
         LOG_INFO << "Missing blobs of " << app.uri;
         for (const auto& blob : app_fetch_status["fetch_check"]["missing_blobs"]) {
@@ -220,11 +311,48 @@ bool AppEngine::isAppInstalled(const App& app) const {
 }
 
 void AppEngine::installAppAndImages(const App& app) {
+  dropCachedAppStatus(app.uri);
   exec(boost::format{"%s --store %s --compose %s --host %s install %s"} % composectl_cmd_ % storeRoot() %
            installRoot() % dockerHost() % app.uri,
        "failed to install compose app", "", nullptr, "4h", true);
 }
 
+bool AppEngine::isInFetchedApps(const std::string& uri) const {
+  std::lock_guard<std::mutex> lock{fetched_apps_mutex_};
+  return fetched_apps_.count(uri) > 0;
+}
+
+void AppEngine::addToFetchedApps(const std::string& uri) const {
+  std::lock_guard<std::mutex> lock{fetched_apps_mutex_};
+  fetched_apps_.insert(uri);
+}
+
+void AppEngine::removeFromFetchedApps(const std::string& uri) const {
+  std::lock_guard<std::mutex> lock{fetched_apps_mutex_};
+  fetched_apps_.erase(uri);
+}
+
+bool AppEngine::getCachedAppStatus(const App& app, Json::Value& status) const {
+  std::lock_guard<std::mutex> lock{apps_status_mutex_};
+  auto found_it{apps_status_.find(app.uri)};
+  if (found_it == apps_status_.end()) {
+    return false;
+  }
+  // the cached status is in the same format as the output of `composectl ps <app-uri>`
+  status[app.uri] = found_it->second;
+  return true;
+}
+
+void AppEngine::clearAppsStatusCache() {
+  std::lock_guard<std::mutex> lock{apps_status_mutex_};
+  apps_status_.clear();
+}
+
+void AppEngine::dropCachedAppStatus(const std::string& uri) const {
+  std::lock_guard<std::mutex> lock{apps_status_mutex_};
+  apps_status_.erase(uri);
+}
+
 static bool checkAppStatus(const AppEngine::App& app, const Json::Value& status) {
   if (!status.isMember(app.uri)) {
     LOG_ERROR << "could not get app status; uri: " << app.uri;
@@ -296,4 +424,22 @@ static Json::Value parseJSON(const std::string& json_str) {
   return json_value;
 }
 
+static std::map<std::string, uint64_t> listStoreBlobs(const boost::filesystem::path& blobs_dir) {
+  std::map<std::string, uint64_t> blobs;
+  boost::system::error_code ec;
+  for (boost::filesystem::directory_iterator it{blobs_dir, ec}, end; !ec && it != end; it.increment(ec)) {
+    const auto hash{it->path().filename().string()};
+    // skip the files that can't be a blob, e.g. the ones being written
+    if (hash.size() != 64 || !boost::filesystem::is_regular_file(it->status())) {
+      continue;
+    }
+    const auto size{boost::filesystem::file_size(it->path(), ec)};
+    if (!ec) {
+      blobs.emplace(hash, size);
+    }
+    ec.clear();
+  }
+  return blobs;
+}
+
 }  // namespace composeapp
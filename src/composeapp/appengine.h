@@ -1,6 +1,8 @@
 #ifndef AKTUALIZR_LITE_COMPOSEAPP_APP_ENGINE_H
 #define AKTUALIZR_LITE_COMPOSEAPP_APP_ENGINE_H
 
+#include <mutex>
+
 #include "docker/restorableappengine.h"
 
 namespace composeapp {
@@ -31,6 +33,8 @@ class AppEngine : public Docker::RestorableAppEngine {
   bool isRunning(const App& app) const override;
   Json::Value getRunningAppsInfo() const override;
   void prune(const Apps& app_shortlist) override;
+  void cacheAppsStatus(const Apps& apps, bool fetch_status_only = false) override;
+  void clearAppsStatusCache() override;
 
  private:
   bool isAppFetched(const App& app) const override;
@@ -41,7 +45,18 @@ class AppEngine : public Docker::RestorableAppEngine {
   const int storage_watermark_;
   const std::string local_source_path_;
   ProxyProvider proxy_;
+  bool isInFetchedApps(const std::string& uri) const;
+  void addToFetchedApps(const std::string& uri) const;
+  void removeFromFetchedApps(const std::string& uri) const;
+  bool getCachedAppStatus(const App& app, Json::Value& status) const;
+  void dropCachedAppStatus(const std::string& uri) const;
+
+  // the app status checks may be invoked concurrently, hence the guarded access to the fetched app cache
+  mutable std::mutex fetched_apps_mutex_;
   mutable std::set<std::string> fetched_apps_;
+  // the output of the batched `composectl ps` for each app, kept until the apps status check is over
+  mutable std::mutex apps_status_mutex_;
+  mutable std::map<std::string, Json::Value> apps_status_;
 };
 
 }  // namespace composeapp
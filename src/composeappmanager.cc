@@ -1,14 +1,20 @@
 #include "composeappmanager.h"
 
+#include <algorithm>
 #include <set>
+#include <vector>
 
+#include <boost/algorithm/hex.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/format.hpp>
 #include <boost/range/iterator_range_core.hpp>
 
 #include "bootloader/bootloaderlite.h"
+#include "crypto/crypto.h"
 #include "docker/restorableappengine.h"
+#include "fetchstats.h"
 #include "target.h"
+#include "workerpool.h"
 #ifdef USE_COMPOSEAPP_ENGINE
 #include "composeapp/appengine.h"
 #endif  // USE_COMPOSEAPP_ENGINE
@@ -93,6 +99,48 @@ ComposeAppManager::Config::Config(const PackageConfig& pconfig) {
     stop_apps_before_update = boost::lexical_cast<bool>(raw.at("stop_apps_before_update"));
   }
 
+  if (raw.count("apps_deep_verify") > 0) {
+    apps_deep_verify = boost::lexical_cast<bool>(raw.at("apps_deep_verify"));
+  }
+
+  if (raw.count("apps_check_concurrency") > 0) {
+    const std::string concurrency_str{raw.at("apps_check_concurrency")};
+    try {
+      apps_check_concurrency = std::stoi(concurrency_str);
+    } catch (const std::exception& exc) {
+      LOG_ERROR << "Invalid sota.toml:pacman:apps_check_concurrency value, should be an integer, got "
+                << concurrency_str << ", err: " << exc.what();
+      throw;
+    }
+    if (apps_check_concurrency < 1 || apps_check_concurrency > AppsCheckConcurrencyHighLimit) {
+      throw std::invalid_argument(
+          "Unsupported value of sota.toml:pacman:apps_check_concurrency; should be within [1," +
+          std::to_string(AppsCheckConcurrencyHighLimit) + "] range, got " + concurrency_str);
+    }
+  }
+
+  if (raw.count("blob_parallel_download_threshold") > 0) {
+    blob_parallel_download_threshold = boost::lexical_cast<size_t>(raw.at("blob_parallel_download_threshold"));
+  }
+
+  if (raw.count("blob_parallel_download_connections") > 0) {
+    const std::string connections_str{raw.at("blob_parallel_download_connections")};
+    try {
+      blob_parallel_download_connections = std::stoi(connections_str);
+    } catch (const std::exception& exc) {
+      LOG_ERROR << "Invalid sota.toml:pacman:blob_parallel_download_connections value, should be an integer, got "
+                << connections_str << ", err: " << exc.what();
+      throw;
+    }
+    if (blob_parallel_download_connections < 1 ||
+        blob_parallel_download_connections > Docker::RegistryClient::MaxParallelDownloadConnections) {
+      throw std::invalid_argument(
+          "Unsupported value of sota.toml:pacman:blob_parallel_download_connections; should be within [1," +
+          std::to_string(Docker::RegistryClient::MaxParallelDownloadConnections) + "] range, got " +
+          connections_str);
+    }
+  }
+
   if (raw.count("storage_watermark") > 0) {
     const std::string storage_watermark_str{raw.at("storage_watermark")};
 
@@ -124,7 +172,9 @@ ComposeAppManager::ComposeAppManager(const PackageConfig& pconfig, const Bootloa
       cfg_{pconfig},
       app_engine_{std::move(app_engine)} {
   if (!app_engine_) {
-    auto registry_client{std::make_shared<Docker::RegistryClient>(http, cfg_.hub_auth_creds_endpoint)};
+    auto registry_client{std::make_shared<Docker::RegistryClient>(
+        http, cfg_.hub_auth_creds_endpoint, Docker::RegistryClient::DefaultHttpClientFactory,
+        cfg_.blob_parallel_download_threshold, cfg_.blob_parallel_download_connections)};
     std::string compose_cmd{boost::filesystem::canonical(cfg_.compose_bin).string() + " "};
 
     if (cfg_.compose_bin.filename().compare("docker") == 0) {
@@ -144,6 +194,11 @@ ComposeAppManager::ComposeAppManager(const PackageConfig& pconfig, const Bootloa
     LOG_DEBUG << "Compose utility: `" << compose_cmd << "`";
 
     std::string docker_host{"unix:///var/run/docker.sock"};
+    // the client's container state cache is kept current by the dockerd's event stream, so the App status checks
+    // made on each check-in don't list all containers every time
+    auto docker_client{std::make_shared<Docker::DockerClient>(
+        Docker::DockerClient::DefaultHttpClientFactory(docker_host),
+        Docker::DockerClient::DefaultEventsHttpClientFactory(docker_host))};
 
     if (!!cfg_.reset_apps) {
       if (std::getenv("DOCKER_HOST") != nullptr) {
@@ -166,20 +221,21 @@ ComposeAppManager::ComposeAppManager(const PackageConfig& pconfig, const Bootloa
         };
       }
       app_engine_ = std::make_shared<composeapp::AppEngine>(
-          cfg_.reset_apps_root, cfg_.apps_root, cfg_.images_data_root, registry_client,
-          std::make_shared<Docker::DockerClient>(), docker_host, compose_cmd, composectl_cmd, cfg_.storage_watermark,
+          cfg_.reset_apps_root, cfg_.apps_root, cfg_.images_data_root, registry_client, docker_client, docker_host,
+          compose_cmd, composectl_cmd, cfg_.storage_watermark,
           Docker::RestorableAppEngine::GetDefStorageSpaceFunc(cfg_.storage_watermark), nullptr, true, "", proxy);
 #else
       const std::string skopeo_cmd{boost::filesystem::canonical(cfg_.skopeo_bin).string()};
       app_engine_ = std::make_shared<Docker::RestorableAppEngine>(
-          cfg_.reset_apps_root, cfg_.apps_root, cfg_.images_data_root, registry_client,
-          std::make_shared<Docker::DockerClient>(), skopeo_cmd, docker_host, compose_cmd,
-          Docker::RestorableAppEngine::GetDefStorageSpaceFunc(cfg_.storage_watermark));
+          cfg_.reset_apps_root, cfg_.apps_root, cfg_.images_data_root, registry_client, docker_client, skopeo_cmd,
+          docker_host, compose_cmd, Docker::RestorableAppEngine::GetDefStorageSpaceFunc(cfg_.storage_watermark),
+          [](const Docker::Uri& /* app_uri */, const std::string& image_uri) { return "docker://" + image_uri; }, true,
+          false, cfg_.apps_deep_verify);
 #endif  // USE_COMPOSEAPP_ENGINE
       is_restorable_engine_ = true;
     } else {
-      app_engine_ = std::make_shared<Docker::ComposeAppEngine>(
-          cfg_.apps_root, compose_cmd, std::make_shared<Docker::DockerClient>(), registry_client);
+      app_engine_ =
+          std::make_shared<Docker::ComposeAppEngine>(cfg_.apps_root, compose_cmd, docker_client, registry_client);
     }
   }
 }
@@ -225,6 +281,7 @@ ComposeAppManager::AppsContainer ComposeAppManager::getAppsToUpdate(const Uptane
 
   auto currently_installed_target_apps = Target::appsJson(OstreeManager::getCurrent());
   auto new_target_apps = getApps(t);  // intersection of apps specified in Target and the configuration
+  AppEngine::Apps apps_to_check;
 
   for (const auto& app_pair : new_target_apps) {
     const auto& app_name = app_pair.first;
@@ -246,21 +303,46 @@ ComposeAppManager::AppsContainer ComposeAppManager::getAppsToUpdate(const Uptane
       continue;
     }
 
-    LOG_DEBUG << app_name << " performing full status check";
-    if (!app_engine_->isRunning({app_name, app_pair.second})) {
-      // an App that is supposed to be running is not running or is not fully installed
-      apps_to_update.insert(app_pair);
-      apps_and_reasons[app_pair.first] = "not running";
-      continue;
-    }
-    if (!app_engine_->isFetched({app_name, app_pair.second})) {
-      // an App that is supposed to be installed is not fully fetched
-      apps_to_update.insert(app_pair);
-      apps_and_reasons[app_pair.first] = "not fetched";
-      LOG_INFO << app_name << " is not fully fetched; missing blobs will be fetched";
-      continue;
+    apps_to_check.emplace_back(AppEngine::App{app_name, app_pair.second});
+  }
+
+  // Run a full status check of the apps which are supposed to be installed and running concurrently since each check
+  // may take a while, e.g. it may spawn a child process. The results are processed in the order of the checked apps.
+  enum class AppStatus { Ok, NotRunning, NotFetched };
+  std::sort(apps_to_check.begin(), apps_to_check.end(),
+            [](const AppEngine::App& lhs, const AppEngine::App& rhs) { return lhs.name < rhs.name; });
+  std::vector<AppStatus> app_statuses(apps_to_check.size(), AppStatus::Ok);
+  {
+    // let the engine query the status of all the apps at once if it is capable of it
+    const AppEngine::AppsStatusCache status_cache{*app_engine_, apps_to_check};
+    forEachConcurrently(apps_to_check.size(), cfg_.apps_check_concurrency, [&](std::size_t ii) {
+      const auto& app{apps_to_check[ii]};
+      LOG_DEBUG << app.name << " performing full status check";
+      if (!app_engine_->isRunning(app)) {
+        app_statuses[ii] = AppStatus::NotRunning;
+      } else if (!app_engine_->isFetched(app)) {
+        app_statuses[ii] = AppStatus::NotFetched;
+      }
+    });
+  }
+
+  for (std::size_t ii = 0; ii < apps_to_check.size(); ++ii) {
+    const auto& app{apps_to_check[ii]};
+    switch (app_statuses[ii]) {
+      case AppStatus::NotRunning:
+        // an App that is supposed to be running is not running or is not fully installed
+        apps_to_update.emplace(app.name, app.uri);
+        apps_and_reasons[app.name] = "not running";
+        break;
+      case AppStatus::NotFetched:
+        // an App that is supposed to be installed is not fully fetched
+        apps_to_update.emplace(app.name, app.uri);
+        apps_and_reasons[app.name] = "not fetched";
+        LOG_INFO << app.name << " is not fully fetched; missing blobs will be fetched";
+        break;
+      default:
+        fetched_apps.insert(app.name);
     }
-    fetched_apps.insert(app_name);
   }
 
   return apps_to_update;
@@ -296,6 +378,7 @@ ComposeAppManager::AppsSyncReason ComposeAppManager::checkForAppsToUpdate(const
 }
 
 DownloadResult ComposeAppManager::Download(const TufTarget& target) {
+  fetch_stats_ = Json::Value();
   auto ostree_download_res{RootfsTreeManager::Download(target)};
   if (!ostree_download_res) {
     return ostree_download_res;
@@ -312,9 +395,13 @@ DownloadResult ComposeAppManager::Download(const TufTarget& target) {
     stat_msg << res.description << "\nbefore apps pull: " << pre_pull_fs_usage;
     LOG_INFO << "Pre Apps pull storage usage info; " << pre_pull_fs_usage;
   }
+  Json::Value apps_fetch_stats;
   for (const auto& pair : all_apps_to_fetch) {
     LOG_INFO << "Fetching " << pair.first << " -> " << pair.second;
     const auto fetch_res{app_engine_->fetch({pair.first, pair.second})};
+    if (!fetch_res.fetch_stats.isNull()) {
+      apps_fetch_stats[pair.first] = fetch_res.fetch_stats;
+    }
     if (!fetch_res) {
       const std::string err_desc{boost::str(boost::format("failed to fetch App; app: %s; uri: %s; %s") % pair.first %
                                             pair.second % fetch_res.err)};
@@ -335,6 +422,12 @@ DownloadResult ComposeAppManager::Download(const TufTarget& target) {
     res.description = stat_msg.str();
     LOG_INFO << "Post Apps pull storage usage info; " << post_pull_fs_usage;
   }
+  if (!apps_fetch_stats.isNull()) {
+    fetch_stats_ = FetchStats::summarize(apps_fetch_stats);
+    LOG_INFO << "Apps fetch stats; fetched " << fetch_stats_["bytes_done"].asUInt64() << " of "
+             << fetch_stats_["bytes_total"].asUInt64() << " bytes in " << fetch_stats_["duration_ms"].asInt64()
+             << " ms, " << fetch_stats_["bytes_per_sec"].asUInt64() << " bytes/sec";
+  }
 
   return res;
 }
@@ -710,34 +803,63 @@ Json::Value ComposeAppManager::getAppsState() const {
 
 bool ComposeAppManager::compareAppsStates(const Json::Value& left, const Json::Value& right) {
   // Unfortunately we cannot just compare json docs (Json::Value == Json::Value) because the App status
-  // includes Apps running duration which obviously changes as time goes.
-  // An input jsons are dicts of Apps, an app name is the dict key.
+  // includes Apps running duration which obviously changes as time goes, so digests of their canonical states
+  // are compared instead. An input jsons are dicts of Apps, an app name is the dict key.
   if (!left.isMember("apps") && !right.isMember("apps")) {
     // no states at all, considered equal
     return true;
   }
-  if (left.size() != right.size()) {
+  if (left.isMember("apps") != right.isMember("apps")) {
     // "apps" are present in one and missing in another
     return false;
   }
-  if (left["apps"].size() != right["apps"].size()) {
-    // Different quantity of Apps
+  if (left["ostree"] != right["ostree"]) {
     return false;
   }
-  for (Json::ValueConstIterator ii = left["apps"].begin(); ii != left["apps"].end(); ++ii) {
-    const auto app_name{ii.key().asString()};
-    if (!right["apps"].isMember(app_name)) {
-      // Different set of Apps
-      return false;
+  return getAppsStateDigests(left) == getAppsStateDigests(right);
+}
+
+ComposeAppManager::AppsStateDigests ComposeAppManager::getAppsStateDigests(const Json::Value& apps_state) {
+  AppsStateDigests digests;
+  const auto& apps{apps_state["apps"]};
+  if (!apps.isObject()) {
+    return digests;
+  }
+  for (Json::ValueConstIterator ii = apps.begin(); ii != apps.end(); ++ii) {
+    digests.emplace(ii.key().asString(), getAppStateDigest(*ii));
+  }
+  return digests;
+}
+
+std::string ComposeAppManager::getAppStateDigest(const Json::Value& app) {
+  Json::Value canonical_state;
+  if (app.isObject()) {
+    canonical_state["uri"] = app["uri"];
+    canonical_state["state"] = app["state"];
+    // the order of services depends on the order in which containers are listed by dockerd
+    std::vector<std::string> service_digests;
+    for (const auto& service : app["services"]) {
+      service_digests.emplace_back(getServiceStateDigest(service));
     }
-    if ((*ii)["state"] != right["apps"][app_name]["state"] || (*ii)["uri"] != right["apps"][app_name]["uri"]) {
-      return false;
+    std::sort(service_digests.begin(), service_digests.end());
+    canonical_state["services"] = Json::arrayValue;
+    for (const auto& digest : service_digests) {
+      canonical_state["services"].append(digest);
     }
-    if ((*ii)["services"].size() != right["apps"][app_name]["services"].size()) {
-      return false;
+  }
+  return boost::algorithm::to_lower_copy(
+      boost::algorithm::hex(Crypto::sha256digest(Utils::jsonToCanonicalStr(canonical_state))));
+}
+
+std::string ComposeAppManager::getServiceStateDigest(const Json::Value& service) {
+  Json::Value canonical_state;
+  if (service.isObject()) {
+    for (const auto& field : {"name", "hash", "image", "state", "health"}) {
+      canonical_state[field] = service[field];
     }
   }
-  return true;
+  return boost::algorithm::to_lower_copy(
+      boost::algorithm::hex(Crypto::sha256digest(Utils::jsonToCanonicalStr(canonical_state))));
 }
 
 ComposeAppManager::AppsContainer ComposeAppManager::getRequiredApps(const Config& cfg, const Uptane::Target& target) {
@@ -783,7 +905,7 @@ ComposeAppManager::AppsContainer ComposeAppManager::getAppsToFetch(const Uptane:
     return enabled_apps;
   }
 
-  AppsContainer apps_to_be_fetched;
+  AppEngine::Apps apps_to_check;
   for (const auto& app : enabled_apps) {
     if (checked_apps != nullptr && checked_apps->count(app.first) > 0) {
       // no reason to check whether app is fetched since app is checked and marked for update because
@@ -795,8 +917,23 @@ ComposeAppManager::AppsContainer ComposeAppManager::getAppsToFetch(const Uptane:
       // app is enabled for running.
       continue;
     }
-    if (!app_engine_->isFetched({app.first, app.second})) {
-      apps_to_be_fetched.insert(app);
+    apps_to_check.emplace_back(AppEngine::App{app.first, app.second});
+  }
+
+  std::sort(apps_to_check.begin(), apps_to_check.end(),
+            [](const AppEngine::App& lhs, const AppEngine::App& rhs) { return lhs.name < rhs.name; });
+  // std::vector<bool> is not suitable for a concurrent update of its elements
+  std::vector<char> are_fetched(apps_to_check.size(), 0);
+  {
+    const AppEngine::AppsStatusCache status_cache{*app_engine_, apps_to_check, true};
+    forEachConcurrently(apps_to_check.size(), cfg_.apps_check_concurrency,
+                        [&](std::size_t ii) { are_fetched[ii] = app_engine_->isFetched(apps_to_check[ii]) ? 1 : 0; });
+  }
+
+  AppsContainer apps_to_be_fetched;
+  for (std::size_t ii = 0; ii < apps_to_check.size(); ++ii) {
+    if (are_fetched[ii] == 0) {
+      apps_to_be_fetched.emplace(apps_to_check[ii].name, apps_to_check[ii].uri);
     }
   }
 
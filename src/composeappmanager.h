@@ -2,6 +2,7 @@
 #define AKTUALIZR_LITE_COMPOSE_APP_MANAGER_H_
 
 #include <functional>
+#include <map>
 #include <memory>
 #include <set>
 #include <unordered_map>
@@ -14,6 +15,7 @@
 class ComposeAppManager : public RootfsTreeManager {
  public:
   static constexpr const char* const Name{"ostree+compose_apps"};
+  static const int AppsCheckConcurrencyHighLimit{16};
 
   struct Config {
    public:
@@ -40,6 +42,10 @@ class ComposeAppManager : public RootfsTreeManager {
     bool create_containers_before_reboot{true};
     bool stop_apps_before_update{true};
     int storage_watermark{80};
+    bool apps_deep_verify{false};
+    int apps_check_concurrency{1};
+    size_t blob_parallel_download_threshold{0};
+    int blob_parallel_download_connections{4};
   };
 
   using AppsContainer = std::unordered_map<std::string, std::string>;
@@ -74,7 +80,18 @@ class ComposeAppManager : public RootfsTreeManager {
   }
   void handleRemovedApps(const Uptane::Target& target) const;
   Json::Value getAppsState() const;
+  // Statistics of the Apps fetch done by the last Download() call (see FetchStats::summarize()), null if no App
+  // has been fetched
+  const Json::Value& getFetchStats() const { return fetch_stats_; }
+  // Maps an App name to the digest of its state, see getAppStateDigest()
+  using AppsStateDigests = std::map<std::string, std::string>;
   static bool compareAppsStates(const Json::Value& left, const Json::Value& right);
+  static AppsStateDigests getAppsStateDigests(const Json::Value& apps_state);
+  // Digest of the canonical App state, i.e. the App URI and state along with the digests of its services' state.
+  // The fields that change over time regardless of the actual state (e.g. `status` that includes a container uptime,
+  // `logs`) are not taken into account.
+  static std::string getAppStateDigest(const Json::Value& app);
+  static std::string getServiceStateDigest(const Json::Value& service);
   static AppsContainer getRequiredApps(const Config& cfg, const Uptane::Target& target);
 
  private:
@@ -95,6 +112,7 @@ class ComposeAppManager : public RootfsTreeManager {
   mutable AppsContainer cur_apps_to_fetch_and_update_;
   mutable AppsContainer cur_apps_to_fetch_;
   bool are_apps_checked_{false};
+  Json::Value fetch_stats_;
   AppEngine::Ptr app_engine_;
   bool is_restorable_engine_{false};
 };
@@ -0,0 +1,83 @@
+#include "compression.h"
+
+#include <zlib.h>
+
+#include <array>
+#include <stdexcept>
+
+// zlib adds the gzip header and trailer instead of the zlib ones if 16 is added to the window bits
+static const int GzipWindowBits{15 + 16};
+static const size_t ChunkSize{16 * 1024};
+
+ContentEncoding parseContentEncoding(const std::string& value) {
+  if (value.empty() || value == "none" || value == "identity") {
+    return ContentEncoding::Identity;
+  }
+  if (value == "gzip") {
+    return ContentEncoding::Gzip;
+  }
+  throw std::invalid_argument("Unsupported content encoding: " + value + ", supported: none, gzip");
+}
+
+std::string contentEncodingToString(ContentEncoding encoding) {
+  return encoding == ContentEncoding::Gzip ? "gzip" : "identity";
+}
+
+std::string gzip(const std::string& data) {
+  z_stream stream{};
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, GzipWindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    throw std::runtime_error("Failed to initialize gzip compression: " + std::string(stream.msg ? stream.msg : ""));
+  }
+  std::string compressed;
+  compressed.reserve(deflateBound(&stream, data.size()));
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  stream.avail_in = static_cast<uInt>(data.size());
+
+  std::array<char, ChunkSize> chunk{};
+  int res;
+  do {
+    stream.next_out = reinterpret_cast<Bytef*>(chunk.data());
+    stream.avail_out = chunk.size();
+    res = deflate(&stream, Z_FINISH);
+    if (res == Z_STREAM_ERROR) {
+      deflateEnd(&stream);
+      throw std::runtime_error("Failed to gzip data");
+    }
+    compressed.append(chunk.data(), chunk.size() - stream.avail_out);
+  } while (res != Z_STREAM_END);
+  deflateEnd(&stream);
+  return compressed;
+}
+
+std::string gunzip(const std::string& data, size_t max_size) {
+  z_stream stream{};
+  if (inflateInit2(&stream, GzipWindowBits) != Z_OK) {
+    throw std::runtime_error("Failed to initialize gzip decompression: " + std::string(stream.msg ? stream.msg : ""));
+  }
+  std::string decompressed;
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  stream.avail_in = static_cast<uInt>(data.size());
+
+  std::array<char, ChunkSize> chunk{};
+  int res;
+  do {
+    stream.next_out = reinterpret_cast<Bytef*>(chunk.data());
+    stream.avail_out = chunk.size();
+    res = inflate(&stream, Z_NO_FLUSH);
+    if (res != Z_OK && res != Z_STREAM_END) {
+      const std::string err{stream.msg ? stream.msg : "truncated or invalid data"};
+      inflateEnd(&stream);
+      throw std::runtime_error("Failed to gunzip data: " + err);
+    }
+    decompressed.append(chunk.data(), chunk.size() - stream.avail_out);
+    if (decompressed.size() > max_size) {
+      inflateEnd(&stream);
+      throw std::runtime_error("Failed to gunzip data: decompressed data exceed the limit of " +
+                               std::to_string(max_size) + " bytes");
+    }
+  } while (res != Z_STREAM_END);
+  inflateEnd(&stream);
+  return decompressed;
+}
+
+bool isGzip(const std::string& data) { return data.size() >= 2 && data[0] == '\x1f' && data[1] == '\x8b'; }
@@ -0,0 +1,24 @@
+#ifndef AKTUALIZR_LITE_COMPRESSION_H_
+#define AKTUALIZR_LITE_COMPRESSION_H_
+
+#include <limits>
+#include <string>
+
+// Content coding applied to bodies of requests sent to Device Gateway, the value of the `Content-Encoding` header
+enum class ContentEncoding {
+  Identity,
+  Gzip,
+};
+
+// Parses a sota.toml value, either "none" or "gzip", throws std::invalid_argument if the value is not supported
+ContentEncoding parseContentEncoding(const std::string& value);
+std::string contentEncodingToString(ContentEncoding encoding);
+
+// Compresses/decompresses data in the gzip format (RFC 1952), throw std::runtime_error on failure.
+// `max_size` limits the size of decompressed data, so a small compressed body cannot expand into a huge one.
+std::string gzip(const std::string& data);
+std::string gunzip(const std::string& data, size_t max_size = std::numeric_limits<size_t>::max());
+// checks whether data starts with the gzip magic number, a JSON document never does
+bool isGzip(const std::string& data);
+
+#endif  // AKTUALIZR_LITE_COMPRESSION_H_
@@ -0,0 +1,293 @@
+#include "connectivitymonitor.h"
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <array>
+#include <cerrno>
+#include <cstring>
+
+#include "curl/curl.h"
+
+#include "logging/logging.h"
+
+namespace {
+
+const size_t NetlinkBufferSize{32 * 1024};
+
+// Sends a dump request of the given type over a new rtnetlink socket and passes each received message to `handler`
+bool dumpNetlink(uint16_t type, const std::function<void(const nlmsghdr*)>& handler) {
+  const int fd{::socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE)};
+  if (fd == -1) {
+    return false;
+  }
+  struct {
+    nlmsghdr header;
+    rtgenmsg msg;
+  } req{};
+  req.header.nlmsg_len = NLMSG_LENGTH(sizeof(rtgenmsg));
+  req.header.nlmsg_type = type;
+  req.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  req.header.nlmsg_seq = 1;
+  req.msg.rtgen_family = AF_UNSPEC;
+  if (::send(fd, &req, req.header.nlmsg_len, 0) == -1) {
+    ::close(fd);
+    return false;
+  }
+
+  std::vector<char> buffer(NetlinkBufferSize);
+  bool done{false};
+  bool ok{true};
+  while (!done && ok) {
+    const auto read_size{::recv(fd, buffer.data(), buffer.size(), 0)};
+    if (read_size <= 0) {
+      if (read_size == -1 && errno == EINTR) {
+        continue;
+      }
+      ok = false;
+      break;
+    }
+    auto len{static_cast<unsigned int>(read_size)};
+    for (auto* msg{reinterpret_cast<const nlmsghdr*>(buffer.data())}; NLMSG_OK(msg, len); msg = NLMSG_NEXT(msg, len)) {
+      if (msg->nlmsg_type == NLMSG_DONE) {
+        done = true;
+        break;
+      }
+      if (msg->nlmsg_type == NLMSG_ERROR) {
+        ok = false;
+        break;
+      }
+      handler(msg);
+    }
+  }
+  ::close(fd);
+  return ok;
+}
+
+}  // namespace
+
+ConnectivityMonitor::ConnectivityMonitor(ProbeFunc probe_func) : probe_func_{std::move(probe_func)} {}
+
+void ConnectivityMonitor::start() {
+  if (netlink_fd_ != -1 || stop_fd_ != -1) {
+    return;
+  }
+  bool has_default_route{true};
+  if (!evaluate(has_default_route)) {
+    LOG_WARNING << "rtnetlink is not available, network connectivity is not monitored: " << std::strerror(errno);
+    return;
+  }
+
+  netlink_fd_ = ::socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_ROUTE);
+  sockaddr_nl addr{};
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR | RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE;
+  stop_fd_ = ::eventfd(0, EFD_CLOEXEC);
+  if (netlink_fd_ == -1 || stop_fd_ == -1 ||
+      ::bind(netlink_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    LOG_WARNING << "Failed to subscribe to rtnetlink notifications, network connectivity is not monitored: "
+                << std::strerror(errno);
+    return;
+  }
+  setDefaultRoute(has_default_route);
+  thread_ = std::thread(&ConnectivityMonitor::run, this);
+}
+
+ConnectivityMonitor::~ConnectivityMonitor() {
+  if (thread_.joinable()) {
+    const uint64_t stop{1};
+    if (::write(stop_fd_, &stop, sizeof(stop)) != sizeof(stop)) {
+      LOG_ERROR << "Failed to stop the connectivity monitor: " << std::strerror(errno);
+    }
+    thread_.join();
+  }
+  for (const auto fd : {netlink_fd_, stop_fd_}) {
+    if (fd != -1) {
+      ::close(fd);
+    }
+  }
+}
+
+bool ConnectivityMonitor::hasDefaultRoute() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return has_default_route_;
+}
+
+bool ConnectivityMonitor::isRouteAvailable(const std::string& server) const {
+  return isLoopbackServer(server) || hasDefaultRoute();
+}
+
+bool ConnectivityMonitor::isReachable(const std::string& server) {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    const auto cached_probe{probes_.find(server)};
+    if (cached_probe != probes_.end() &&
+        std::chrono::steady_clock::now() - cached_probe->second.time < ReachabilityTtl) {
+      return cached_probe->second.reachable;
+    }
+  }
+  // probe without holding the lock since it may take a while
+  const auto probe_time{std::chrono::steady_clock::now()};
+  const bool reachable{probe_func_(server)};
+  std::lock_guard<std::mutex> lock{mutex_};
+  probes_[server] = {reachable, probe_time};
+  return reachable;
+}
+
+bool ConnectivityMonitor::waitForDefaultRoute(std::chrono::milliseconds timeout) const {
+  std::unique_lock<std::mutex> lock{mutex_};
+  return cv_.wait_for(lock, timeout, [this]() { return has_default_route_; });
+}
+
+int ConnectivityMonitor::addListener(Listener listener) {
+  std::lock_guard<std::mutex> lock{listeners_mutex_};
+  listeners_.emplace(next_listener_id_, std::move(listener));
+  return next_listener_id_++;
+}
+
+void ConnectivityMonitor::removeListener(int id) {
+  std::lock_guard<std::mutex> lock{listeners_mutex_};
+  listeners_.erase(id);
+}
+
+bool ConnectivityMonitor::probe(const std::string& server) {
+  bool ret = true;
+  CURL* curl = curl_easy_init();
+  if (curl != nullptr) {
+    curl_easy_setopt(curl, CURLOPT_URL, (server).c_str());
+    curl_easy_setopt(curl, CURLOPT_CONNECT_ONLY, 1L);
+    auto curl_ret = curl_easy_perform(curl);
+    // If the device is online, CURLE_PEER_FAILED_VERIFICATION is typically returned.
+    if (curl_ret == CURLE_COULDNT_RESOLVE_HOST) {
+      ret = false;
+    }
+    curl_easy_cleanup(curl);
+  }
+  return ret;
+}
+
+bool ConnectivityMonitor::isLoopbackServer(const std::string& server) {
+  // <scheme>://[user@]host[:port][/path]
+  auto host_begin{server.find("://")};
+  host_begin = host_begin == std::string::npos ? 0 : host_begin + 3;
+  const auto authority{server.substr(host_begin, server.find('/', host_begin) - host_begin)};
+  auto host{authority.substr(authority.find('@') == std::string::npos ? 0 : authority.find('@') + 1)};
+  if (!host.empty() && host[0] == '[') {
+    host = host.substr(1, host.find(']') - 1);
+  } else {
+    host = host.substr(0, host.find(':'));
+  }
+  return host == "localhost" || host == "::1" || host.rfind("127.", 0) == 0;
+}
+
+void ConnectivityMonitor::run() {
+  std::vector<char> buffer(NetlinkBufferSize);
+  std::array<pollfd, 2> fds{pollfd{netlink_fd_, POLLIN, 0}, pollfd{stop_fd_, POLLIN, 0}};
+  while (true) {
+    if (::poll(fds.data(), fds.size(), -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG_ERROR << "Failed to wait for rtnetlink notifications, stopping the connectivity monitor: "
+                << std::strerror(errno);
+      setDefaultRoute(true);
+      return;
+    }
+    if ((fds[1].revents & POLLIN) != 0) {
+      return;
+    }
+    // Drain all pending notifications, the state is re-evaluated as a whole, so the content doesn't matter.
+    // ENOBUFS means some notifications were lost, the state is re-evaluated anyway.
+    while (true) {
+      const auto read_size{::recv(netlink_fd_, buffer.data(), buffer.size(), 0)};
+      if (read_size <= 0 && !(read_size == -1 && (errno == ENOBUFS || errno == EINTR))) {
+        break;
+      }
+    }
+    bool has_default_route{true};
+    if (!evaluate(has_default_route)) {
+      LOG_WARNING << "Failed to read the network configuration: " << std::strerror(errno);
+      continue;
+    }
+    setDefaultRoute(has_default_route);
+  }
+}
+
+int ConnectivityMonitor::getUpLinkIndex(const nlmsghdr* msg) {
+  if (msg->nlmsg_type != RTM_NEWLINK) {
+    return -1;
+  }
+  const auto* link{reinterpret_cast<const ifinfomsg*>(NLMSG_DATA(msg))};
+  if ((link->ifi_flags & IFF_UP) != 0 && (link->ifi_flags & IFF_RUNNING) != 0 &&
+      (link->ifi_flags & IFF_LOOPBACK) == 0) {
+    return link->ifi_index;
+  }
+  return -1;
+}
+
+bool ConnectivityMonitor::isDefaultRoute(const nlmsghdr* msg, const std::unordered_set<int>& up_links) {
+  const auto* route{reinterpret_cast<const rtmsg*>(NLMSG_DATA(msg))};
+  if (msg->nlmsg_type != RTM_NEWROUTE || route->rtm_dst_len != 0 || route->rtm_type != RTN_UNICAST) {
+    return false;
+  }
+  int oif{-1};
+  bool multipath{false};
+  auto attr_len{RTM_PAYLOAD(msg)};
+  for (const auto* attr{RTM_RTA(route)}; RTA_OK(attr, attr_len); attr = RTA_NEXT(attr, attr_len)) {
+    if (attr->rta_type == RTA_OIF) {
+      oif = *reinterpret_cast<const int*>(RTA_DATA(attr));
+    } else if (attr->rta_type == RTA_MULTIPATH) {
+      multipath = true;
+    }
+  }
+  // A default route of any table counts since policy routing may be in use. The nexthops of a multipath route are
+  // not checked, it's assumed that at least one of them is up.
+  return multipath || up_links.count(oif) > 0;
+}
+
+bool ConnectivityMonitor::evaluate(bool& has_default_route) const {
+  std::unordered_set<int> up_links;
+  const bool links_ok{dumpNetlink(RTM_GETLINK, [&up_links](const nlmsghdr* msg) {
+    const auto index{getUpLinkIndex(msg)};
+    if (index != -1) {
+      up_links.insert(index);
+    }
+  })};
+  if (!links_ok) {
+    return false;
+  }
+
+  bool found{false};
+  const bool routes_ok{dumpNetlink(RTM_GETROUTE, [&up_links, &found](const nlmsghdr* msg) {
+    found = found || isDefaultRoute(msg, up_links);
+  })};
+  if (!routes_ok) {
+    return false;
+  }
+  has_default_route = found;
+  return true;
+}
+
+void ConnectivityMonitor::setDefaultRoute(bool has_default_route) {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    // a change of the network configuration may change the reachability, e.g. a new DNS server, so probe it again
+    probes_.clear();
+    if (has_default_route_ == has_default_route) {
+      return;
+    }
+    has_default_route_ = has_default_route;
+  }
+  LOG_INFO << (has_default_route ? "Network connectivity is up" : "Network connectivity is down, no default route");
+  cv_.notify_all();
+  // The listeners are invoked under their own lock rather than the state one, so they can query the state, and a
+  // listener that is being invoked is not removed until it returns.
+  std::lock_guard<std::mutex> lock{listeners_mutex_};
+  for (const auto& listener : listeners_) {
+    listener.second(has_default_route);
+  }
+}
@@ -0,0 +1,98 @@
+#ifndef AKTUALIZR_LITE_CONNECTIVITY_MONITOR_H_
+#define AKTUALIZR_LITE_CONNECTIVITY_MONITOR_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct nlmsghdr;
+
+/**
+ * @brief ConnectivityMonitor, tracks whether a device has a default route over a link that is up
+ *
+ * Once started, the monitor subscribes to rtnetlink link, address and route notifications and re-evaluates the default
+ * route presence on each of them, so it doesn't poll anything while the network configuration stays the same.
+ * A default route is assumed to be present until the monitor is started, e.g. in the CLI mode, or if rtnetlink is
+ * not available (e.g. restricted by a seccomp profile).
+ *
+ * The reachability of a server is probed by establishing a connection to it without the TLS handshake, the result is
+ * cached for `ReachabilityTtl` or until the network configuration changes, so frequent callers (the report queue,
+ * the daemon loop) don't resolve and connect to the server each time they are about to send something.
+ * The lack of a default route doesn't mean that a server is unreachable, e.g. it may be reachable over a static route,
+ * so the server is probed in this case too.
+ */
+class ConnectivityMonitor {
+ public:
+  // Invoked from the monitor's thread each time a default route appears (true) or disappears (false).
+  // A listener must not add or remove listeners.
+  using Listener = std::function<void(bool has_default_route)>;
+  using ProbeFunc = std::function<bool(const std::string& server)>;
+
+  static constexpr std::chrono::seconds ReachabilityTtl{60};
+
+  explicit ConnectivityMonitor(ProbeFunc probe_func = ConnectivityMonitor::probe);
+  virtual ~ConnectivityMonitor();
+  ConnectivityMonitor(const ConnectivityMonitor&) = delete;
+  ConnectivityMonitor(ConnectivityMonitor&&) = delete;
+  ConnectivityMonitor& operator=(const ConnectivityMonitor&) = delete;
+  ConnectivityMonitor& operator=(ConnectivityMonitor&&) = delete;
+
+  // starts monitoring the network configuration in a dedicated thread, the daemon mode only needs it
+  virtual void start();
+  bool hasDefaultRoute() const;
+  // a server on a loopback interface doesn't need a default route, e.g. a local proxy
+  virtual bool isRouteAvailable(const std::string& server) const;
+  // returns the cached or a new probe result regardless of the default route presence
+  bool isReachable(const std::string& server);
+  // blocks until there is a default route or the timeout expires, returns whether there is a default route
+  bool waitForDefaultRoute(std::chrono::milliseconds timeout) const;
+  // returns an ID of the listener that can be used to remove it
+  int addListener(Listener listener);
+  // waits for the listener to return if it's being invoked, so the objects it refers to can be destroyed afterwards
+  void removeListener(int id);
+
+  // Only a failure to resolve the server host name is considered as no connectivity. A device is considered online
+  // if e.g. a connection is refused or a certificate verification fails, since it's not an issue of connectivity.
+  static bool probe(const std::string& server);
+
+  // Evaluate messages of the rtnetlink link and route dumps
+  // returns the index of a non-loopback link that is up and running, or -1
+  static int getUpLinkIndex(const nlmsghdr* msg);
+  static bool isDefaultRoute(const nlmsghdr* msg, const std::unordered_set<int>& up_links);
+
+ protected:
+  void setDefaultRoute(bool has_default_route);
+
+ private:
+  struct Probe {
+    bool reachable;
+    std::chrono::steady_clock::time_point time;
+  };
+
+  static bool isLoopbackServer(const std::string& server);
+  void run();
+  // reads the current links and routes, returns false if rtnetlink is not available
+  bool evaluate(bool& has_default_route) const;
+
+  const ProbeFunc probe_func_;
+  mutable std::mutex mutex_;
+  mutable std::condition_variable cv_;
+  bool has_default_route_{true};
+  std::unordered_map<std::string, Probe> probes_;
+  // held while the listeners are invoked
+  std::mutex listeners_mutex_;
+  std::map<int, Listener> listeners_;
+  int next_listener_id_{0};
+  int netlink_fd_{-1};
+  int stop_fd_{-1};
+  std::thread thread_;
+};
+
+#endif  // AKTUALIZR_LITE_CONNECTIVITY_MONITOR_H_
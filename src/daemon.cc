@@ -1,13 +1,88 @@
+#include <sys/eventfd.h>
 #include <sys/file.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <functional>
 #include <memory>
-#include <thread>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include "aktualizr-lite/aklite_client_ext.h"
 #include "aktualizr-lite/api.h"
+#include "aktualizr-lite/cli/cli.h"
+#include "connectivitymonitor.h"
 #include "daemon.h"
 #include "libaktualizr/config.h"
 #include "liteclient.h"
 #include "logging/logging.h"
+#include "scheduler.h"
+
+namespace {
+
+const std::string CheckInTask{"check-in"};
+const std::string AppsStateReportTask{"apps-state-report"};
+const std::string NetworkInfoReportTask{"network-info-report"};
+const std::string LocalUpdateTask{"local-update"};
+
+struct DaemonConfig {
+  std::chrono::seconds jitter{0};
+  std::chrono::seconds apps_state_report_interval{0};
+  std::chrono::seconds network_info_report_interval{0};
+  boost::filesystem::path local_update_dir;
+};
+
+DaemonConfig getDaemonConfig(const LiteClient& client, uint64_t interval) {
+  const auto& raw{client.config.pacman.extra};
+  DaemonConfig cfg;
+  // spread check-ins of devices started at the same time over 10% of the interval by default
+  cfg.jitter = std::chrono::seconds(interval / 10);
+  if (raw.count("daemon_jitter") == 1) {
+    cfg.jitter = std::chrono::seconds(boost::lexical_cast<uint64_t>(raw.at("daemon_jitter")));
+  }
+  if (raw.count("apps_state_report_interval") == 1) {
+    cfg.apps_state_report_interval =
+        std::chrono::seconds(boost::lexical_cast<uint64_t>(raw.at("apps_state_report_interval")));
+  }
+  if (raw.count("network_info_report_interval") == 1) {
+    cfg.network_info_report_interval =
+        std::chrono::seconds(boost::lexical_cast<uint64_t>(raw.at("network_info_report_interval")));
+  }
+  if (raw.count("local_update_dir") == 1) {
+    cfg.local_update_dir = raw.at("local_update_dir");
+  }
+  return cfg;
+}
+
+// written by the SIGUSR1 handler in order to trigger a check-in
+int check_in_signal_fd{-1};
+
+void onCheckInSignal(int /*signal*/) {
+  const uint64_t wakeup{1};
+  // nothing can be done if it fails, a check-in just occurs at its regular time
+  (void)::write(check_in_signal_fd, &wakeup, sizeof(wakeup));
+}
+
+// Runs a function on exit, e.g. closes a watched file descriptor or unregisters a handler referring to the scheduler
+class Cleanup {
+ public:
+  explicit Cleanup(std::function<void()> func) : func_{std::move(func)} {}
+  ~Cleanup() { func_(); }
+  Cleanup(const Cleanup&) = delete;
+  Cleanup(Cleanup&&) = delete;
+  Cleanup& operator=(const Cleanup&) = delete;
+  Cleanup& operator=(Cleanup&&) = delete;
+
+ private:
+  std::function<void()> func_;
+};
+
+}  // namespace
 
 int run_daemon(LiteClient& client, uint64_t interval, bool return_on_sleep, bool acquire_lock) {
   if (client.config.uptane.repo_server.empty()) {
@@ -31,7 +106,30 @@ int run_daemon(LiteClient& client, uint64_t interval, bool return_on_sleep, bool
 
   Uptane::HardwareIdentifier hwid(client.config.provision.primary_ecu_hardware_id);
 
-  while (true) {
+  const auto cfg{getDaemonConfig(client, interval)};
+  const auto& connectivity_monitor{client.connectivityMonitor()};
+  if (!return_on_sleep && connectivity_monitor) {
+    connectivity_monitor->start();
+  }
+  Scheduler scheduler;
+  bool stop{false};
+  bool check_in_skipped{false};
+
+  // The first check-in is delayed by a jitter too, so devices started at the same time, e.g. after a power outage,
+  // don't check in at the same time. It's not delayed if the daemon runs just one iteration.
+  const bool jitter_first_check_in{!return_on_sleep};
+  scheduler.addTask(CheckInTask, std::chrono::seconds(interval), cfg.jitter, [&]() {
+    if (!return_on_sleep && !check_in_skipped && connectivity_monitor &&
+        !connectivity_monitor->isRouteAvailable(client.config.uptane.repo_server) &&
+        !connectivity_monitor->isReachable(client.config.uptane.repo_server)) {
+      // No point to check in while offline, the check-in is triggered as soon as connectivity is restored.
+      // Check in anyway at the next regular time in case the probe result is wrong.
+      LOG_INFO << "No network connectivity, waiting for it before checking for a new Target...";
+      check_in_skipped = true;
+      return;
+    }
+    check_in_skipped = false;
+
     auto current = akclient.GetCurrent();
     LOG_INFO << "Active Target: " << current.Name() << ", sha256: " << current.Sha256Hash();
     LOG_INFO << "Checking for a new Target...";
@@ -48,17 +146,122 @@ int run_daemon(LiteClient& client, uint64_t interval, bool return_on_sleep, bool
           // no point to continue running TUF cycle (check for update, download, install)
           // since reboot is required to apply/finalize the currently installed update (aka pending update)
           // If a reboot command is set in configuration, and is executed successfully, we will not get to this point
-          break;
+          stop = true;
         }
       }
     }
+  }, jitter_first_check_in);
 
-    if (return_on_sleep) {
-      break;
+  // Apps state and network info are also reported during each check-in if changed, the dedicated tasks allow
+  // reporting the changes more often than the device checks for a new Target.
+  if (cfg.apps_state_report_interval.count() > 0) {
+    scheduler.addTask(AppsStateReportTask, cfg.apps_state_report_interval, cfg.jitter,
+                      [&client]() { client.reportAppsState(); });
+  }
+  if (cfg.network_info_report_interval.count() > 0) {
+    scheduler.addTask(NetworkInfoReportTask, cfg.network_info_report_interval, cfg.jitter,
+                      [&client]() { client.reportNetworkInfo(); });
+  }
+
+  if (!cfg.local_update_dir.empty()) {
+    scheduler.addTask(LocalUpdateTask, std::chrono::seconds(0), std::chrono::seconds(0), [&]() {
+      if (stop || !boost::filesystem::is_directory(cfg.local_update_dir)) {
+        return;
+      }
+      LOG_INFO << "Checking for a new Target in the local update directory: " << cfg.local_update_dir;
+      LocalUpdateSource local_update_source{(cfg.local_update_dir / "tuf").string(),
+                                            (cfg.local_update_dir / "ostree_repo").string(),
+                                            (cfg.local_update_dir / "apps").string()};
+      const auto status{aklite::cli::Install(akclient, -1, "", InstallMode::All, false, &local_update_source)};
+      LOG_INFO << "Local update status: " << static_cast<int>(status);
+      if (akclient.RebootIfRequired()) {
+        stop = true;
+      }
+    });
+    // an update that is already there is applied at startup
+    scheduler.trigger(LocalUpdateTask);
+  }
+
+  // the cleanups are declared after the scheduler, so they are run before it's destroyed
+  std::vector<std::unique_ptr<Cleanup>> cleanups;
+  if (!return_on_sleep) {
+    check_in_signal_fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (check_in_signal_fd != -1) {
+      struct sigaction action {};
+      struct sigaction prev_action {};
+      action.sa_handler = onCheckInSignal;
+      sigemptyset(&action.sa_mask);
+      action.sa_flags = SA_RESTART;
+      sigaction(SIGUSR1, &action, &prev_action);
+      cleanups.emplace_back(std::make_unique<Cleanup>([prev_action]() {
+        sigaction(SIGUSR1, &prev_action, nullptr);
+        ::close(check_in_signal_fd);
+        check_in_signal_fd = -1;
+      }));
+      scheduler.addWatch(check_in_signal_fd, [&scheduler]() {
+        uint64_t signals;
+        if (::read(check_in_signal_fd, &signals, sizeof(signals)) == sizeof(signals)) {
+          LOG_INFO << "SIGUSR1 received, checking for a new Target";
+          scheduler.trigger(CheckInTask);
+        }
+      });
+    } else {
+      LOG_WARNING << "Failed to create an eventfd, a check-in cannot be triggered by SIGUSR1: "
+                  << std::strerror(errno);
     }
 
-    std::this_thread::sleep_for(std::chrono::seconds(interval));
-  }  // while true
+    if (connectivity_monitor) {
+      const auto listener_id{connectivity_monitor->addListener([&scheduler](bool has_default_route) {
+        if (!has_default_route) {
+          return;
+        }
+        // invoked in the connectivity monitor thread, an exception escaping it would terminate the process
+        try {
+          scheduler.trigger(CheckInTask);
+        } catch (const std::exception& exc) {
+          LOG_WARNING << "Failed to trigger a check-in on connectivity restored: " << exc.what();
+        }
+      })};
+      cleanups.emplace_back(std::make_unique<Cleanup>(
+          [&connectivity_monitor, listener_id]() { connectivity_monitor->removeListener(listener_id); }));
+    }
+
+    if (!cfg.local_update_dir.empty()) {
+      // The directory itself may not exist yet, so its parent is watched for the directory being created,
+      // or moved into it, e.g. by a udev rule or a script that copies an update from a removable media.
+      const auto parent_dir{cfg.local_update_dir.parent_path()};
+      const int fd{::inotify_init1(IN_CLOEXEC | IN_NONBLOCK)};
+      if (fd != -1) {
+        cleanups.emplace_back(std::make_unique<Cleanup>([fd]() { ::close(fd); }));
+      }
+      if (fd == -1 || ::inotify_add_watch(fd, parent_dir.c_str(), IN_CREATE | IN_MOVED_TO) == -1) {
+        LOG_WARNING << "Failed to watch " << parent_dir << ", a local update is applied only at startup: "
+                    << std::strerror(errno);
+      } else {
+        const auto dir_name{cfg.local_update_dir.filename().string()};
+        scheduler.addWatch(fd, [fd, dir_name, &scheduler]() {
+          alignas(inotify_event) std::array<char, 4096> buffer;
+          ssize_t read_size;
+          while ((read_size = ::read(fd, buffer.data(), buffer.size())) > 0) {
+            for (ssize_t offset = 0; offset < read_size;) {
+              const auto* event{reinterpret_cast<const inotify_event*>(buffer.data() + offset)};
+              if ((event->mask & IN_ISDIR) != 0 && event->len > 0 && dir_name == event->name) {
+                scheduler.trigger(LocalUpdateTask);
+              }
+              offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+            }
+          }
+        });
+      }
+    }
+  }
 
+  while (true) {
+    scheduler.runDueTasks();
+    if (stop || return_on_sleep) {
+      break;
+    }
+    scheduler.waitForDueTask();
+  }
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,116 @@
+#include "blobindex.h"
+
+#include <sys/stat.h>
+#include <ctime>
+
+#include "logging/logging.h"
+#include "utilities/utils.h"
+
+namespace Docker {
+
+BlobIndex::BlobIndex(boost::filesystem::path index_file) : index_file_{std::move(index_file)} { load(); }
+
+bool BlobIndex::isVerified(const std::string& hash, const boost::filesystem::path& blob_path) const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  const auto found_it{entries_.find(hash)};
+  if (found_it == entries_.end()) {
+    return false;
+  }
+  Entry actual;
+  if (!getEntry(blob_path, actual)) {
+    return false;
+  }
+  return actual == found_it->second;
+}
+
+void BlobIndex::setVerified(const std::string& hash, const boost::filesystem::path& blob_path) {
+  Entry entry;
+  std::lock_guard<std::mutex> lock{mutex_};
+  if (!getEntry(blob_path, entry)) {
+    if (entries_.erase(hash) > 0) {
+      dirty_ = true;
+    }
+    return;
+  }
+  entry.verified_at = std::time(nullptr);
+  entries_[hash] = entry;
+  dirty_ = true;
+}
+
+void BlobIndex::remove(const std::string& hash) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  if (entries_.erase(hash) > 0) {
+    dirty_ = true;
+  }
+}
+
+void BlobIndex::retain(const std::unordered_set<std::string>& hashes) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    if (hashes.count(it->first) == 0) {
+      it = entries_.erase(it);
+      dirty_ = true;
+    } else {
+      ++it;
+    }
+  }
+}
+
+void BlobIndex::flush() {
+  std::lock_guard<std::mutex> lock{mutex_};
+  if (!dirty_) {
+    return;
+  }
+  Json::Value index_json{Json::objectValue};
+  for (const auto& entry : entries_) {
+    Json::Value& e{index_json[entry.first]};
+    e["size"] = Json::UInt64(entry.second.size);
+    e["mtime"] = Json::Int64(entry.second.mtime_ns);
+    e["inode"] = Json::UInt64(entry.second.inode);
+    e["verified_at"] = Json::Int64(entry.second.verified_at);
+  }
+  try {
+    // write to a tmp file and rename it so a power cut in the middle of writing doesn't leave a broken index
+    const boost::filesystem::path tmp_file{index_file_.string() + ".tmp"};
+    Utils::writeFile(tmp_file, Utils::jsonToCanonicalStr(index_json));
+    boost::filesystem::rename(tmp_file, index_file_);
+    dirty_ = false;
+  } catch (const std::exception& exc) {
+    LOG_WARNING << "Failed to store the blob index: " << index_file_ << ", err: " << exc.what();
+  }
+}
+
+bool BlobIndex::getEntry(const boost::filesystem::path& blob_path, Entry& entry) {
+  struct stat st {};
+  if (::stat(blob_path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+    return false;
+  }
+  entry.size = static_cast<uint64_t>(st.st_size);
+  entry.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+  entry.inode = static_cast<uint64_t>(st.st_ino);
+  return true;
+}
+
+void BlobIndex::load() {
+  if (!boost::filesystem::exists(index_file_)) {
+    return;
+  }
+  try {
+    const auto index_json{Utils::parseJSONFile(index_file_)};
+    for (Json::ValueConstIterator ii = index_json.begin(); ii != index_json.end(); ++ii) {
+      Entry entry;
+      entry.size = (*ii)["size"].asUInt64();
+      entry.mtime_ns = (*ii)["mtime"].asInt64();
+      entry.inode = (*ii)["inode"].asUInt64();
+      entry.verified_at = (*ii)["verified_at"].asInt64();
+      entries_.emplace(ii.key().asString(), entry);
+    }
+  } catch (const std::exception& exc) {
+    // the index is just an optimization, all blobs will be re-verified if it cannot be loaded
+    LOG_WARNING << "Failed to load the blob index, dropping it: " << index_file_ << ", err: " << exc.what();
+    entries_.clear();
+    dirty_ = true;
+  }
+}
+
+}  // namespace Docker
@@ -0,0 +1,59 @@
+#ifndef AKTUALIZR_LITE_DOCKER_BLOB_INDEX_H_
+#define AKTUALIZR_LITE_DOCKER_BLOB_INDEX_H_
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <boost/filesystem.hpp>
+
+namespace Docker {
+
+/**
+ * @brief BlobIndex, a persistent record of blobs whose content hash has been verified
+ *
+ * Each entry maps a blob hash to the inode metadata (size, mtime, inode number) the blob file had at the moment of
+ * its successful verification. A blob is considered verified as long as its current inode metadata match the recorded
+ * one, so a caller can skip re-reading and re-hashing the blob content. Any modification of the blob file changes its
+ * mtime (and usually its size or inode) and invalidates the entry.
+ * The index methods can be invoked concurrently.
+ */
+class BlobIndex {
+ public:
+  static constexpr const char* const Filename{"blob-index.json"};
+
+  explicit BlobIndex(boost::filesystem::path index_file);
+
+  bool isVerified(const std::string& hash, const boost::filesystem::path& blob_path) const;
+  void setVerified(const std::string& hash, const boost::filesystem::path& blob_path);
+  void remove(const std::string& hash);
+  // remove all entries except the ones listed in `hashes`
+  void retain(const std::unordered_set<std::string>& hashes);
+  // persist the index if it has been changed since the last flush
+  void flush();
+
+ private:
+  struct Entry {
+    uint64_t size{0};
+    int64_t mtime_ns{0};
+    uint64_t inode{0};
+    int64_t verified_at{0};
+
+    bool operator==(const Entry& rhs) const {
+      return size == rhs.size && mtime_ns == rhs.mtime_ns && inode == rhs.inode;
+    }
+  };
+
+  static bool getEntry(const boost::filesystem::path& blob_path, Entry& entry);
+  void load();
+
+  const boost::filesystem::path index_file_;
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, Entry> entries_;
+  bool dirty_{false};
+};
+
+}  // namespace Docker
+
+#endif  // AKTUALIZR_LITE_DOCKER_BLOB_INDEX_H_
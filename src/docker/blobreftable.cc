@@ -0,0 +1,184 @@
+#include "blobreftable.h"
+
+#include "logging/logging.h"
+#include "utilities/utils.h"
+
+namespace Docker {
+
+BlobRefTable::BlobRefTable(boost::filesystem::path table_file) : table_file_{std::move(table_file)} { load(); }
+
+bool BlobRefTable::has(const std::string& app_version) const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return app_versions_.count(app_version) > 0;
+}
+
+void BlobRefTable::set(const std::string& app_version, const Blobs& blobs) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  auto found_it{app_versions_.find(app_version)};
+  if (found_it != app_versions_.end()) {
+    if (found_it->second == blobs) {
+      return;
+    }
+    // add the new references before removing the old ones so the blobs shared by both don't become garbage
+    addRefs(blobs);
+    removeRefs(found_it->second);
+    found_it->second = blobs;
+  } else {
+    addRefs(blobs);
+    app_versions_.emplace(app_version, blobs);
+  }
+  dirty_ = true;
+}
+
+void BlobRefTable::retain(const std::unordered_set<std::string>& app_versions) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  for (auto it = app_versions_.begin(); it != app_versions_.end();) {
+    if (app_versions.count(it->first) == 0) {
+      removeRefs(it->second);
+      it = app_versions_.erase(it);
+      dirty_ = true;
+    } else {
+      ++it;
+    }
+  }
+}
+
+BlobRefTable::Blobs BlobRefTable::getUnreferencedBlobs(const std::unordered_set<std::string>& app_versions) const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  // count references coming from App versions that are not listed, a blob is unreferenced if all its references do
+  std::unordered_map<std::string, unsigned int> dropped_ref_counts;
+  for (const auto& app_version : app_versions_) {
+    if (app_versions.count(app_version.first) == 0) {
+      for (const auto& hash : app_version.second) {
+        ++dropped_ref_counts[hash];
+      }
+    }
+  }
+  Blobs unreferenced;
+  for (const auto& dropped : dropped_ref_counts) {
+    if (ref_counts_.at(dropped.first) == dropped.second) {
+      unreferenced.emplace(dropped.first);
+    }
+  }
+  return unreferenced;
+}
+
+bool BlobRefTable::isReferenced(const std::string& hash) const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return ref_counts_.count(hash) > 0;
+}
+
+BlobRefTable::Blobs BlobRefTable::getGarbage() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return garbage_;
+}
+
+void BlobRefTable::removeGarbage(const Blobs& hashes) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  for (const auto& hash : hashes) {
+    if (garbage_.erase(hash) > 0) {
+      dirty_ = true;
+    }
+  }
+}
+
+bool BlobRefTable::isSweepRequired() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return sweep_required_;
+}
+
+void BlobRefTable::setSweepRequired(bool required) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  if (sweep_required_ != required) {
+    sweep_required_ = required;
+    dirty_ = true;
+  }
+}
+
+void BlobRefTable::flush() {
+  std::lock_guard<std::mutex> lock{mutex_};
+  if (!dirty_) {
+    return;
+  }
+  Json::Value table_json;
+  table_json["apps"] = Json::Value(Json::objectValue);
+  for (const auto& app_version : app_versions_) {
+    Json::Value& blobs_json{table_json["apps"][app_version.first]};
+    blobs_json = Json::Value(Json::arrayValue);
+    for (const auto& hash : app_version.second) {
+      blobs_json.append(hash);
+    }
+  }
+  table_json["garbage"] = Json::Value(Json::arrayValue);
+  for (const auto& hash : garbage_) {
+    table_json["garbage"].append(hash);
+  }
+  table_json["sweep_required"] = sweep_required_;
+  try {
+    // write to a tmp file and rename it so a power cut in the middle of writing doesn't leave a broken table
+    const boost::filesystem::path tmp_file{table_file_.string() + ".tmp"};
+    Utils::writeFile(tmp_file, Utils::jsonToCanonicalStr(table_json));
+    boost::filesystem::rename(tmp_file, table_file_);
+    dirty_ = false;
+  } catch (const std::exception& exc) {
+    LOG_WARNING << "Failed to store the blob reference table: " << table_file_ << ", err: " << exc.what();
+  }
+}
+
+void BlobRefTable::addRefs(const Blobs& blobs) {
+  for (const auto& hash : blobs) {
+    if (++ref_counts_[hash] == 1) {
+      // a garbage blob that is referenced again must not be swept
+      garbage_.erase(hash);
+    }
+  }
+}
+
+void BlobRefTable::removeRefs(const Blobs& blobs) {
+  for (const auto& hash : blobs) {
+    auto found_it{ref_counts_.find(hash)};
+    if (found_it == ref_counts_.end()) {
+      continue;
+    }
+    if (--found_it->second == 0) {
+      ref_counts_.erase(found_it);
+      garbage_.emplace(hash);
+    }
+  }
+}
+
+void BlobRefTable::load() {
+  if (!boost::filesystem::exists(table_file_)) {
+    // the store may contain blobs fetched before the table was introduced
+    sweep_required_ = true;
+    return;
+  }
+  try {
+    const auto table_json{Utils::parseJSONFile(table_file_)};
+    const auto& apps_json{table_json["apps"]};
+    for (Json::ValueConstIterator ii = apps_json.begin(); ii != apps_json.end(); ++ii) {
+      Blobs blobs;
+      for (const auto& hash : *ii) {
+        blobs.emplace(hash.asString());
+      }
+      addRefs(blobs);
+      app_versions_.emplace(ii.key().asString(), std::move(blobs));
+    }
+    for (const auto& hash : table_json["garbage"]) {
+      if (ref_counts_.count(hash.asString()) == 0) {
+        garbage_.emplace(hash.asString());
+      }
+    }
+    sweep_required_ = table_json["sweep_required"].asBool();
+  } catch (const std::exception& exc) {
+    // the table is rebuilt by the next prune, which sweeps the whole store to find the blobs it missed
+    LOG_WARNING << "Failed to load the blob reference table, dropping it: " << table_file_ << ", err: " << exc.what();
+    app_versions_.clear();
+    ref_counts_.clear();
+    garbage_.clear();
+    sweep_required_ = true;
+    dirty_ = true;
+  }
+}
+
+}  // namespace Docker
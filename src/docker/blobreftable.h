@@ -0,0 +1,67 @@
+#ifndef AKTUALIZR_LITE_DOCKER_BLOB_REF_TABLE_H_
+#define AKTUALIZR_LITE_DOCKER_BLOB_REF_TABLE_H_
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <boost/filesystem.hpp>
+
+namespace Docker {
+
+/**
+ * @brief BlobRefTable, a persistent record of blobs referenced by each fetched App version
+ *
+ * An App version is identified by `<app name>/<app hash>`, its entry lists hashes of all blobs it refers to: the App
+ * manifest and its layers, the App images' manifests, configs and layers. A reference counter is kept per blob, a blob
+ * whose counter drops to zero is moved to the garbage list which is persisted along with the references, so blobs
+ * of removed App versions can be found and swept without re-parsing manifests or listing the whole blob store.
+ * The store may also contain blobs the table knows nothing about, e.g. blobs of an interrupted fetch or blobs fetched
+ * before the table was introduced, in this case the "sweep required" flag is set and a sweep of the whole store
+ * is needed to find them. The table methods can be invoked concurrently.
+ */
+class BlobRefTable {
+ public:
+  static constexpr const char* const Filename{"blob-refs.json"};
+  using Blobs = std::unordered_set<std::string>;
+
+  explicit BlobRefTable(boost::filesystem::path table_file);
+
+  static std::string getAppVersion(const std::string& app, const std::string& hash) { return app + "/" + hash; }
+
+  bool has(const std::string& app_version) const;
+  void set(const std::string& app_version, const Blobs& blobs);
+  // remove all App versions except the ones listed in `app_versions`, their unreferenced blobs become garbage
+  void retain(const std::unordered_set<std::string>& app_versions);
+  // blobs that would become garbage if all App versions except the ones listed in `app_versions` were removed
+  Blobs getUnreferencedBlobs(const std::unordered_set<std::string>& app_versions) const;
+  bool isReferenced(const std::string& hash) const;
+
+  Blobs getGarbage() const;
+  // remove the given blobs from the garbage list once they are removed from the store
+  void removeGarbage(const Blobs& hashes);
+
+  bool isSweepRequired() const;
+  void setSweepRequired(bool required);
+
+  // persist the table if it has been changed since the last flush
+  void flush();
+
+ private:
+  void addRefs(const Blobs& blobs);
+  void removeRefs(const Blobs& blobs);
+  void load();
+
+  const boost::filesystem::path table_file_;
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, Blobs> app_versions_;
+  std::unordered_map<std::string, unsigned int> ref_counts_;
+  Blobs garbage_;
+  bool sweep_required_{false};
+  bool dirty_{false};
+};
+
+}  // namespace Docker
+
+#endif  // AKTUALIZR_LITE_DOCKER_BLOB_REF_TABLE_H_
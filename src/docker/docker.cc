@@ -1,4 +1,5 @@
 #include "docker.h"
+#include <algorithm>
 #include <fstream>
 
 #include <boost/algorithm/hex.hpp>
@@ -10,6 +11,7 @@
 
 #include "crypto/crypto.h"
 #include "http/httpclient.h"
+#include "workerpool.h"
 
 namespace Docker {
 
@@ -190,10 +192,19 @@ RegistryClient::BearerAuth::BearerAuth(const std::string& auth_header_value) {
 }
 
 RegistryClient::RegistryClient(std::shared_ptr<HttpInterface> ota_lite_client, std::string auth_creds_endpoint,
-                               HttpClientFactory http_client_factory)
+                               HttpClientFactory http_client_factory, size_t parallel_download_threshold,
+                               int parallel_download_connections)
     : auth_creds_endpoint_{std::move(auth_creds_endpoint)},
       ota_lite_client_{std::move(ota_lite_client)},
-      http_client_factory_{std::move(http_client_factory)} {}
+      http_client_factory_{std::move(http_client_factory)},
+      parallel_download_threshold_{parallel_download_threshold},
+      parallel_download_connections_{parallel_download_connections} {
+  if (parallel_download_connections_ < 1 || parallel_download_connections_ > MaxParallelDownloadConnections) {
+    throw std::invalid_argument("Unsupported number of parallel blob download connections; should be within [1," +
+                                std::to_string(MaxParallelDownloadConnections) + "] range, got " +
+                                std::to_string(parallel_download_connections_));
+  }
+}
 
 std::string RegistryClient::getAppManifest(const Uri& uri, const std::string& format,
                                            boost::optional<std::int64_t> manifest_size) const {
@@ -201,6 +212,10 @@ std::string RegistryClient::getAppManifest(const Uri& uri, const std::string& fo
   LOG_DEBUG << "Downloading App manifest: " << manifest_url;
 
   std::vector<std::string> registry_repo_request_headers{"accept:" + format};
+  const auto cached_auth_header{getCachedAuthHeader(uri)};
+  if (!cached_auth_header.empty()) {
+    registry_repo_request_headers.push_back(cached_auth_header);
+  }
   const std::set<std::string> header_to_get{BearerAuth::Header};
 
   std::int64_t manifest_max_size{DefManifestMaxSize};
@@ -214,11 +229,12 @@ std::string RegistryClient::getAppManifest(const Uri& uri, const std::string& fo
 
   auto manifest_resp = doGetManifestRequest();
   if (manifest_resp.http_status_code == 401) {
-    if (manifest_resp.headers.empty() || manifest_resp.headers.count(BearerAuth::Header) == 0) {
-      throw std::runtime_error("No `" + BearerAuth::Header + "` header found in the 401 response");
+    if (!cached_auth_header.empty()) {
+      // the cached token has been rejected, e.g. revoked, so get a new one
+      dropCachedAuthHeader(uri);
+      registry_repo_request_headers.pop_back();
     }
-    auto auth_header{getBearerAuthHeader(BearerAuth(manifest_resp.headers[BearerAuth::Header]))};
-    registry_repo_request_headers.push_back(auth_header);
+    registry_repo_request_headers.push_back(getAuthHeader(uri, manifest_resp));
     manifest_resp = doGetManifestRequest();
   }
 
@@ -254,8 +270,13 @@ std::string RegistryClient::getAppManifest(const Uri& uri, const std::string& fo
 }
 
 struct DownloadCtx {
-  DownloadCtx(std::ostream& out_stream_in, MultiPartHasher& hasher_in, std::size_t expected_size_in)
-      : out_stream{out_stream_in}, hasher{hasher_in}, expected_size{expected_size_in} {}
+  DownloadCtx(std::ostream& out_stream_in, MultiPartHasher& hasher_in, std::size_t expected_size_in,
+              std::size_t base_size_in = 0)
+      : out_stream{out_stream_in},
+        hasher{hasher_in},
+        expected_size{expected_size_in},
+        written_size{base_size_in},
+        received_size{base_size_in} {}
 
   std::ostream& out_stream;
   MultiPartHasher& hasher;
@@ -286,12 +307,6 @@ struct DownloadCtx {
     hasher.update(reinterpret_cast<const unsigned char*>(data), size);
     return (end_pos - start_pos);
   }
-  void reset() {
-    out_stream.seekp(std::ios_base::beg);
-    hasher.reset();
-    written_size = 0;
-    received_size = 0;
-  }
 };
 
 static size_t DownloadHandler(char* data, size_t buf_size, size_t buf_numb, void* user_ctx) {
@@ -301,59 +316,214 @@ static size_t DownloadHandler(char* data, size_t buf_size, size_t buf_numb, void
   return download_ctx->write(data, (buf_size * buf_numb));
 }
 
+// Feed the first `size` bytes of the file to the hasher
+static void hashFile(MultiPartHasher& hasher, const boost::filesystem::path& filepath, size_t size) {
+  static const size_t read_chunk_size{64 * 1024};
+  std::ifstream input_file{filepath.string(), std::ios_base::in | std::ios_base::binary};
+  if (!input_file.is_open()) {
+    throw std::runtime_error("Failed to open a file: " + filepath.string());
+  }
+  std::vector<char> buffer(read_chunk_size);
+  while (size > 0) {
+    input_file.read(buffer.data(), static_cast<std::streamsize>(std::min(size, buffer.size())));
+    const auto read_size{input_file.gcount()};
+    if (read_size <= 0) {
+      throw std::runtime_error("Failed to read a file: " + filepath.string());
+    }
+    hasher.update(reinterpret_cast<const unsigned char*>(buffer.data()), static_cast<uint64_t>(read_size));
+    size -= static_cast<size_t>(read_size);
+  }
+}
+
 void RegistryClient::downloadBlob(const Uri& uri, const boost::filesystem::path& filepath, size_t expected_size) const {
   auto compose_app_blob_url{composeBlobUrl(uri)};
+  const boost::filesystem::path partial_file{filepath.string() + PartialFileSuffix};
 
   LOG_DEBUG << "Downloading App blob: " << compose_app_blob_url;
 
-  std::ofstream output_file{filepath.string(), std::ios_base::out | std::ios_base::binary};
-  if (!output_file.is_open()) {
-    throw std::runtime_error("Failed to open a file: " + filepath.string());
+  bool is_downloaded{false};
+  if (parallel_download_threshold_ > 0 && parallel_download_connections_ > 1 &&
+      expected_size >= parallel_download_threshold_ && !boost::filesystem::exists(partial_file)) {
+    is_downloaded = downloadBlobInChunks(uri, partial_file, expected_size);
   }
-  MultiPartSHA256Hasher hasher;
-  DownloadCtx download_ctx{output_file, hasher, expected_size};
+  if (!is_downloaded) {
+    downloadBlobSequentially(uri, partial_file, expected_size);
+  }
+  boost::filesystem::rename(partial_file, filepath);
+}
 
+void RegistryClient::downloadBlobSequentially(const Uri& uri, const boost::filesystem::path& partial_file,
+                                              size_t expected_size) const {
+  const auto blob_url{composeBlobUrl(uri)};
+  const auto& expected_hash{uri.digest.hash()};
+  std::size_t offset{0};
+  if (boost::filesystem::exists(partial_file)) {
+    offset = boost::filesystem::file_size(partial_file);
+    if (offset > expected_size) {
+      LOG_WARNING << "Size of the partially downloaded App blob exceeds the expected one, downloading it again: "
+                  << offset << " > " << expected_size;
+      offset = 0;
+    } else if (offset > 0) {
+      LOG_INFO << "Resuming App blob download from " << offset << " of " << expected_size << " bytes: " << blob_url;
+    }
+  }
+
+  MultiPartSHA256Hasher hasher;
+  std::size_t written_size{offset};
   const std::set<std::string> header_to_get{BearerAuth::Header};
   std::vector<std::string> registry_repo_request_headers;
-  std::function<HttpResponse()> doDownloadBlobRequest = [&]() {
+  const auto cached_auth_header{getCachedAuthHeader(uri)};
+  if (!cached_auth_header.empty()) {
+    registry_repo_request_headers.push_back(cached_auth_header);
+  }
+  std::function<HttpResponse(size_t)> doDownloadBlobRequest = [&](size_t from) {
+    // Drop whatever has been received beyond the offset, e.g. a body of an error response, and re-seed the hasher
+    // with the data downloaded before
+    if (!boost::filesystem::exists(partial_file)) {
+      std::ofstream{partial_file.string(), std::ios_base::out | std::ios_base::binary};
+    }
+    boost::filesystem::resize_file(partial_file, from);
+    hasher.reset();
+    hashFile(hasher, partial_file, from);
+
+    std::fstream output_file{partial_file.string(), std::ios_base::in | std::ios_base::out | std::ios_base::binary};
+    if (!output_file.is_open()) {
+      throw std::runtime_error("Failed to open a file: " + partial_file.string());
+    }
+    output_file.seekp(static_cast<std::streamoff>(from));
+    DownloadCtx download_ctx{output_file, hasher, expected_size, from};
+    if (from == expected_size) {
+      // the whole blob has been downloaded before
+      written_size = from;
+      return HttpResponse("", 200, CURLE_OK, "");
+    }
     auto registry_repo_client{http_client_factory_(&registry_repo_request_headers, &header_to_get)};
-    return registry_repo_client->download(compose_app_blob_url, DownloadHandler, nullptr, &download_ctx, 0);
+    auto resp{registry_repo_client->download(blob_url, DownloadHandler, nullptr, &download_ctx,
+                                             static_cast<curl_off_t>(from))};
+    output_file.close();
+    written_size = download_ctx.written_size;
+    return resp;
   };
 
-  auto get_blob_resp = doDownloadBlobRequest();
+  auto get_blob_resp = doDownloadBlobRequest(offset);
   if (get_blob_resp.http_status_code == 401) {
-    if (get_blob_resp.headers.empty() || get_blob_resp.headers.count(BearerAuth::Header) == 0) {
-      throw std::runtime_error("No `" + BearerAuth::Header + "` header found in the 401 response");
+    if (!cached_auth_header.empty()) {
+      // the cached token has been rejected, e.g. revoked, so get a new one
+      dropCachedAuthHeader(uri);
     }
-    auto auth_header{getBearerAuthHeader(BearerAuth(get_blob_resp.headers[BearerAuth::Header]))};
-    registry_repo_request_headers.push_back(auth_header);
-    download_ctx.reset();
-    get_blob_resp = doDownloadBlobRequest();
+    registry_repo_request_headers = {getAuthHeader(uri, get_blob_resp)};
+    get_blob_resp = doDownloadBlobRequest(offset);
+  }
+  if (!get_blob_resp.isOk() && offset > 0 && written_size == offset) {
+    // Nothing has been received, e.g. a registry doesn't support range requests, so start from the beginning
+    LOG_WARNING << "Failed to resume App blob download, downloading it from the beginning: "
+                << get_blob_resp.getStatusStr();
+    offset = 0;
+    get_blob_resp = doDownloadBlobRequest(offset);
   }
   if (!get_blob_resp.isOk()) {
-    throw std::runtime_error("Failed to download App blob: " + get_blob_resp.getStatusStr());
+    // The partially downloaded blob is kept so the next attempt resumes from it
+    throw std::runtime_error("Failed to download App blob: " + get_blob_resp.getStatusStr() + "; received " +
+                             std::to_string(written_size) + " of " + std::to_string(expected_size) + " bytes");
   }
 
-  output_file.close();
-  std::size_t recv_blob_file_size{download_ctx.written_size};
-
-  if (recv_blob_file_size != expected_size) {
-    std::remove(filepath.c_str());
+  if (written_size != expected_size) {
+    boost::filesystem::remove(partial_file);
     throw std::runtime_error(
         "Size of downloaded App blob does not equal to "
         "the expected one: " +
-        std::to_string(recv_blob_file_size) + " != " + std::to_string(expected_size));
+        std::to_string(written_size) + " != " + std::to_string(expected_size));
   }
 
   auto recv_blob_hash{boost::algorithm::to_lower_copy(hasher.getHexDigest())};
 
-  if (recv_blob_hash != uri.digest.hash()) {
-    std::remove(filepath.c_str());
+  if (recv_blob_hash != expected_hash) {
+    boost::filesystem::remove(partial_file);
+    throw std::runtime_error(
+        "Hash of downloaded App blob does not equal to "
+        "the expected one: " +
+        recv_blob_hash + " != " + expected_hash);
+  }
+}
+
+bool RegistryClient::downloadBlobInChunks(const Uri& uri, const boost::filesystem::path& partial_file,
+                                          size_t expected_size) const {
+  const auto blob_url{composeBlobUrl(uri)};
+  const auto& expected_hash{uri.digest.hash()};
+  const auto connections{static_cast<size_t>(parallel_download_connections_)};
+  const size_t chunk_size{(expected_size + connections - 1) / connections};
+  const size_t chunk_numb{(expected_size + chunk_size - 1) / chunk_size};
+  LOG_DEBUG << "Downloading App blob in " << chunk_numb << " chunks: " << blob_url;
+
+  const std::set<std::string> header_to_get{BearerAuth::Header};
+  std::vector<std::string> auth_headers;
+  const auto cached_auth_header{getCachedAuthHeader(uri)};
+  if (!cached_auth_header.empty()) {
+    auth_headers.push_back(cached_auth_header);
+  }
+  const auto downloadChunk = [&](size_t chunk_indx) {
+    const size_t from{chunk_indx * chunk_size};
+    const size_t size{std::min(chunk_size, expected_size - from)};
+    std::vector<std::string> registry_repo_request_headers{auth_headers};
+    registry_repo_request_headers.emplace_back("Range: bytes=" + std::to_string(from) + "-" +
+                                               std::to_string(from + size - 1));
+
+    std::fstream output_file{partial_file.string(), std::ios_base::in | std::ios_base::out | std::ios_base::binary};
+    if (!output_file.is_open()) {
+      throw std::runtime_error("Failed to open a file: " + partial_file.string());
+    }
+    output_file.seekp(static_cast<std::streamoff>(from));
+    // the whole blob is hashed once all its chunks are in place
+    MultiPartSHA256Hasher chunk_hasher;
+    DownloadCtx download_ctx{output_file, chunk_hasher, size};
+    auto registry_repo_client{http_client_factory_(&registry_repo_request_headers, &header_to_get)};
+    auto resp{registry_repo_client->download(blob_url, DownloadHandler, nullptr, &download_ctx, 0)};
+    if (resp.isOk() && (resp.http_status_code != 206 || download_ctx.written_size != size)) {
+      throw std::runtime_error("Registry doesn't support range requests, status: " + resp.getStatusStr());
+    }
+    return resp;
+  };
+
+  try {
+    std::ofstream{partial_file.string(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc};
+    boost::filesystem::resize_file(partial_file, expected_size);
+
+    // Download the first chunk alone to get authorized
+    auto get_chunk_resp{downloadChunk(0)};
+    if (get_chunk_resp.http_status_code == 401) {
+      if (!cached_auth_header.empty()) {
+        dropCachedAuthHeader(uri);
+      }
+      auth_headers = {getAuthHeader(uri, get_chunk_resp)};
+      get_chunk_resp = downloadChunk(0);
+    }
+    if (!get_chunk_resp.isOk()) {
+      throw std::runtime_error("Failed to download App blob chunk: " + get_chunk_resp.getStatusStr());
+    }
+    forEachConcurrently(chunk_numb - 1, parallel_download_connections_, [&](std::size_t ii) {
+      const auto resp{downloadChunk(ii + 1)};
+      if (!resp.isOk()) {
+        throw std::runtime_error("Failed to download App blob chunk: " + resp.getStatusStr());
+      }
+    });
+  } catch (const std::exception& exc) {
+    // The chunks downloaded so far cannot be resumed since there may be gaps between them, so start over
+    LOG_WARNING << "Failed to download App blob in chunks, downloading it sequentially: " << exc.what();
+    boost::filesystem::remove(partial_file);
+    return false;
+  }
+
+  MultiPartSHA256Hasher hasher;
+  hashFile(hasher, partial_file, expected_size);
+  auto recv_blob_hash{boost::algorithm::to_lower_copy(hasher.getHexDigest())};
+  if (recv_blob_hash != expected_hash) {
+    boost::filesystem::remove(partial_file);
     throw std::runtime_error(
         "Hash of downloaded App blob does not equal to "
         "the expected one: " +
-        recv_blob_hash + " != " + uri.digest.hash());
+        recv_blob_hash + " != " + expected_hash);
   }
+  return true;
 }
 
 std::string RegistryClient::getBasicAuthHeader() const {
@@ -387,24 +557,101 @@ std::string RegistryClient::getBasicAuthHeader() const {
 }
 
 std::string RegistryClient::getBearerAuthHeader(const BearerAuth& bearer) const {
+  const auto token_request_uri{bearer.uri()};
+  std::string basic_auth_header;
+  {
+    std::lock_guard<std::mutex> lock{auth_cache_mutex_};
+    const auto found_it{token_cache_.find(token_request_uri)};
+    if (found_it != token_cache_.end() && std::chrono::steady_clock::now() < found_it->second.expires_at) {
+      LOG_DEBUG << "Using cached Docker Registry token for " << bearer.Scope;
+      return found_it->second.auth_header;
+    }
+    basic_auth_header = basic_auth_header_;
+  }
+
   LOG_DEBUG << "Getting Docker Registry token from " << bearer.Realm;
+  const bool are_creds_cached{!basic_auth_header.empty()};
+  if (!are_creds_cached) {
+    basic_auth_header = getBasicAuthHeader();
+  }
+  const auto doGetTokenRequest = [&]() {
+    std::vector<std::string> auth_header = {basic_auth_header};
+    auto registry_client{http_client_factory_(&auth_header, nullptr)};
+    return registry_client->get(token_request_uri, AuthMaterialMaxSize);
+  };
 
-  std::vector<std::string> auth_header = {getBasicAuthHeader()};
-  auto registry_client{http_client_factory_(&auth_header, nullptr)};
-  auto token_resp = registry_client->get(bearer.uri(), AuthMaterialMaxSize);
+  auto token_resp = doGetTokenRequest();
+  if (token_resp.http_status_code == 401 && are_creds_cached) {
+    // the cached credentials have been rotated, get the new ones
+    basic_auth_header = getBasicAuthHeader();
+    token_resp = doGetTokenRequest();
+  }
 
   if (!token_resp.isOk()) {
     throw std::runtime_error("Failed to get Auth Token at Docker Registry " + bearer.Realm +
                              "; error: " + token_resp.getStatusStr());
   }
 
-  auto token = token_resp.getJson()["token"].asString();
+  const auto token_json{token_resp.getJson()};
+  auto token = token_json["token"].asString();
   if (token.empty()) {
     throw std::runtime_error("Got invalid token from Docker Registry: " + token_resp.body);
   }
 
   LOG_DEBUG << "Got Docker Registry token: " << token;
-  return "authorization: bearer " + token;
+  const std::string auth_header{"authorization: bearer " + token};
+  const auto ttl{getTokenTtl(token_json["expires_in"])};
+  {
+    std::lock_guard<std::mutex> lock{auth_cache_mutex_};
+    basic_auth_header_ = basic_auth_header;
+    token_cache_[token_request_uri] = {auth_header, std::chrono::steady_clock::now() + std::chrono::seconds(ttl)};
+  }
+  return auth_header;
+}
+
+int RegistryClient::getTokenTtl(const Json::Value& expires_in_json) {
+  int expires_in{DefTokenExpiresIn};
+  if (expires_in_json.isNumeric() && expires_in_json.asDouble() >= 1) {
+    expires_in = static_cast<int>(std::min(expires_in_json.asDouble(), static_cast<double>(MaxTokenExpiresIn)));
+  } else if (!expires_in_json.isNull()) {
+    LOG_DEBUG << "Invalid Docker Registry token lifetime: " << expires_in_json << ", using the default one";
+  }
+  // a short-lived token is cached for at least a part of its lifetime
+  return std::max({expires_in - TokenExpiryMargin, expires_in / 2, MinTokenTtl});
+}
+
+std::string RegistryClient::getAuthHeader(const Uri& uri, const HttpResponse& unauthorized_resp) const {
+  const auto found_it{unauthorized_resp.headers.find(BearerAuth::Header)};
+  if (found_it == unauthorized_resp.headers.end()) {
+    throw std::runtime_error("No `" + BearerAuth::Header + "` header found in the 401 response");
+  }
+  const BearerAuth bearer{found_it->second};
+  auto auth_header{getBearerAuthHeader(bearer)};
+  std::lock_guard<std::mutex> lock{auth_cache_mutex_};
+  repo_token_scopes_[getRepoKey(uri)] = bearer.uri();
+  return auth_header;
+}
+
+std::string RegistryClient::getCachedAuthHeader(const Uri& uri) const {
+  std::lock_guard<std::mutex> lock{auth_cache_mutex_};
+  const auto scope_it{repo_token_scopes_.find(getRepoKey(uri))};
+  if (scope_it == repo_token_scopes_.end()) {
+    return "";
+  }
+  const auto token_it{token_cache_.find(scope_it->second)};
+  if (token_it == token_cache_.end() || std::chrono::steady_clock::now() >= token_it->second.expires_at) {
+    return "";
+  }
+  return token_it->second.auth_header;
+}
+
+void RegistryClient::dropCachedAuthHeader(const Uri& uri) const {
+  std::lock_guard<std::mutex> lock{auth_cache_mutex_};
+  const auto scope_it{repo_token_scopes_.find(getRepoKey(uri))};
+  if (scope_it != repo_token_scopes_.end()) {
+    token_cache_.erase(scope_it->second);
+    repo_token_scopes_.erase(scope_it);
+  }
 }
 
 }  // namespace Docker
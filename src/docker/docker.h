@@ -1,9 +1,12 @@
 #ifndef AKTUALIZR_LITE_DOCKER_H_
 #define AKTUALIZR_LITE_DOCKER_H_
 
+#include <chrono>
 #include <limits>
+#include <mutex>
 #include <set>
 #include <string>
+#include <unordered_map>
 
 #include <boost/optional.hpp>
 
@@ -177,17 +180,49 @@ class RegistryClient {
   static const HttpClientFactory DefaultHttpClientFactory;
   using Ptr = std::shared_ptr<RegistryClient>;
 
+  // The suffix of a file a blob is being downloaded to, the download is resumed from it if interrupted
+  static constexpr const char* const PartialFileSuffix{".partial"};
+  static const int MaxParallelDownloadConnections{8};
+
+  // `parallel_download_threshold` - blobs of this size or bigger are downloaded in chunks over
+  // `parallel_download_connections` concurrent connections, 0 disables parallel downloading
   explicit RegistryClient(std::shared_ptr<HttpInterface> ota_lite_client,
                           std::string auth_creds_endpoint = DefAuthCredsEndpoint,
-                          HttpClientFactory http_client_factory = RegistryClient::DefaultHttpClientFactory);
+                          HttpClientFactory http_client_factory = RegistryClient::DefaultHttpClientFactory,
+                          size_t parallel_download_threshold = 0, int parallel_download_connections = 1);
 
   std::string getAppManifest(const Uri& uri, const std::string& format,
                              boost::optional<std::int64_t> manifest_size = boost::none) const;
+  // Returns for how many seconds a token can be cached given its lifetime specified by a token server
+  static int getTokenTtl(const Json::Value& expires_in_json);
+  // Downloads the App blobs fetched by aktualizr-lite itself, i.e. App manifests and archives, the image layers are
+  // pulled by an external utility
   void downloadBlob(const Uri& uri, const boost::filesystem::path& filepath, size_t expected_size) const;
 
  private:
+  struct CachedToken {
+    std::string auth_header;
+    std::chrono::steady_clock::time_point expires_at;
+  };
+  // A token lifetime if a token server doesn't specify it, as defined in the Docker Registry token auth spec
+  static const int DefTokenExpiresIn{60};
+  // A cached token is considered expired a bit earlier so it doesn't expire in the middle of a request
+  static const int TokenExpiryMargin{10};
+  static const int MinTokenTtl{1};
+  static const int MaxTokenExpiresIn{24 * 60 * 60};
+
   std::string getBasicAuthHeader() const;
   std::string getBearerAuthHeader(const BearerAuth& bearer) const;
+  // Returns an auth header for the given repository by requesting a token for the scope specified in the 401 response
+  std::string getAuthHeader(const Uri& uri, const HttpResponse& unauthorized_resp) const;
+  // Returns a cached auth header for the given repository if there is a valid one, an empty string otherwise
+  std::string getCachedAuthHeader(const Uri& uri) const;
+  void dropCachedAuthHeader(const Uri& uri) const;
+  static std::string getRepoKey(const Uri& uri) { return uri.registryHostname + '/' + uri.repo; }
+
+  void downloadBlobSequentially(const Uri& uri, const boost::filesystem::path& partial_file,
+                                size_t expected_size) const;
+  bool downloadBlobInChunks(const Uri& uri, const boost::filesystem::path& partial_file, size_t expected_size) const;
 
   static std::string composeManifestUrl(const Uri& uri) {
     return "https://" + uri.registryHostname + SupportedRegistryVersion + uri.repo + ManifestEndpoint + uri.digest();
@@ -200,6 +235,17 @@ class RegistryClient {
   const std::string auth_creds_endpoint_;
   std::shared_ptr<HttpInterface> ota_lite_client_;
   HttpClientFactory http_client_factory_;
+  const size_t parallel_download_threshold_;
+  const int parallel_download_connections_;
+
+  // Registry auth material is cached, so it is obtained once per repository scope rather than once per request
+  mutable std::mutex auth_cache_mutex_;
+  // Basic auth header made of the credentials obtained from the `hub-creds` endpoint
+  mutable std::string basic_auth_header_;
+  // token request URI (realm, service and scope) -> token
+  mutable std::unordered_map<std::string, CachedToken> token_cache_;
+  // repository -> token request URI
+  mutable std::unordered_map<std::string, std::string> repo_token_scopes_;
 };
 
 }  // namespace Docker
@@ -4,14 +4,19 @@
 #include <archive_entry.h>
 #include <boost/format.hpp>
 #include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
 
-#include "http/httpclient.h"
+#include "dockerdhttpclient.h"
 #include "logging/logging.h"
 #include "utilities/utils.h"
 
 namespace Docker {
 
-const DockerClient::HttpClientFactory DockerClient::DefaultHttpClientFactory = [](const std::string& docker_host_in) {
+namespace {
+
+std::string getDockerSocket(const std::string& docker_host_in) {
   std::string docker_host{docker_host_in};
   if (std::getenv("DOCKER_HOST") != nullptr) {
     docker_host = std::getenv("DOCKER_HOST");
@@ -21,9 +26,55 @@ const DockerClient::HttpClientFactory DockerClient::DefaultHttpClientFactory = [
   if (find_res != 0) {
     throw std::invalid_argument("Invalid docker host value, must start with unix:// : " + docker_host);
   }
+  return docker_host.substr(docker_host_prefix.size());
+}
+
+// filters={"type":["container"]}
+const std::string ContainerEventsFilter{"%7B%22type%22%3A%5B%22container%22%5D%7D"};
+// container events that don't change a container state listed by `/containers/json`, `exec_*` events are ignored too
+const std::unordered_set<std::string> IgnoredContainerEvents{
+    "attach", "detach", "resize", "top", "archive-path", "extract-to-dir", "export", "copy", "commit", "checkpoint"};
+// filters={"label":["com.docker.compose.project"]}
+const std::string ComposeProjectFilter{"%7B%22label%22%3A%5B%22com.docker.compose.project%22%5D%7D"};
+// re-list all containers instead of listing the changed ones if too many of them have changed
+const size_t MaxChangedContainersToList{32};
+const size_t MaxEventSize{1024 * 1024};
+const size_t MaxLoadMessageSize{1024 * 1024};
+
+// Logs the progress of image layers being loaded, dockerd reports it by the messages like
+// {"status":"Loading layer","id":"<short layer ID>","progressDetail":{"current":<bytes>,"total":<bytes>}}
+class LayerLoadProgress {
+ public:
+  static const int ReportStepPercent{25};
+
+  void update(const Json::Value& msg) {
+    const auto id{msg.get("id", "").asString()};
+    const auto& detail{msg["progressDetail"]};
+    if (id.empty() || !detail.isMember("total")) {
+      LOG_DEBUG << msg["status"].asString() << " " << id;
+      return;
+    }
+    const auto current{detail["current"].asUInt64()};
+    const auto total{detail["total"].asUInt64()};
+    const int percent{total > 0 ? static_cast<int>(std::min(current, total) * 100 / total) : 100};
+    auto found_it{reported_percents_.find(id)};
+    if (found_it == reported_percents_.end()) {
+      found_it = reported_percents_.emplace(id, -ReportStepPercent).first;
+    }
+    if (percent - found_it->second >= ReportStepPercent || (percent == 100 && found_it->second < 100)) {
+      LOG_INFO << msg["status"].asString() << " " << id << ": " << percent << "% (" << current << "/" << total
+               << " bytes)";
+      found_it->second = percent;
+    }
+  }
+
+ private:
+  std::unordered_map<std::string, int> reported_percents_;
+};
+
+}  // namespace
 
-  const auto socket{docker_host.substr(docker_host_prefix.size())};
-  auto c{std::make_shared<HttpClient>(socket)};
+const DockerClient::HttpClientFactory DockerClient::DefaultHttpClientFactory = [](const std::string& docker_host) {
   // Set a timeout for the overall request processing:
   // "the maximum time in milliseconds that you allow the entire transfer operation to take".
   int64_t timeout_ms{1000 * 60}; /* by default 1m timeout */
@@ -39,18 +90,117 @@ const DockerClient::HttpClientFactory DockerClient::DefaultHttpClientFactory = [
                 << ", err: " << exc.what() << "; applying the default value: 60s";
     }
   }
-  c->timeout(timeout_ms);
-  return c;
+  return std::make_shared<DockerdHttpClient>(getDockerSocket(docker_host), timeout_ms);
 };
 
-DockerClient::DockerClient(std::shared_ptr<HttpInterface> http_client)
+const DockerClient::HttpClientFactory DockerClient::DefaultEventsHttpClientFactory =
+    [](const std::string& docker_host) { return std::make_shared<DockerdHttpClient>(getDockerSocket(docker_host)); };
+
+struct DockerClient::EventStream {
+  explicit EventStream(DockerClient& client_in) : client{client_in} {}
+
+  static size_t onData(char* data, size_t buf_size, size_t buf_numb, void* user_ctx) {
+    auto* stream = reinterpret_cast<EventStream*>(user_ctx);
+    if (stream->client.stop_events_) {
+      return 0;
+    }
+    stream->setConnected();
+    // each event is a json object followed by a new line
+    stream->buffer.append(data, buf_size * buf_numb);
+    size_t line_start{0};
+    for (auto line_end = stream->buffer.find('\n'); line_end != std::string::npos;
+         line_end = stream->buffer.find('\n', line_start)) {
+      const auto line{stream->buffer.substr(line_start, line_end - line_start)};
+      line_start = line_end + 1;
+      if (line.empty()) {
+        continue;
+      }
+      const auto event{Utils::parseJSON(line)};
+      if (event.isNull()) {
+        LOG_WARNING << "Received invalid docker event: " << line;
+        continue;
+      }
+      stream->client.onEvent(event);
+    }
+    stream->buffer.erase(0, line_start);
+    if (stream->buffer.size() > MaxEventSize) {
+      LOG_WARNING << "Docker event exceeds the maximum size: " << MaxEventSize << ", closing the event stream";
+      return 0;
+    }
+    return buf_size * buf_numb;
+  }
+
+  static int onProgress(void* user_ctx, curl_off_t /* dltotal */, curl_off_t /* dlnow */, curl_off_t /* ultotal */,
+                        curl_off_t /* ulnow */) {
+    auto* stream = reinterpret_cast<EventStream*>(user_ctx);
+    if (stream->client.stop_events_) {
+      return 1;
+    }
+    // dockerd doesn't send anything until an event occurs, so the stream is considered connected if the request
+    // hasn't been rejected for a while
+    if (std::chrono::steady_clock::now() - stream->started_at >= std::chrono::seconds(1)) {
+      stream->setConnected();
+    }
+    return 0;
+  }
+
+  void setConnected() {
+    if (!connected) {
+      std::lock_guard<std::mutex> lock{client.cache_mutex_};
+      client.events_connected_ = true;
+      connected = true;
+    }
+  }
+
+  DockerClient& client;
+  const std::chrono::steady_clock::time_point started_at{std::chrono::steady_clock::now()};
+  bool connected{false};
+  std::string buffer;
+};
+
+DockerClient::DockerClient(std::shared_ptr<HttpInterface> http_client,
+                           std::shared_ptr<HttpInterface> events_http_client)
     : http_client_{std::move(http_client)},
+      is_http_client_thread_safe_{std::dynamic_pointer_cast<DockerdHttpClient>(http_client_) != nullptr},
       engine_info_{getEngineInfo()},
-      arch_{engine_info_.get("Arch", Json::Value()).asString()} {}
+      arch_{engine_info_.get("Arch", Json::Value()).asString()},
+      events_http_client_{std::move(events_http_client)} {
+  if (events_http_client_) {
+    events_thread_ = std::thread(&DockerClient::watchEvents, this);
+  }
+}
+
+DockerClient::~DockerClient() {
+  if (events_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock{cache_mutex_};
+      stop_events_ = true;
+    }
+    stop_events_cv_.notify_all();
+    events_thread_.join();
+  }
+}
+
+std::unique_lock<std::mutex> DockerClient::lockHttpClient() {
+  if (is_http_client_thread_safe_) {
+    return {};
+  }
+  return std::unique_lock<std::mutex>{http_client_mutex_};
+}
 
 void DockerClient::getContainers(Json::Value& root) {
+  if (events_http_client_) {
+    root = getCachedContainers();
+  } else {
+    root = listContainers();
+  }
+}
+
+Json::Value DockerClient::listContainers(const std::string& filters) {
   // curl --unix-socket /var/run/docker.sock http://localhost/containers/json?all=1
-  const std::string cmd{"http://localhost/containers/json?all=1"};
+  const std::string cmd{"http://localhost/containers/json?all=1" + (filters.empty() ? "" : "&filters=" + filters)};
+  Json::Value root;
+  const auto lock{lockHttpClient()};
   auto resp = http_client_->get(cmd, HttpInterface::kNoLimit);
   if (resp.isOk()) {
     root = resp.getJson();
@@ -60,13 +210,14 @@ void DockerClient::getContainers(Json::Value& root) {
     // empty json `[]`, which is not exceptional situation and means zero containers are running
     throw std::runtime_error("Request to dockerd has failed: " + cmd);
   }
+  return root;
 }
 
 std::tuple<bool, std::string> DockerClient::getContainerState(const Json::Value& root, const std::string& app,
                                                               const std::string& service,
                                                               const std::string& hash) const {
   for (Json::ValueConstIterator ii = root.begin(); ii != root.end(); ++ii) {
-    Json::Value val = *ii;
+    const Json::Value& val = *ii;
     if (val["Labels"]["com.docker.compose.project"].asString() == app) {
       if (val["Labels"]["com.docker.compose.service"].asString() == service) {
         if (val["Labels"]["io.compose-spec.config-hash"].asString() == hash) {
@@ -80,6 +231,7 @@ std::tuple<bool, std::string> DockerClient::getContainerState(const Json::Value&
 
 Json::Value DockerClient::getContainerInfo(const std::string& id) {
   const std::string cmd{"http://localhost/containers/" + id + "/json"};
+  const auto lock{lockHttpClient()};
   auto resp = http_client_->get(cmd, HttpInterface::kNoLimit);
   if (!resp.isOk()) {
     throw std::runtime_error("Request to dockerd has failed: " + cmd);
@@ -89,6 +241,7 @@ Json::Value DockerClient::getContainerInfo(const std::string& id) {
 
 std::string DockerClient::getContainerLogs(const std::string& id, int tail) {
   const std::string cmd{"http://localhost/containers/" + id + "/logs?stderr=1&tail=" + std::to_string(tail)};
+  const auto lock{lockHttpClient()};
   auto resp = http_client_->get(cmd, HttpInterface::kNoLimit);
   if (!resp.isOk()) {
     throw std::runtime_error("Request to dockerd has failed: " + cmd);
@@ -96,53 +249,177 @@ std::string DockerClient::getContainerLogs(const std::string& id, int tail) {
   return resp.body;
 }
 
+DockerClient::Container::Container(const Json::Value& container)
+    : id{container["Id"].asString()},
+      app{container["Labels"]["com.docker.compose.project"].asString()},
+      service{container["Labels"]["com.docker.compose.service"].asString()},
+      hash{container["Labels"]["io.compose-spec.config-hash"].asString()},
+      image{container["Image"].asString()},
+      state{container["State"].asString()},
+      status{container["Status"].asString()} {}
+
 Json::Value DockerClient::getRunningApps(const std::function<void(const std::string&, Json::Value&)>& ext_func) {
   Json::Value apps;
-  Json::Value containers;
-  getContainers(containers);
-
-  for (Json::ValueIterator ii = containers.begin(); ii != containers.end(); ++ii) {
-    Json::Value val = *ii;
+  // the cache holds all containers, otherwise only App containers are listed, non-App containers are skipped anyway
+  const auto containers{events_http_client_ ? getCachedContainers() : listContainers(ComposeProjectFilter)};
 
-    std::string app_name = val["Labels"]["com.docker.compose.project"].asString();
-    if (app_name.empty()) {
+  for (const auto& container_json : containers) {
+    const Container container{container_json};
+    if (container.app.empty()) {
       continue;
     }
 
-    std::string state = val["State"].asString();
-    std::string status = val["Status"].asString();
-
     Json::Value service_attributes;
-    service_attributes["name"] = val["Labels"]["com.docker.compose.service"].asString();
-    service_attributes["hash"] = val["Labels"]["io.compose-spec.config-hash"].asString();
-    service_attributes["image"] = val["Image"].asString();
-    service_attributes["state"] = state;
-    service_attributes["status"] = status;
-
-    // (created|restarting|running|removing|paused|exited|dead)
-    service_attributes["health"] = "healthy";
-    if (status.find("health") != std::string::npos) {
-      service_attributes["health"] = getContainerInfo(val["Id"].asString())["State"]["Health"]["Status"].asString();
-    } else {
-      if (state == "dead" ||
-          (state == "exited" && getContainerInfo(val["Id"].asString())["State"]["ExitCode"].asInt() != 0)) {
-        service_attributes["health"] = "unhealthy";
-      }
-    }
-
+    service_attributes["name"] = container.service;
+    service_attributes["hash"] = container.hash;
+    service_attributes["image"] = container.image;
+    service_attributes["state"] = container.state;
+    service_attributes["status"] = container.status;
+    service_attributes["health"] = getContainerHealth(container);
     if (service_attributes["health"] != "healthy") {
-      service_attributes["logs"] = getContainerLogs(val["Id"].asString(), 5);
+      service_attributes["logs"] = getContainerLogs(container.id, 5);
     }
 
-    apps[app_name]["services"].append(service_attributes);
+    auto& app{apps[container.app]};
+    app["services"].append(service_attributes);
 
     if (ext_func) {
-      ext_func(app_name, apps[app_name]);
+      ext_func(container.app, app);
     }
   }
   return apps;
 }
 
+std::string DockerClient::getContainerHealth(const Container& container) {
+  // The container status listed by dockerd contains the health check result, e.g. "Up 5 minutes (healthy)" or
+  // "Up 5 seconds (health: starting)", and the exit code of an exited container, e.g. "Exited (1) 2 minutes ago",
+  // so the container is inspected only if its status doesn't match the expected format.
+  // (created|restarting|running|removing|paused|exited|dead)
+  if (container.state == "dead") {
+    return "unhealthy";
+  }
+  if (container.status.find("health") != std::string::npos) {
+    static const std::vector<std::pair<std::string, std::string>> health_statuses{
+        {"(healthy)", "healthy"}, {"(unhealthy)", "unhealthy"}, {"(health: starting)", "starting"}};
+    for (const auto& health : health_statuses) {
+      if (container.status.find(health.first) != std::string::npos) {
+        return health.second;
+      }
+    }
+    return getContainerInfo(container.id)["State"]["Health"]["Status"].asString();
+  }
+  if (container.state == "exited") {
+    static const std::string exited_prefix{"Exited ("};
+    int exit_code{-1};
+    if (container.status.rfind(exited_prefix, 0) == 0) {
+      try {
+        const auto code_end{container.status.find(')', exited_prefix.size())};
+        exit_code =
+            boost::lexical_cast<int>(container.status.substr(exited_prefix.size(), code_end - exited_prefix.size()));
+      } catch (const boost::bad_lexical_cast&) {
+        exit_code = -1;
+      }
+    }
+    if (exit_code == -1) {
+      exit_code = getContainerInfo(container.id)["State"]["ExitCode"].asInt();
+    }
+    return exit_code != 0 ? "unhealthy" : "healthy";
+  }
+  return "healthy";
+}
+
+Json::Value DockerClient::getCachedContainers() {
+  // the lock is held while listing containers, so an event received meanwhile is applied after the listing
+  std::lock_guard<std::mutex> lock{cache_mutex_};
+  if (!events_connected_ || !cache_valid_ || changed_containers_.size() > MaxChangedContainersToList) {
+    // The cache is primed even if the event stream is not connected yet since the stream is (re-)opened with
+    // the `since` param set to a time preceding the cache invalidation, so no change made after it is missed.
+    // But the cached state is not trusted until the stream is connected, so containers are listed each time.
+    const auto containers{listContainers()};
+    containers_.clear();
+    changed_containers_.clear();
+    for (const auto& container : containers) {
+      containers_.emplace(container["Id"].asString(), container);
+    }
+    cache_valid_ = true;
+    return containers;
+  }
+
+  if (!changed_containers_.empty()) {
+    // filters={"id":["<id>",...]}
+    std::string filters;
+    for (const auto& id : changed_containers_) {
+      filters += (filters.empty() ? "%7B%22id%22%3A%5B%22" : "%22%2C%22") + id;
+    }
+    filters += "%22%5D%7D";
+    const auto containers{listContainers(filters)};
+    for (const auto& id : changed_containers_) {
+      containers_.erase(id);
+    }
+    for (const auto& container : containers) {
+      containers_[container["Id"].asString()] = container;
+    }
+    changed_containers_.clear();
+  }
+
+  Json::Value root{Json::arrayValue};
+  for (const auto& container : containers_) {
+    root.append(container.second);
+  }
+  return root;
+}
+
+void DockerClient::watchEvents() {
+  // the margin covers the second granularity of the `since` param
+  auto since{std::time(nullptr) - 1};
+  while (!stop_events_) {
+    EventStream stream{*this};
+    const std::string url{"http://localhost/events?since=" + std::to_string(since) +
+                          "&filters=" + ContainerEventsFilter};
+    const auto resp{events_http_client_->download(url, EventStream::onData, EventStream::onProgress, &stream, 0)};
+    const auto stream_closed_at{std::time(nullptr)};
+
+    std::unique_lock<std::mutex> lock{cache_mutex_};
+    events_connected_ = false;
+    if (stop_events_) {
+      break;
+    }
+    // An idle stream can be closed by a transfer timeout, in this case the next stream replays the events emitted
+    // since then. Otherwise, dockerd may have been restarted and its events missed, so the cache is invalidated.
+    if (resp.curl_code != CURLE_OPERATION_TIMEDOUT) {
+      LOG_DEBUG << "Docker event stream has been closed, dropping the container state cache: "
+                << resp.getStatusStr();
+      cache_valid_ = false;
+      containers_.clear();
+      changed_containers_.clear();
+      stop_events_cv_.wait_for(lock, std::chrono::seconds(EventsReconnectIntervalS),
+                               [this]() { return stop_events_.load(); });
+    }
+    since = stream_closed_at - 1;
+  }
+}
+
+void DockerClient::onEvent(const Json::Value& event) {
+  if (event["Type"].asString() != "container") {
+    return;
+  }
+  const auto action{event["Action"].asString()};
+  const auto id{event["Actor"]["ID"].asString()};
+  if (id.empty() || action.rfind("exec_", 0) == 0 || IgnoredContainerEvents.count(action) > 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock{cache_mutex_};
+  if (!cache_valid_) {
+    return;
+  }
+  if (action == "destroy") {
+    containers_.erase(id);
+    changed_containers_.erase(id);
+  } else {
+    changed_containers_.emplace(id);
+  }
+}
+
 void DockerClient::pruneImages() {
   // curl -G -X POST --unix-socket <sock> "http://localhost/images/prune" --data-urlencode
   // 'filters={"dangling":{"false":true},"label!":{"aktualizr-no-prune":true}}'
@@ -151,6 +428,7 @@ void DockerClient::pruneImages() {
       "http://localhost/images/"
       "prune?filters=%7B%22dangling%22%3A%7B%22false%22%3Atrue%7D%2C%22label%21%22%3A%7B%22aktualizr-no-prune%22%"
       "3Atrue%7D%7D"};
+  const auto lock{lockHttpClient()};
   auto resp = http_client_->post(cmd, Json::nullValue);
   if (!resp.isOk()) {
     throw std::runtime_error("Failed to prune unused images: " + resp.getStatusStr());
@@ -162,6 +440,7 @@ void DockerClient::pruneContainers() {
   // filters=%7B%22label%21%22%3A%7B%22aktualizr-no-prune%22%3Atrue%7D%7D
   const std::string cmd{
       "http://localhost/containers/prune?filters=%7B%22label%21%22%3A%7B%22aktualizr-no-prune%22%3Atrue%7D%7D"};
+  const auto lock{lockHttpClient()};
   auto resp = http_client_->post(cmd, Json::nullValue);
   if (!resp.isOk()) {
     throw std::runtime_error("Failed to prune unused containers: " + resp.getStatusStr());
@@ -177,11 +456,60 @@ void DockerClient::loadImage(const std::string& image_uri, const Json::Value& lo
   // curl --unix-socket <sock>  "http://localhost/images/load?quiet=0" --data-binary @tarred_load_manifest -H
   // "Content-Type: application/x-tar"
   LOG_INFO << "Loading image into docker store " << image_uri;
-  // TODO: implement support of the "not quiet" request. In this case, the response is streamed as a "chunked" stream,
-  // each "chunk" containing image load progress, so the code can output the progress to the logs.
-  // The httpclient doesn't support a HTTP response streaming and it will require some effort to implement it.
   // The code that handle the request is located in https://github.com/moby/moby/blob/master/image/tarexport/load.go.
+  if (auto dockerd_client = std::dynamic_pointer_cast<DockerdHttpClient>(http_client_)) {
+    // In the "not quiet" mode, the response is streamed as a sequence of json messages, each containing the image load
+    // progress, so the per-layer progress is logged as it's received. The tarred manifest is the only data sent,
+    // dockerd reads layers straight from the blob store pointed by the manifest's `LayersRoot`.
+    std::string buffer;
+    std::string load_result;
+    std::string load_err;
+    LayerLoadProgress layer_progress;
+    const auto on_msg{[&load_result, &load_err, &layer_progress](const std::string& msg_str) {
+      if (msg_str.empty()) {
+        return;
+      }
+      const auto msg{Utils::parseJSON(msg_str)};
+      if (msg.isMember("error")) {
+        load_err = msg["error"].asString();
+      } else if (msg.isMember("stream")) {
+        // It prints "Image loaded; refs: <ref1>, <ref2>, ... <refN>"
+        load_result = msg["stream"].asString();
+        LOG_INFO << load_result;
+      } else if (msg.isMember("status")) {
+        layer_progress.update(msg);
+      } else {
+        load_err = msg_str;
+      }
+    }};
+    const auto resp{dockerd_client->postStreaming(
+        "http://localhost/images/load?quiet=0", "application/x-tar", tarred_manifest,
+        [&buffer, &on_msg](const char* data, size_t size) {
+          // each message is a json object followed by a new line
+          buffer.append(data, size);
+          size_t msg_start{0};
+          for (auto msg_end = buffer.find('\n'); msg_end != std::string::npos;
+               msg_end = buffer.find('\n', msg_start)) {
+            on_msg(buffer.substr(msg_start, msg_end - msg_start));
+            msg_start = msg_end + 1;
+          }
+          buffer.erase(0, msg_start);
+          return buffer.size() <= MaxLoadMessageSize;
+        })};
+    if (!resp.isOk()) {
+      throw std::runtime_error("Failed to load image: " + resp.getStatusStr() + " " + buffer);
+    }
+    on_msg(buffer);
+    // The load handler sends 200 to a caller before all layers are loaded and image refs are set, so the load is
+    // successful only if the `stream` message is received and no error is reported.
+    if (!load_err.empty() || load_result.empty()) {
+      throw std::runtime_error("Failed to load image: " + (load_err.empty() ? "no load result received" : load_err));
+    }
+    return;
+  }
+
   const std::string cmd{"http://localhost/images/load?quiet=1"};
+  const auto lock{lockHttpClient()};
   auto resp = http_client_->post(cmd, "application/x-tar", tarred_manifest);
   if (!resp.isOk()) {
     throw std::runtime_error("Failed to load image: " + resp.getStatusStr());
@@ -198,9 +526,24 @@ void DockerClient::loadImage(const std::string& image_uri, const Json::Value& lo
   }
 }
 
+bool DockerClient::hasImage(const std::string& image_ref) {
+  // curl --unix-socket /var/run/docker.sock http://localhost/images/<ref>/json
+  const std::string cmd{"http://localhost/images/" + image_ref + "/json"};
+  const auto lock{lockHttpClient()};
+  const auto resp{http_client_->get(cmd, HttpInterface::kNoLimit)};
+  if (resp.http_status_code == 404) {
+    return false;
+  }
+  if (!resp.isOk()) {
+    throw std::runtime_error("Failed to inspect image: " + image_ref + ", err: " + resp.getStatusStr());
+  }
+  return true;
+}
+
 Json::Value DockerClient::getEngineInfo() {
   Json::Value info;
   const std::string cmd{"http://localhost/version"};
+  const auto lock{lockHttpClient()};
   auto resp = http_client_->get(cmd, HttpInterface::kNoLimit);
   if (resp.isOk()) {
     info = resp.getJson();
@@ -1,8 +1,14 @@
 #ifndef AKTUALIZR_LITE_DOCKER_CLIENT_H
 #define AKTUALIZR_LITE_DOCKER_CLIENT_H
 #include <json/json.h>
+#include <atomic>
+#include <condition_variable>
 #include <functional>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "appengine.h"
 #include "http/httpinterface.h"
@@ -14,9 +20,17 @@ class DockerClient : public AppEngine::Client {
   using Ptr = std::shared_ptr<DockerClient>;
   using HttpClientFactory = std::function<std::shared_ptr<HttpInterface>(const std::string& docker_host)>;
   static const HttpClientFactory DefaultHttpClientFactory;
+  // a client for the dockerd's event stream, unlike the default client it doesn't limit the request processing time
+  static const HttpClientFactory DefaultEventsHttpClientFactory;
+  static constexpr int EventsReconnectIntervalS{5};
 
+  // If `events_http_client` is specified then the client keeps a cache of containers' state which is primed by
+  // listing containers once and then kept current by the container events streamed by dockerd, so the container
+  // queries don't hit dockerd unless a container has changed since the last query.
   explicit DockerClient(
-      std::shared_ptr<HttpInterface> http_client = DefaultHttpClientFactory("unix:///var/run/docker.sock"));
+      std::shared_ptr<HttpInterface> http_client = DefaultHttpClientFactory("unix:///var/run/docker.sock"),
+      std::shared_ptr<HttpInterface> events_http_client = nullptr);
+  ~DockerClient() override;
 
   void getContainers(Json::Value& root) override;
   std::tuple<bool, std::string> getContainerState(const Json::Value& root, const std::string& app,
@@ -28,15 +42,55 @@ class DockerClient : public AppEngine::Client {
   void pruneImages() override;
   void pruneContainers() override;
   void loadImage(const std::string& image_uri, const Json::Value& load_manifest) override;
+  bool hasImage(const std::string& image_ref);
   static std::string tarString(const std::string& data, const std::string& file_name_in_tar);
 
  private:
+  struct EventStream;
+  // container attributes listed by `/containers/json` that are used by the client
+  struct Container {
+    explicit Container(const Json::Value& container);
+
+    std::string id;
+    std::string app;
+    std::string service;
+    std::string hash;
+    std::string image;
+    std::string state;
+    std::string status;
+  };
+
   Json::Value getEngineInfo();
   Json::Value getContainerInfo(const std::string& id);
+  Json::Value listContainers(const std::string& filters = "");
+  std::string getContainerHealth(const Container& container);
+
+  // container state cache
+  Json::Value getCachedContainers();
+  void watchEvents();
+  void onEvent(const Json::Value& event);
 
+  // Serializes the requests if the http client is not thread-safe, e.g. the curl-based one, since the docker client
+  // can be used by concurrent app status checks. Requests sent by DockerdHttpClient are not serialized.
+  std::unique_lock<std::mutex> lockHttpClient();
+
+  std::mutex http_client_mutex_;
   std::shared_ptr<HttpInterface> http_client_;
+  const bool is_http_client_thread_safe_;
   const Json::Value engine_info_;
   const std::string arch_;
+
+  std::shared_ptr<HttpInterface> events_http_client_;
+  std::mutex cache_mutex_;
+  // container ID -> container as listed by `/containers/json`
+  std::unordered_map<std::string, Json::Value> containers_;
+  // containers changed since the last query, they are re-listed by the next query
+  std::unordered_set<std::string> changed_containers_;
+  bool cache_valid_{false};
+  bool events_connected_{false};
+  std::atomic_bool stop_events_{false};
+  std::condition_variable stop_events_cv_;
+  std::thread events_thread_;
 };
 
 }  // namespace Docker
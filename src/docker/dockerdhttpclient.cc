@@ -0,0 +1,455 @@
+#include "dockerdhttpclient.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <future>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "utilities/utils.h"
+
+namespace Docker {
+
+struct DockerdHttpClient::Connection {
+  explicit Connection(int fd_in) : fd{fd_in} {}
+  ~Connection() { ::close(fd); }
+  Connection(const Connection&) = delete;
+  Connection(Connection&&) = delete;
+  Connection& operator=(const Connection&) = delete;
+  Connection& operator=(Connection&&) = delete;
+
+  const int fd;
+};
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const size_t MaxHeaderLineSize{64 * 1024};
+
+enum class ReadStatus { Ok, Closed, Timeout, Aborted, Rejected, Error };
+
+// Reads a response from a connection, received data that are not consumed yet are kept in the buffer
+class ResponseReader {
+ public:
+  using Sink = std::function<bool(const char* data, size_t size)>;
+  using ProgressHandler = std::function<bool(uint64_t received)>;
+
+  ResponseReader(int fd, Clock::time_point deadline, const ProgressHandler& progress_handler)
+      : fd_{fd}, deadline_{deadline}, progress_handler_{progress_handler}, chunk_(DockerdHttpClient::ReadBufferSize) {}
+
+  // reads a line without the trailing CRLF
+  ReadStatus readLine(std::string& line) {
+    while (true) {
+      const auto line_end{buffer_.find("\r\n", pos_)};
+      if (line_end != std::string::npos) {
+        line = buffer_.substr(pos_, line_end - pos_);
+        pos_ = line_end + 2;
+        return ReadStatus::Ok;
+      }
+      if (buffer_.size() - pos_ > MaxHeaderLineSize) {
+        return ReadStatus::Error;
+      }
+      const auto status{fill()};
+      if (status != ReadStatus::Ok) {
+        return status;
+      }
+    }
+  }
+
+  // passes exactly `size` bytes to the sink
+  ReadStatus read(size_t size, const Sink& sink) {
+    while (size > 0) {
+      if (pos_ == buffer_.size()) {
+        const auto status{fill()};
+        if (status != ReadStatus::Ok) {
+          return status;
+        }
+      }
+      const auto read_size{std::min(size, buffer_.size() - pos_)};
+      if (!sink(buffer_.data() + pos_, read_size)) {
+        return ReadStatus::Rejected;
+      }
+      pos_ += read_size;
+      size -= read_size;
+    }
+    return ReadStatus::Ok;
+  }
+
+  // passes all data to the sink until the connection is closed
+  ReadStatus readAll(const Sink& sink) {
+    while (true) {
+      if (pos_ < buffer_.size()) {
+        if (!sink(buffer_.data() + pos_, buffer_.size() - pos_)) {
+          return ReadStatus::Rejected;
+        }
+        pos_ = buffer_.size();
+      }
+      const auto status{fill()};
+      if (status == ReadStatus::Closed) {
+        return ReadStatus::Ok;
+      }
+      if (status != ReadStatus::Ok) {
+        return status;
+      }
+    }
+  }
+
+  bool receivedAny() const { return received_ > 0; }
+
+ private:
+  ReadStatus fill() {
+    while (true) {
+      int64_t wait_ms{DockerdHttpClient::ProgressIntervalMs};
+      if (deadline_ != Clock::time_point::max()) {
+        const auto left_ms{std::chrono::duration_cast<std::chrono::milliseconds>(deadline_ - Clock::now()).count()};
+        if (left_ms <= 0) {
+          return ReadStatus::Timeout;
+        }
+        wait_ms = std::min(wait_ms, static_cast<int64_t>(left_ms));
+      }
+      pollfd poll_fd{fd_, POLLIN, 0};
+      const int poll_res{::poll(&poll_fd, 1, static_cast<int>(wait_ms))};
+      if (poll_res == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return ReadStatus::Error;
+      }
+      if (poll_res == 0) {
+        if (progress_handler_ && !progress_handler_(received_)) {
+          return ReadStatus::Aborted;
+        }
+        continue;
+      }
+      const auto read_size{::recv(fd_, chunk_.data(), chunk_.size(), 0)};
+      if (read_size == -1) {
+        if (errno == EINTR || errno == EAGAIN) {
+          continue;
+        }
+        return ReadStatus::Error;
+      }
+      if (read_size == 0) {
+        return ReadStatus::Closed;
+      }
+      // drop the consumed data so the buffer doesn't grow while a long body is being streamed
+      if (pos_ == buffer_.size()) {
+        buffer_.clear();
+        pos_ = 0;
+      } else if (pos_ > chunk_.size()) {
+        buffer_.erase(0, pos_);
+        pos_ = 0;
+      }
+      buffer_.append(chunk_.data(), static_cast<size_t>(read_size));
+      received_ += static_cast<uint64_t>(read_size);
+      return ReadStatus::Ok;
+    }
+  }
+
+  const int fd_;
+  const Clock::time_point deadline_;
+  const ProgressHandler& progress_handler_;
+  std::vector<char> chunk_;
+  std::string buffer_;
+  size_t pos_{0};
+  uint64_t received_{0};
+};
+
+bool sendAll(int fd, const std::string& data) {
+  size_t sent{0};
+  while (sent < data.size()) {
+    const auto res{::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL)};
+    if (res == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    sent += static_cast<size_t>(res);
+  }
+  return true;
+}
+
+HttpResponse getErrorResponse(ReadStatus status, long http_code, bool is_body_streamed) {
+  switch (status) {
+    case ReadStatus::Closed:
+      return HttpResponse("", http_code, http_code == 0 ? CURLE_GOT_NOTHING : CURLE_PARTIAL_FILE,
+                          "Connection to dockerd has been closed");
+    case ReadStatus::Timeout:
+      return HttpResponse("", http_code, CURLE_OPERATION_TIMEDOUT, "Request to dockerd has timed out");
+    case ReadStatus::Aborted:
+      return HttpResponse("", http_code, CURLE_ABORTED_BY_CALLBACK, "Request to dockerd has been aborted");
+    case ReadStatus::Rejected:
+      return is_body_streamed
+                 ? HttpResponse("", http_code, CURLE_WRITE_ERROR, "Response body has been rejected by a caller")
+                 : HttpResponse("", http_code, CURLE_FILESIZE_EXCEEDED, "Response body exceeds the maximum size");
+    default:
+      return HttpResponse("", http_code, CURLE_RECV_ERROR,
+                          std::string("Failed to receive dockerd response: ") + std::strerror(errno));
+  }
+}
+
+}  // namespace
+
+DockerdHttpClient::DockerdHttpClient(std::string socket_path, int64_t timeout_ms)
+    : socket_path_{std::move(socket_path)}, timeout_ms_{timeout_ms} {}
+
+DockerdHttpClient::~DockerdHttpClient() = default;
+
+HttpResponse DockerdHttpClient::get(const std::string& url, int64_t maxsize) {
+  return send(Request{"GET", url, {}, "", ""}, maxsize);
+}
+
+HttpResponse DockerdHttpClient::post(const std::string& url, const std::string& content_type,
+                                     const std::string& data) {
+  return send(Request{"POST", url, {}, content_type, data}, HttpInterface::kNoLimit);
+}
+
+HttpResponse DockerdHttpClient::post(const std::string& url, const Json::Value& data) {
+  return post(url, "application/json", Utils::jsonToCanonicalStr(data));
+}
+
+HttpResponse DockerdHttpClient::put(const std::string& url, const std::string& content_type,
+                                    const std::string& data) {
+  return send(Request{"PUT", url, {}, content_type, data}, HttpInterface::kNoLimit);
+}
+
+HttpResponse DockerdHttpClient::put(const std::string& url, const Json::Value& data) {
+  return put(url, "application/json", Utils::jsonToCanonicalStr(data));
+}
+
+HttpResponse DockerdHttpClient::download(const std::string& url, curl_write_callback write_cb,
+                                         curl_xferinfo_callback progress_cb, void* userp, curl_off_t from) {
+  Request req{"GET", url, {}, "", ""};
+  if (from > 0) {
+    req.headers.emplace_back("Range: bytes=" + std::to_string(from) + "-");
+  }
+  ProgressHandler progress_handler;
+  if (progress_cb != nullptr) {
+    progress_handler = [progress_cb, userp](uint64_t received) {
+      return progress_cb(userp, 0, static_cast<curl_off_t>(received), 0, 0) == 0;
+    };
+  }
+  return send(
+      req, HttpInterface::kNoLimit,
+      [write_cb, userp](const char* data, size_t size) {
+        return write_cb(const_cast<char*>(data), 1, size, userp) == size;
+      },
+      progress_handler);
+}
+
+std::future<HttpResponse> DockerdHttpClient::downloadAsync(const std::string& url, curl_write_callback write_cb,
+                                                           curl_xferinfo_callback progress_cb, void* userp,
+                                                           curl_off_t from, CurlHandler* easyp) {
+  (void)easyp;
+  return std::async(std::launch::async, [this, url, write_cb, progress_cb, userp, from]() {
+    return download(url, write_cb, progress_cb, userp, from);
+  });
+}
+
+void DockerdHttpClient::setCerts(const std::string& ca, CryptoSource ca_source, const std::string& cert,
+                                 CryptoSource cert_source, const std::string& pkey, CryptoSource pkey_source) {
+  // dockerd is reached through a unix socket, so there is nothing to secure
+  (void)ca;
+  (void)ca_source;
+  (void)cert;
+  (void)cert_source;
+  (void)pkey;
+  (void)pkey_source;
+}
+
+HttpResponse DockerdHttpClient::postStreaming(const std::string& url, const std::string& content_type,
+                                              const std::string& data, const BodyHandler& body_handler) {
+  return send(Request{"POST", url, {}, content_type, data}, HttpInterface::kNoLimit, body_handler);
+}
+
+HttpResponse DockerdHttpClient::send(const Request& req, int64_t maxsize, const BodyHandler& body_handler,
+                                     const ProgressHandler& progress_handler) {
+  const auto deadline{timeout_ms_ > 0 ? Clock::now() + std::chrono::milliseconds(timeout_ms_)
+                                      : Clock::time_point::max()};
+  // the host part of the url is ignored since the socket determines the dockerd to talk to
+  std::string path{req.url};
+  const auto scheme_end{path.find("://")};
+  if (scheme_end != std::string::npos) {
+    const auto path_start{path.find('/', scheme_end + 3)};
+    path = path_start == std::string::npos ? "/" : path.substr(path_start);
+  }
+  std::string head{req.method + " " + path + " HTTP/1.1\r\nHost: localhost\r\n"};
+  for (const auto& header : req.headers) {
+    head += header + "\r\n";
+  }
+  if (!req.content_type.empty()) {
+    head += "Content-Type: " + req.content_type + "\r\n";
+  }
+  if (req.method != "GET") {
+    head += "Content-Length: " + std::to_string(req.body.size()) + "\r\n";
+  }
+  head += "\r\n";
+
+  // A pooled connection may have been closed by dockerd meanwhile, in this case the request is re-sent over a new
+  // connection if sending it fails. If the connection is closed once the request is sent, then only an idempotent
+  // request is re-sent and only if no part of the response has been received, since dockerd might have processed it.
+  const bool is_idempotent{req.method == "GET" || req.method == "HEAD"};
+  while (true) {
+    auto connection{getIdleConnection()};
+    const bool is_reused{connection != nullptr};
+    if (!connection) {
+      std::string err;
+      connection = connect(err);
+      if (!connection) {
+        return HttpResponse("", 0, CURLE_COULDNT_CONNECT,
+                            "Failed to connect to dockerd socket " + socket_path_ + ": " + err);
+      }
+    }
+    if (!sendAll(connection->fd, head) || !sendAll(connection->fd, req.body)) {
+      if (is_reused) {
+        continue;
+      }
+      return HttpResponse("", 0, CURLE_SEND_ERROR,
+                          std::string("Failed to send request to dockerd: ") + std::strerror(errno));
+    }
+
+    ResponseReader reader{connection->fd, deadline, progress_handler};
+    std::string status_line;
+    auto status{reader.readLine(status_line)};
+    // dockerd resets a connection that it closes while a request is being sent over it
+    if ((status == ReadStatus::Closed || status == ReadStatus::Error) && is_reused && is_idempotent &&
+        !reader.receivedAny()) {
+      continue;
+    }
+    if (status != ReadStatus::Ok) {
+      return getErrorResponse(status, 0, !!body_handler);
+    }
+
+    // HTTP/1.1 200 OK
+    long http_code{0};
+    try {
+      http_code = boost::lexical_cast<long>(status_line.substr(9, 3));
+    } catch (const std::exception&) {
+      return HttpResponse("", 0, CURLE_WEIRD_SERVER_REPLY, "Invalid dockerd response status line: " + status_line);
+    }
+    const bool is_http_1_1{boost::starts_with(status_line, "HTTP/1.1")};
+    bool keep_alive{is_http_1_1};
+    bool is_chunked{false};
+    bool has_content_length{false};
+    size_t content_length{0};
+    std::string header;
+    while ((status = reader.readLine(header)) == ReadStatus::Ok && !header.empty()) {
+      const auto colon_pos{header.find(':')};
+      if (colon_pos == std::string::npos) {
+        continue;
+      }
+      const auto name{boost::algorithm::to_lower_copy(header.substr(0, colon_pos))};
+      const auto value{boost::algorithm::to_lower_copy(boost::algorithm::trim_copy(header.substr(colon_pos + 1)))};
+      if (name == "content-length") {
+        try {
+          content_length = boost::lexical_cast<size_t>(value);
+          has_content_length = true;
+        } catch (const std::exception&) {
+          return HttpResponse("", http_code, CURLE_WEIRD_SERVER_REPLY, "Invalid dockerd response header: " + header);
+        }
+      } else if (name == "transfer-encoding") {
+        is_chunked = value.find("chunked") != std::string::npos;
+      } else if (name == "connection") {
+        keep_alive = is_http_1_1 ? value != "close" : value == "keep-alive";
+      }
+    }
+    if (status != ReadStatus::Ok) {
+      return getErrorResponse(status, http_code, !!body_handler);
+    }
+
+    std::string body;
+    const BodyHandler sink{body_handler ? body_handler : [&body, maxsize](const char* data, size_t size) {
+      if (maxsize > 0 && body.size() + size > static_cast<size_t>(maxsize)) {
+        return false;
+      }
+      body.append(data, size);
+      return true;
+    }};
+    const bool has_body{req.method != "HEAD" && http_code != 204 && http_code != 304 && http_code >= 200};
+    if (!has_body) {
+      status = ReadStatus::Ok;
+    } else if (is_chunked) {
+      std::string line;
+      while ((status = reader.readLine(line)) == ReadStatus::Ok) {
+        size_t chunk_size{0};
+        try {
+          chunk_size = std::stoul(line, nullptr, 16);
+        } catch (const std::exception&) {
+          return HttpResponse("", http_code, CURLE_WEIRD_SERVER_REPLY, "Invalid dockerd response chunk: " + line);
+        }
+        if (chunk_size == 0) {
+          // skip trailers
+          while ((status = reader.readLine(line)) == ReadStatus::Ok && !line.empty()) {
+          }
+          break;
+        }
+        if ((status = reader.read(chunk_size, sink)) != ReadStatus::Ok ||
+            (status = reader.readLine(line)) != ReadStatus::Ok) {
+          break;
+        }
+      }
+    } else if (has_content_length) {
+      status = reader.read(content_length, sink);
+    } else {
+      // the body is delimited by closing the connection
+      status = reader.readAll(sink);
+      keep_alive = false;
+    }
+    if (status != ReadStatus::Ok) {
+      return getErrorResponse(status, http_code, !!body_handler);
+    }
+
+    if (keep_alive) {
+      releaseConnection(std::move(connection));
+    }
+    return HttpResponse(body, http_code, CURLE_OK, "");
+  }
+}
+
+std::unique_ptr<DockerdHttpClient::Connection> DockerdHttpClient::connect(std::string& err) const {
+  sockaddr_un addr{};
+  if (socket_path_.size() >= sizeof(addr.sun_path)) {
+    err = "the socket path is too long";
+    return nullptr;
+  }
+  const int fd{::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+  if (fd == -1) {
+    err = std::strerror(errno);
+    return nullptr;
+  }
+  auto connection{std::make_unique<Connection>(fd)};
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, socket_path_.c_str(), socket_path_.size());
+  if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    err = std::strerror(errno);
+    return nullptr;
+  }
+  return connection;
+}
+
+std::unique_ptr<DockerdHttpClient::Connection> DockerdHttpClient::getIdleConnection() {
+  std::lock_guard<std::mutex> lock{connections_mutex_};
+  if (idle_connections_.empty()) {
+    return nullptr;
+  }
+  auto connection{std::move(idle_connections_.back())};
+  idle_connections_.pop_back();
+  return connection;
+}
+
+void DockerdHttpClient::releaseConnection(std::unique_ptr<Connection> connection) {
+  std::lock_guard<std::mutex> lock{connections_mutex_};
+  if (idle_connections_.size() < MaxIdleConnections) {
+    idle_connections_.emplace_back(std::move(connection));
+  }
+}
+
+}  // namespace Docker
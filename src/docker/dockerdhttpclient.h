@@ -0,0 +1,83 @@
+#ifndef AKTUALIZR_LITE_DOCKERD_HTTP_CLIENT_H
+#define AKTUALIZR_LITE_DOCKERD_HTTP_CLIENT_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "http/httpinterface.h"
+
+namespace Docker {
+
+/**
+ * @brief DockerdHttpClient, a lightweight HTTP/1.1 client of dockerd listening on a unix socket
+ *
+ * Unlike the generic curl-based client, it keeps connections to dockerd alive and reuses them for subsequent requests,
+ * so a request costs neither a new connection nor a curl handle setup. Response bodies can be streamed to a caller as
+ * they are received, which is needed for endless (`/events`) and long running (`/images/load`) requests.
+ * Requests can be sent concurrently, each one takes its own connection from the pool of idle connections.
+ */
+class DockerdHttpClient : public HttpInterface {
+ public:
+  // returns false to abort the transfer
+  using BodyHandler = std::function<bool(const char* data, size_t size)>;
+
+  static constexpr size_t MaxIdleConnections{4};
+  static constexpr size_t ReadBufferSize{64 * 1024};
+  static constexpr int64_t ProgressIntervalMs{1000};
+
+  // `timeout_ms` limits the time of the overall request processing, zero means no limit
+  explicit DockerdHttpClient(std::string socket_path, int64_t timeout_ms = 0);
+  ~DockerdHttpClient() override;
+  DockerdHttpClient(const DockerdHttpClient&) = delete;
+  DockerdHttpClient(DockerdHttpClient&&) = delete;
+  DockerdHttpClient& operator=(const DockerdHttpClient&) = delete;
+  DockerdHttpClient& operator=(DockerdHttpClient&&) = delete;
+
+  HttpResponse get(const std::string& url, int64_t maxsize) override;
+  HttpResponse post(const std::string& url, const std::string& content_type, const std::string& data) override;
+  HttpResponse post(const std::string& url, const Json::Value& data) override;
+  HttpResponse put(const std::string& url, const std::string& content_type, const std::string& data) override;
+  HttpResponse put(const std::string& url, const Json::Value& data) override;
+  // the `progress_cb` is invoked each `ProgressIntervalMs` while waiting for data, the transfer is aborted if it
+  // returns non-zero value
+  HttpResponse download(const std::string& url, curl_write_callback write_cb, curl_xferinfo_callback progress_cb,
+                        void* userp, curl_off_t from) override;
+  std::future<HttpResponse> downloadAsync(const std::string& url, curl_write_callback write_cb,
+                                          curl_xferinfo_callback progress_cb, void* userp, curl_off_t from,
+                                          CurlHandler* easyp) override;
+  void setCerts(const std::string& ca, CryptoSource ca_source, const std::string& cert, CryptoSource cert_source,
+                const std::string& pkey, CryptoSource pkey_source) override;
+
+  // POST whose response body is passed to `body_handler` as it's received instead of being stored in the response
+  HttpResponse postStreaming(const std::string& url, const std::string& content_type, const std::string& data,
+                             const BodyHandler& body_handler);
+
+ private:
+  struct Connection;
+  struct Request {
+    std::string method;
+    std::string url;
+    std::vector<std::string> headers;
+    std::string content_type;
+    std::string body;
+  };
+  using ProgressHandler = std::function<bool(uint64_t received)>;
+
+  HttpResponse send(const Request& req, int64_t maxsize, const BodyHandler& body_handler = nullptr,
+                    const ProgressHandler& progress_handler = nullptr);
+  std::unique_ptr<Connection> connect(std::string& err) const;
+  std::unique_ptr<Connection> getIdleConnection();
+  void releaseConnection(std::unique_ptr<Connection> connection);
+
+  const std::string socket_path_;
+  const int64_t timeout_ms_;
+  std::mutex connections_mutex_;
+  std::vector<std::unique_ptr<Connection>> idle_connections_;
+};
+
+}  // namespace Docker
+
+#endif  // AKTUALIZR_LITE_DOCKERD_HTTP_CLIENT_H
@@ -1,7 +1,17 @@
 #include "restorableappengine.h"
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <sys/statvfs.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
+#include <fstream>
+#include <iterator>
 #include <limits>
 #include <unordered_set>
 
@@ -16,6 +26,7 @@
 #include "docker/composeappengine.h"
 #include "docker/composeinfo.h"
 #include "exec.h"
+#include "workerpool.h"
 
 namespace fs = std::filesystem;
 
@@ -58,7 +69,8 @@ RestorableAppEngine::RestorableAppEngine(boost::filesystem::path store_root, boo
                                          Docker::DockerClient::Ptr docker_client, std::string client,
                                          std::string docker_host, std::string compose_cmd,
                                          StorageSpaceFunc storage_space_func, ClientImageSrcFunc client_image_src_func,
-                                         bool create_containers_if_install, bool offline)
+                                         bool create_containers_if_install, bool offline, bool deep_verify,
+                                         boost::filesystem::path local_blobs_root)
     : store_root_{std::move(store_root)},
       install_root_{std::move(install_root)},
       docker_root_{std::move(docker_root)},
@@ -71,9 +83,19 @@ RestorableAppEngine::RestorableAppEngine(boost::filesystem::path store_root, boo
       storage_space_func_{std::move(storage_space_func)},
       client_image_src_func_{std::move(client_image_src_func)},
       create_containers_if_install_{create_containers_if_install},
-      offline_{offline} {
+      offline_{offline},
+      deep_verify_{deep_verify},
+      local_blobs_root_{std::move(local_blobs_root)} {
   boost::filesystem::create_directories(apps_root_);
   boost::filesystem::create_directories(blobs_root_);
+  if (!local_blobs_root_.empty()) {
+    const auto local_volume_id{getPathVolumeID(local_blobs_root_)};
+    const auto store_volume_id{getPathVolumeID(blobs_root_)};
+    local_blobs_same_volume_ = std::get<1>(local_volume_id) && std::get<1>(store_volume_id) &&
+                               std::get<0>(local_volume_id) == std::get<0>(store_volume_id);
+    LOG_INFO << "Blobs of the local store " << local_blobs_root_ << " will be "
+             << (local_blobs_same_volume_ ? "shared with" : "copied to") << " the App store " << blobs_root_;
+  }
 
   removeTmpFiles(apps_root_);
 
@@ -96,6 +118,26 @@ RestorableAppEngine::RestorableAppEngine(boost::filesystem::path store_root, boo
                 << "; err: " << cast_err.what();
     }
   }
+
+  if (const char* max_par_loads_str = std::getenv("DOCKER_MAX_PARALLEL_LOADS")) {
+    try {
+      max_parallel_loads_ = boost::lexical_cast<int>(max_par_loads_str);
+      if (max_parallel_loads_ > DockerMaxParallelLoadsHighLimit) {
+        LOG_WARNING << "Value of DOCKER_MAX_PARALLEL_LOADS env variable exceeds the maximum allowed; value: "
+                    << max_par_loads_str << "; the maximum allowed: " << DockerMaxParallelLoadsHighLimit;
+        max_parallel_loads_ = DockerMaxParallelLoadsHighLimit;
+      }
+      if (max_parallel_loads_ < DockerMaxParallelLoadsLowLimit) {
+        LOG_WARNING << "Value of DOCKER_MAX_PARALLEL_LOADS env variable is lower than the minimum allowed; value: "
+                    << max_par_loads_str << "; the minimum allowed: " << DockerMaxParallelLoadsLowLimit;
+        max_parallel_loads_ = DockerMaxParallelLoadsLowLimit;
+      }
+      LOG_DEBUG << "Images will be loaded to the docker store concurrently by " << max_parallel_loads_ << " threads";
+    } catch (const boost::bad_lexical_cast& cast_err) {
+      LOG_ERROR << "Invalid value of DOCKER_MAX_PARALLEL_LOADS env variable; value: " << max_par_loads_str
+                << "; err: " << cast_err.what();
+    }
+  }
 }
 
 AppEngine::Result RestorableAppEngine::fetch(const App& app) {
@@ -114,13 +156,18 @@ AppEngine::Result RestorableAppEngine::fetch(const App& app) {
     }
 
     // check App size
-    checkAppUpdateSize(uri, app_dir);
+    const auto shareable_blobs{checkAppUpdateSize(uri, app_dir)};
+    shareBlobs(shareable_blobs);
 
     // Invoke download of App images unconditionally because `skopeo` is supposed
     // to skip already downloaded image blobs internally while performing `copy` command
     const auto images_dir{app_dir / "images"};
     LOG_DEBUG << app.name << ": downloading App images from Registry(ies): " << app.uri << " --> " << images_dir;
     pullAppImages(uri, app_compose_file, images_dir);
+
+    // record the App blobs so the prune doesn't need to parse the App manifests to find out what blobs are in use
+    blob_refs_.set(BlobRefTable::getAppVersion(uri.app, uri.digest.hash()), getAppBlobs(uri, app_dir, false));
+    blob_refs_.flush();
     res = true;
   } catch (const InsufficientSpaceError& exc) {
     res = {Result::ID::InsufficientSpace, exc.what(), exc.stat};
@@ -132,6 +179,9 @@ AppEngine::Result RestorableAppEngine::fetch(const App& app) {
     if (boost::filesystem::exists(app_dir)) {
       boost::filesystem::remove_all(app_dir);
     }
+    // the failed fetch might have left blobs that are not referenced by any App, only the full sweep can find them
+    blob_refs_.setSweepRequired(true);
+    blob_refs_.flush();
   }
   return res;
 }
@@ -285,129 +335,11 @@ Json::Value RestorableAppEngine::getRunningAppsInfo() const {
 }
 
 void RestorableAppEngine::prune(const Apps& app_shortlist) {
-  std::unordered_set<std::string> blob_shortlist;
   bool prune_docker_store{false};
-
-  for (const auto& entry : boost::make_iterator_range(boost::filesystem::directory_iterator(apps_root_), {})) {
-    if (!boost::filesystem::is_directory(entry)) {
-      continue;
-    }
-    const std::string dir = entry.path().filename().native();
-    auto foundAppIt = std::find_if(app_shortlist.begin(), app_shortlist.end(),
-                                   [&dir](const AppEngine::App& app) { return dir == app.name; });
-
-    if (foundAppIt == app_shortlist.end()) {
-      // remove App dir tree since it's not found in the shortlist
-      boost::filesystem::remove_all(entry.path());
-      LOG_INFO << "Removing App dir: " << entry.path();
-      prune_docker_store = true;
-      continue;
-    }
-
-    const auto& app{*foundAppIt};
-    const Uri uri{Uri::parseUri(app.uri)};
-
-    // iterate over `app` subdirectories/versions and remove those that doesn't match the specified version
-    const auto app_dir{apps_root_ / uri.app};
-
-    for (const auto& entry : boost::make_iterator_range(boost::filesystem::directory_iterator(app_dir), {})) {
-      if (!boost::filesystem::is_directory(entry)) {
-        LOG_WARNING << "Found file while expected an App version directory: " << entry.path().filename().native();
-        continue;
-      }
-
-      const std::string app_version_dir = entry.path().filename().native();
-      if (app_version_dir != uri.digest.hash()) {
-        LOG_INFO << "Removing App version dir: " << entry.path();
-        boost::filesystem::remove_all(entry.path());
-        prune_docker_store = true;
-        continue;
-      }
-
-      if (boost::filesystem::exists(entry.path() / Manifest::Filename)) {
-        // add app manifest to the blob shortlist
-        blob_shortlist.emplace(uri.digest.hash());
-        // add blobs of the shortlisted app's manifest to the blob shortlist
-        try {
-          const Manifest app_manifest{Utils::parseJSONFile(entry.path() / Manifest::Filename)};
-          for (const auto& element : std::vector<std::string>{"manifests", "layers"}) {
-            if (!app_manifest.isNull() && app_manifest.isMember(element) && app_manifest[element].isArray()) {
-              for (const auto& b : app_manifest[element]) {
-                if (!b.isNull() && b.isMember("digest")) {
-                  blob_shortlist.emplace(HashedDigest{b["digest"].asString()}.hash());
-                }
-              }
-            }
-          }
-        } catch (const std::exception& exc) {
-          LOG_WARNING << "Found invalid app manifest in the store, its blobs will be pruned; app: " << app.name
-                      << "err: " << exc.what();
-        }
-      }
-
-      // add blobs of each image of the shortlisted app to the blob shortlist
-      ComposeInfo compose{(entry.path() / ComposeFile).string()};
-      for (const auto& service : compose.getServices()) {
-        const auto image = compose.getImage(service);
-        const Uri image_uri{Uri::parseUri(image, false)};
-        // add image manifest to the blob shortlist
-        blob_shortlist.emplace(image_uri.digest.hash());
-        const auto image_root{app_dir / app_version_dir / "images" / image_uri.registryHostname / image_uri.repo /
-                              image_uri.digest.hash()};
-
-        // Make sure the image root element (index or manifest) is not removed.
-        // We need it for backward compatibility with the composeapp utility.
-        blob_shortlist.emplace(image_uri.digest.hash());
-        const auto index_manifest{image_root / "index.json"};
-        if (!boost::filesystem::exists(index_manifest)) {
-          LOG_WARNING << "Failed to find an index manifest of App image: " << image << ", removing its directory";
-          boost::filesystem::remove_all(image_root);
-          continue;
-        }
-
-        try {
-          const auto image_manifest_desc{Utils::parseJSONFile(index_manifest)};
-          HashedDigest image_digest{image_manifest_desc["manifests"][0]["digest"].asString()};
-          blob_shortlist.emplace(image_digest.hash());
-
-          const auto image_manifest{Utils::parseJSONFile(blobs_root_ / "sha256" / image_digest.hash())};
-          blob_shortlist.emplace(HashedDigest(image_manifest["config"]["digest"].asString()).hash());
-
-          const auto image_layers{image_manifest["layers"]};
-          for (Json::ValueConstIterator ii = image_layers.begin(); ii != image_layers.end(); ++ii) {
-            if ((*ii).isObject() && (*ii).isMember("digest")) {
-              const auto layer_digest{HashedDigest{(*ii)["digest"].asString()}};
-              blob_shortlist.emplace(layer_digest.hash());
-            } else {
-              LOG_ERROR << "Invalid image manifest: " << ii.key().asString() << " -> " << *ii;
-            }
-          }
-        } catch (const std::exception& exc) {
-          LOG_WARNING << "Found invalid app image manifest in the store, its blobs will be pruned; image: " << image
-                      << "err: " << exc.what();
-          boost::filesystem::remove_all(image_root);
-        }
-      }
-    }
-  }
-
-  // prune blobs
-  if (!boost::filesystem::exists(blobs_root_ / "sha256")) {
-    return;
-  }
-
-  for (const auto& entry :
-       boost::make_iterator_range(boost::filesystem::directory_iterator(blobs_root_ / "sha256"), {})) {
-    if (boost::filesystem::is_directory(entry)) {
-      continue;
-    }
-
-    const std::string blob_sha = entry.path().filename().native();
-    if (blob_shortlist.end() == blob_shortlist.find(blob_sha)) {
-      LOG_INFO << "Removing blob: " << entry.path();
-      boost::filesystem::remove_all(entry.path());
-      prune_docker_store = true;
-    }
+  const auto reclaimed{collectGarbage(app_shortlist, false, prune_docker_store)};
+  if (reclaimed.blob_numb > 0) {
+    LOG_INFO << "Removed " << reclaimed.blob_numb << " unused blobs, reclaimed " << reclaimed.bytes << " bytes";
+    prune_docker_store = true;
   }
 
   // prune docker store
@@ -416,6 +348,11 @@ void RestorableAppEngine::prune(const Apps& app_shortlist) {
   }
 }
 
+RestorableAppEngine::ReclaimableSpace RestorableAppEngine::getReclaimableSpace(const Apps& app_shortlist) {
+  bool prune_docker_store{false};
+  return collectGarbage(app_shortlist, true, prune_docker_store);
+}
+
 // protected & private implementation
 
 void RestorableAppEngine::pullApp(const Uri& uri, const boost::filesystem::path& app_dir) {
@@ -443,17 +380,19 @@ void RestorableAppEngine::pullApp(const Uri& uri, const boost::filesystem::path&
   Utils::writeFile(app_dir / ComposeFile, compose);
 }
 
-void RestorableAppEngine::checkAppUpdateSize(const Uri& uri, const boost::filesystem::path& app_dir) const {
+std::unordered_set<std::string> RestorableAppEngine::checkAppUpdateSize(const Uri& uri,
+                                                                        const boost::filesystem::path& app_dir) const {
   const Manifest manifest{Utils::parseJSONFile(app_dir / Manifest::Filename)};
   const auto arch{docker_client_->arch()};
   if (arch.empty()) {
     LOG_WARNING << "Failed to get an info about a system architecture";
-    return;
+    return {};
   }
 
   uint64_t skopeo_total_update_size;
   uint64_t docker_total_update_size;
   bool fallback_to_estimated_update_size_calculation{true};
+  std::unordered_set<std::string> shareable_blobs;
 
   const auto layers_meta_desc{manifest.layersMetaDescr()};
   if (layers_meta_desc) {
@@ -465,9 +404,14 @@ void RestorableAppEngine::checkAppUpdateSize(const Uri& uri, const boost::filesy
       if (!layers_meta.isMember(arch)) {
         throw std::runtime_error("No layers metadata for the given arch: " + arch);
       }
+      std::vector<std::string> layer_hashes;
+      for (const auto& layer_digest : layers_meta[arch]["layers"].getMemberNames()) {
+        layer_hashes.emplace_back(HashedDigest(layer_digest).hash());
+      }
+      shareable_blobs = getShareableBlobs(layer_hashes);
       LOG_INFO << "Checking for App's layers to be pulled...";
       std::tie(skopeo_total_update_size, docker_total_update_size) =
-          getPreciseAppUpdateSize(layers_meta[arch]["layers"], blobs_root_ / "sha256");
+          getPreciseAppUpdateSize(layers_meta[arch]["layers"], blobs_root_ / "sha256", shareable_blobs);
       fallback_to_estimated_update_size_calculation = false;
     } catch (const std::exception& exc) {
       LOG_ERROR << "Failed to retrieve or utilize App layers metadata containing precise disk usage: " << exc.what();
@@ -481,7 +425,7 @@ void RestorableAppEngine::checkAppUpdateSize(const Uri& uri, const boost::filesy
     const auto layers_manifest{manifest.layersManifest(arch)};
     if (!layers_manifest.isObject()) {
       LOG_WARNING << "App layers' manifest is missing, skip checking an App update size";
-      return;
+      return {};
     }
 
     if (!(layers_manifest.isMember("digest") && layers_manifest["digest"].isString())) {
@@ -499,14 +443,75 @@ void RestorableAppEngine::checkAppUpdateSize(const Uri& uri, const boost::filesy
         registry_client_->getAppManifest(layers_manifest_uri, Manifest::IndexFormat, layers_manifest_size)};
     const auto man{Utils::parseJSON(man_str)};
 
+    std::vector<std::string> layer_hashes;
+    for (const auto& layer : man["layers"]) {
+      layer_hashes.emplace_back(HashedDigest(layer["digest"].asString()).hash());
+    }
+    shareable_blobs = getShareableBlobs(layer_hashes);
     LOG_INFO << "Checking for App's new layers...";
-    skopeo_total_update_size = getAppUpdateSize(man["layers"], blobs_root_ / "sha256");
+    uint64_t missing_blobs_size;
+    std::tie(skopeo_total_update_size, missing_blobs_size) =
+        getAppUpdateSize(man["layers"], blobs_root_ / "sha256", shareable_blobs);
     const uint32_t average_compression_ratio{5} /* gzip layer compression ratio */;
-    docker_total_update_size = getDockerStoreSizeForAppUpdate(skopeo_total_update_size, average_compression_ratio);
+    docker_total_update_size = getDockerStoreSizeForAppUpdate(missing_blobs_size, average_compression_ratio);
   }
 
   LOG_INFO << "Checking if there is sufficient amount of storage available for App update...";
   checkAvailableStorageInStores(uri.app, skopeo_total_update_size, docker_total_update_size);
+  return shareable_blobs;
+}
+
+std::unordered_set<std::string> RestorableAppEngine::getShareableBlobs(const std::vector<std::string>& hashes) const {
+  std::unordered_set<std::string> shareable_blobs;
+  if (!local_blobs_same_volume_) {
+    return shareable_blobs;
+  }
+  for (const auto& hash : hashes) {
+    if (!boost::filesystem::exists(blobs_root_ / "sha256" / hash) &&
+        boost::filesystem::exists(local_blobs_root_ / "sha256" / hash)) {
+      shareable_blobs.emplace(hash);
+    }
+  }
+  return shareable_blobs;
+}
+
+void RestorableAppEngine::shareBlobs(const std::unordered_set<std::string>& hashes) {
+  for (const auto& hash : hashes) {
+    const auto blob_path{blobs_root_ / "sha256" / hash};
+    if (!shareFile(local_blobs_root_ / "sha256" / hash, blob_path)) {
+      LOG_WARNING << "Failed to share blob " << hash << " with the local store, it will be copied: " << strerror(errno);
+      continue;
+    }
+    // the image transfer utility skips the blobs present in the store, so it doesn't verify the shared ones
+    if (getVerifiedContentHash(hash, blob_path) != hash) {
+      LOG_WARNING << "Blob shared with the local store is invalid, it will be copied: " << hash;
+      boost::filesystem::remove(blob_path);
+    }
+  }
+}
+
+bool RestorableAppEngine::shareFile(const boost::filesystem::path& src, const boost::filesystem::path& dst) {
+  // a reflink shares the file data blocks until one of the files is modified, a hardlink shares the file itself
+  const int src_fd{::open(src.c_str(), O_RDONLY | O_CLOEXEC)};
+  if (src_fd == -1) {
+    return false;
+  }
+  bool is_shared{false};
+  const boost::filesystem::path tmp_file{dst.string() + ".tmp"};
+  const int dst_fd{::open(tmp_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)};
+  if (dst_fd != -1) {
+    is_shared = ::ioctl(dst_fd, FICLONE, src_fd) == 0;
+    ::close(dst_fd);
+    is_shared = is_shared && ::rename(tmp_file.c_str(), dst.c_str()) == 0;
+    if (!is_shared) {
+      ::unlink(tmp_file.c_str());
+    }
+  }
+  ::close(src_fd);
+  if (!is_shared) {
+    is_shared = ::link(src.c_str(), dst.c_str()) == 0 || errno == EEXIST;
+  }
+  return is_shared;
 }
 
 void RestorableAppEngine::pullAppImages(const Uri& app_uri, const boost::filesystem::path& app_compose_file,
@@ -559,11 +564,25 @@ void RestorableAppEngine::installApp(const boost::filesystem::path& app_dir, con
 
 void RestorableAppEngine::installAppImages(const boost::filesystem::path& app_dir) {
   const auto compose{ComposeInfo((app_dir / ComposeFile).string())};
+  // services may share an image, so each image is loaded once
+  std::vector<std::string> image_uris;
   for (const auto& service : compose.getServices()) {
     const auto image_uri = compose.getImage(service);
+    if (std::find(image_uris.begin(), image_uris.end(), image_uri) == image_uris.end()) {
+      image_uris.emplace_back(image_uri);
+    }
+  }
+  // Images are independent of each other, so they are loaded concurrently; dockerd handles layers shared by them.
+  // If more than one load fails, then the error of the first image in the compose service order is reported.
+  forEachConcurrently(image_uris.size(), max_parallel_loads_, [&](std::size_t ii) {
+    const auto& image_uri{image_uris[ii]};
     const Uri uri{Uri::parseUri(image_uri, false)};
     const std::string tag{uri.registryHostname + '/' + uri.repo + ':' + uri.digest.shortHash()};
     const auto image_dir{app_dir / "images" / uri.registryHostname / uri.repo / uri.digest.hash()};
+    if (isImageLoaded(image_uri, tag)) {
+      LOG_INFO << uri.app << ": image has been already loaded into docker store: " << image_uri;
+      return;
+    }
     // TODO: Consider making type of installation configurable.
     // installImage(client_, image_dir, blobs_root_, docker_host_, tag);
     try {
@@ -571,6 +590,24 @@ void RestorableAppEngine::installAppImages(const boost::filesystem::path& app_di
     } catch (const std::exception& exc) {
       throw LoadImageException("Failed to load image to docker store; image: " + image_uri + ", err: " + exc.what());
     }
+    std::lock_guard<std::mutex> lock{loaded_images_mutex_};
+    loaded_images_.emplace(image_uri);
+  });
+}
+
+bool RestorableAppEngine::isImageLoaded(const std::string& image_uri, const std::string& tag) {
+  {
+    std::lock_guard<std::mutex> lock{loaded_images_mutex_};
+    if (loaded_images_.count(image_uri) == 0) {
+      return false;
+    }
+  }
+  // the image might have been pruned since it was loaded
+  try {
+    return docker_client_->hasImage(tag);
+  } catch (const std::exception& exc) {
+    LOG_WARNING << "Failed to check whether image is in docker store: " << tag << ", err: " << exc.what();
+    return false;
   }
 }
 
@@ -591,7 +628,7 @@ bool RestorableAppEngine::isAppFetched(const App& app) const {
       break;
     }
 
-    const auto manifest_hash{getContentHash(manifest_file)};
+    const auto manifest_hash{getVerifiedContentHash(uri.digest.hash(), manifest_file)};
     if (manifest_hash != uri.digest.hash()) {
       LOG_DEBUG << app.name << ": App manifest hash mismatch; actual: " << manifest_hash
                 << "; expected: " << uri.digest.hash();
@@ -608,8 +645,7 @@ bool RestorableAppEngine::isAppFetched(const App& app) const {
       break;
     }
 
-    // we assume that a compose App blob is relatively small so we can just read it all into RAM
-    const auto app_arch_hash{getContentHash(archive_full_path)};
+    const auto app_arch_hash{getVerifiedContentHash(archive_manifest_hash, archive_full_path)};
     if (app_arch_hash != archive_manifest_hash) {
       LOG_DEBUG << app.name << ": App archive hash mismatch; actual: " << app_arch_hash
                 << "; defined in manifest: " << archive_manifest_hash;
@@ -631,6 +667,7 @@ bool RestorableAppEngine::isAppFetched(const App& app) const {
     res = areAppImagesFetched(app);
   } while (false);
 
+  blob_index_.flush();
   return res;
 }
 
@@ -673,7 +710,7 @@ bool RestorableAppEngine::areAppImagesFetched(const App& app) const {
         return false;
       }
 
-      const auto manifest_hash{getContentHash(manifest_file)};
+      const auto manifest_hash{getVerifiedContentHash(manifest_digest.hash(), manifest_file)};
       if (manifest_hash != manifest_digest.hash()) {
         LOG_DEBUG << app.name << ": App image manifest hash mismatch; actual: " << manifest_hash
                   << "; expected: " << manifest_digest.hash();
@@ -691,7 +728,7 @@ bool RestorableAppEngine::areAppImagesFetched(const App& app) const {
         return false;
       }
 
-      const auto config_hash{getContentHash(config_file)};
+      const auto config_hash{getVerifiedContentHash(config_digest.hash(), config_file)};
       if (config_hash != config_digest.hash()) {
         LOG_DEBUG << app.name << ": App image config hash mismatch; actual: " << config_hash
                   << "; expected: " << config_digest.hash();
@@ -738,6 +775,254 @@ bool RestorableAppEngine::areAppImagesFetched(const App& app) const {
   return true;
 }
 
+BlobRefTable::Blobs RestorableAppEngine::getAppBlobs(const Uri& uri, const boost::filesystem::path& app_version_dir,
+                                                     bool remove_invalid_images) const {
+  BlobRefTable::Blobs blobs;
+  if (boost::filesystem::exists(app_version_dir / Manifest::Filename)) {
+    // add app manifest to the App blobs
+    blobs.emplace(uri.digest.hash());
+    // add blobs of the app's manifest to the App blobs
+    try {
+      const Manifest app_manifest{Utils::parseJSONFile(app_version_dir / Manifest::Filename)};
+      for (const auto& element : std::vector<std::string>{"manifests", "layers"}) {
+        if (!app_manifest.isNull() && app_manifest.isMember(element) && app_manifest[element].isArray()) {
+          for (const auto& b : app_manifest[element]) {
+            if (!b.isNull() && b.isMember("digest")) {
+              blobs.emplace(HashedDigest{b["digest"].asString()}.hash());
+            }
+          }
+        }
+      }
+    } catch (const std::exception& exc) {
+      LOG_WARNING << "Found invalid app manifest in the store, its blobs will be pruned; app: " << uri.app
+                  << "err: " << exc.what();
+    }
+  }
+
+  // add blobs of each image of the app to the App blobs
+  ComposeInfo compose{(app_version_dir / ComposeFile).string()};
+  for (const auto& service : compose.getServices()) {
+    const auto image = compose.getImage(service);
+    const Uri image_uri{Uri::parseUri(image, false)};
+    const auto image_root{app_version_dir / "images" / image_uri.registryHostname / image_uri.repo /
+                          image_uri.digest.hash()};
+
+    // Make sure the image root element (index or manifest) is not removed.
+    // We need it for backward compatibility with the composeapp utility.
+    blobs.emplace(image_uri.digest.hash());
+    const auto index_manifest{image_root / "index.json"};
+    if (!boost::filesystem::exists(index_manifest)) {
+      LOG_WARNING << "Failed to find an index manifest of App image: " << image;
+      if (remove_invalid_images) {
+        boost::filesystem::remove_all(image_root);
+      }
+      continue;
+    }
+
+    try {
+      const auto image_manifest_desc{Utils::parseJSONFile(index_manifest)};
+      HashedDigest image_digest{image_manifest_desc["manifests"][0]["digest"].asString()};
+      blobs.emplace(image_digest.hash());
+
+      const auto image_manifest{Utils::parseJSONFile(blobs_root_ / "sha256" / image_digest.hash())};
+      blobs.emplace(HashedDigest(image_manifest["config"]["digest"].asString()).hash());
+
+      const auto image_layers{image_manifest["layers"]};
+      for (Json::ValueConstIterator ii = image_layers.begin(); ii != image_layers.end(); ++ii) {
+        if ((*ii).isObject() && (*ii).isMember("digest")) {
+          const auto layer_digest{HashedDigest{(*ii)["digest"].asString()}};
+          blobs.emplace(layer_digest.hash());
+        } else {
+          LOG_ERROR << "Invalid image manifest: " << ii.key().asString() << " -> " << *ii;
+        }
+      }
+    } catch (const std::exception& exc) {
+      LOG_WARNING << "Found invalid app image manifest in the store, its blobs will be pruned; image: " << image
+                  << "err: " << exc.what();
+      if (remove_invalid_images) {
+        boost::filesystem::remove_all(image_root);
+      }
+    }
+  }
+  return blobs;
+}
+
+RestorableAppEngine::ReclaimableSpace RestorableAppEngine::collectGarbage(const Apps& app_shortlist, bool dry_run,
+                                                                          bool& prune_docker_store) {
+  // Mark: find the App versions to keep, the blobs they refer to are taken from the blob reference table updated on
+  // each fetch. App manifests are parsed only if an App version is missing in the table, e.g. it had been fetched
+  // before the table was introduced.
+  std::unordered_set<std::string> app_versions;
+  // blobs of the shortlisted App versions that are missing in the table, the dry run doesn't add them to the table
+  BlobRefTable::Blobs unrecorded_blobs;
+  // blobs of a removed App version missing in the table can be found only by sweeping the whole blob store
+  bool sweep_required{false};
+
+  for (const auto& entry : boost::make_iterator_range(boost::filesystem::directory_iterator(apps_root_), {})) {
+    if (!boost::filesystem::is_directory(entry)) {
+      continue;
+    }
+    const std::string dir = entry.path().filename().native();
+    auto foundAppIt = std::find_if(app_shortlist.begin(), app_shortlist.end(),
+                                   [&dir](const AppEngine::App& app) { return dir == app.name; });
+
+    if (foundAppIt == app_shortlist.end()) {
+      for (const auto& version_entry : boost::make_iterator_range(boost::filesystem::directory_iterator(entry), {})) {
+        if (!blob_refs_.has(BlobRefTable::getAppVersion(dir, version_entry.path().filename().native()))) {
+          sweep_required = true;
+        }
+      }
+      prune_docker_store = true;
+      if (!dry_run) {
+        // remove App dir tree since it's not found in the shortlist
+        boost::filesystem::remove_all(entry.path());
+        LOG_INFO << "Removing App dir: " << entry.path();
+      }
+      continue;
+    }
+
+    const auto& app{*foundAppIt};
+    const Uri uri{Uri::parseUri(app.uri)};
+
+    // iterate over `app` subdirectories/versions and remove those that doesn't match the specified version
+    const auto app_dir{apps_root_ / uri.app};
+
+    for (const auto& entry : boost::make_iterator_range(boost::filesystem::directory_iterator(app_dir), {})) {
+      if (!boost::filesystem::is_directory(entry)) {
+        LOG_WARNING << "Found file while expected an App version directory: " << entry.path().filename().native();
+        continue;
+      }
+
+      const std::string app_version_dir = entry.path().filename().native();
+      const auto app_version{BlobRefTable::getAppVersion(uri.app, app_version_dir)};
+      if (app_version_dir != uri.digest.hash()) {
+        if (!blob_refs_.has(app_version)) {
+          sweep_required = true;
+        }
+        prune_docker_store = true;
+        if (!dry_run) {
+          LOG_INFO << "Removing App version dir: " << entry.path();
+          boost::filesystem::remove_all(entry.path());
+        }
+        continue;
+      }
+
+      app_versions.emplace(app_version);
+      if (blob_refs_.has(app_version)) {
+        continue;
+      }
+      const auto blobs{getAppBlobs(uri, entry.path(), !dry_run)};
+      if (dry_run) {
+        unrecorded_blobs.insert(blobs.begin(), blobs.end());
+      } else {
+        blob_refs_.set(app_version, blobs);
+      }
+    }
+  }
+
+  BlobRefTable::Blobs garbage;
+  std::function<bool(const std::string&)> is_referenced;
+  if (dry_run) {
+    garbage = blob_refs_.getGarbage();
+    const auto unreferenced{blob_refs_.getUnreferencedBlobs(app_versions)};
+    garbage.insert(unreferenced.begin(), unreferenced.end());
+    is_referenced = [this, &garbage, &unrecorded_blobs](const std::string& hash) {
+      return (blob_refs_.isReferenced(hash) && garbage.count(hash) == 0) || unrecorded_blobs.count(hash) > 0;
+    };
+  } else {
+    blob_refs_.retain(app_versions);
+    if (sweep_required) {
+      blob_refs_.setSweepRequired(true);
+    }
+    // persist the garbage list before removing any blob so an interrupted sweep is resumed by the next prune
+    blob_refs_.flush();
+    garbage = blob_refs_.getGarbage();
+    is_referenced = [this](const std::string& hash) { return blob_refs_.isReferenced(hash); };
+  }
+
+  // Sweep: remove the garbage blobs, the whole blob store is listed only if the table might have missed some blobs
+  const bool full_sweep{sweep_required || blob_refs_.isSweepRequired()};
+  ReclaimableSpace reclaimed;
+  BlobRefTable::Blobs removed_blobs;
+  const bool swept{sweepBlobs(garbage, full_sweep, is_referenced, dry_run, reclaimed, removed_blobs)};
+  if (!dry_run) {
+    blob_refs_.removeGarbage(removed_blobs);
+    if (full_sweep && swept) {
+      blob_refs_.setSweepRequired(false);
+    }
+    blob_refs_.flush();
+    for (const auto& hash : removed_blobs) {
+      blob_index_.remove(hash);
+    }
+    blob_index_.flush();
+  }
+  return reclaimed;
+}
+
+bool RestorableAppEngine::sweepBlobs(const BlobRefTable::Blobs& garbage, bool full_sweep,
+                                     const std::function<bool(const std::string&)>& is_referenced, bool dry_run,
+                                     ReclaimableSpace& reclaimed, BlobRefTable::Blobs& removed_blobs) const {
+  const auto blob_dir{blobs_root_ / "sha256"};
+  // blobs are stat-ed and removed relatively to the blob directory descriptor so their paths are not resolved each time
+  const int dir_fd{::open(blob_dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+  if (dir_fd == -1) {
+    if (errno == ENOENT) {
+      // no blobs in the store
+      removed_blobs = garbage;
+      return true;
+    }
+    LOG_WARNING << "Failed to open the blob directory: " << blob_dir << ", err: " << std::strerror(errno);
+    return false;
+  }
+
+  bool swept{true};
+  std::vector<std::string> sweep_list;
+  std::copy_if(garbage.begin(), garbage.end(), std::back_inserter(sweep_list),
+               [&is_referenced](const std::string& hash) { return !is_referenced(hash); });
+  if (full_sweep) {
+    // `fdopendir` takes ownership of the descriptor, so pass a duplicate of it
+    DIR* dir{::fdopendir(::dup(dir_fd))};
+    if (dir != nullptr) {
+      while (const auto* dir_entry = ::readdir(dir)) {
+        const std::string name{dir_entry->d_name};
+        if (name == "." || name == ".." || dir_entry->d_type == DT_DIR || garbage.count(name) > 0 ||
+            is_referenced(name)) {
+          continue;
+        }
+        sweep_list.emplace_back(name);
+      }
+      ::closedir(dir);
+    } else {
+      LOG_WARNING << "Failed to list the blob directory: " << blob_dir << ", err: " << std::strerror(errno);
+      swept = false;
+    }
+  }
+
+  for (const auto& name : sweep_list) {
+    struct stat st {};
+    if (::fstatat(dir_fd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0) {
+      if (errno == ENOENT) {
+        removed_blobs.emplace(name);
+      }
+      continue;
+    }
+    if (S_ISDIR(st.st_mode)) {
+      continue;
+    }
+    if (!dry_run && ::unlinkat(dir_fd, name.c_str(), 0) != 0) {
+      LOG_WARNING << "Failed to remove blob: " << blob_dir / name << ", err: " << std::strerror(errno);
+      swept = false;
+      continue;
+    }
+    LOG_DEBUG << (dry_run ? "Unused blob: " : "Removed blob: ") << blob_dir / name;
+    removed_blobs.emplace(name);
+    ++reclaimed.blob_numb;
+    reclaimed.bytes += static_cast<uint64_t>(st.st_size);
+  }
+  ::close(dir_fd);
+  return swept;
+}
+
 bool RestorableAppEngine::isAppInstalled(const App& app) const {
   bool res{false};
   const Uri uri{Uri::parseUri(app.uri)};
@@ -868,11 +1153,42 @@ void RestorableAppEngine::stopComposeApp(const std::string& compose_cmd, const b
 }
 
 std::string RestorableAppEngine::getContentHash(const boost::filesystem::path& path) {
-  const auto content{Utils::readFile(path)};
-  return boost::algorithm::to_lower_copy(boost::algorithm::hex(Crypto::sha256digest(content)));
+  // Read and hash a file chunk by chunk so memory usage doesn't depend on a file size
+  std::ifstream file{path.string(), std::ios_base::in | std::ios_base::binary};
+  if (!file.is_open()) {
+    throw std::runtime_error("Failed to open a file: " + path.string());
+  }
+  MultiPartSHA256Hasher hasher;
+  std::vector<char> buf(HashReadChunkSize);
+  while (file.good()) {
+    file.read(buf.data(), static_cast<std::streamsize>(buf.size()));
+    if (file.gcount() > 0) {
+      hasher.update(reinterpret_cast<const unsigned char*>(buf.data()), static_cast<uint64_t>(file.gcount()));
+    }
+  }
+  if (!file.eof()) {
+    throw std::runtime_error("Failed to read a file: " + path.string());
+  }
+  return boost::algorithm::to_lower_copy(hasher.getHexDigest());
 }
 
-uint64_t RestorableAppEngine::getAppUpdateSize(const Json::Value& app_layers, const boost::filesystem::path& blob_dir) {
+std::string RestorableAppEngine::getVerifiedContentHash(const std::string& expected_hash,
+                                                        const boost::filesystem::path& path) const {
+  if (!deep_verify_ && blob_index_.isVerified(expected_hash, path)) {
+    return expected_hash;
+  }
+  const auto hash{getContentHash(path)};
+  if (hash == expected_hash) {
+    blob_index_.setVerified(hash, path);
+  } else {
+    blob_index_.remove(expected_hash);
+  }
+  return hash;
+}
+
+std::tuple<uint64_t, uint64_t> RestorableAppEngine::getAppUpdateSize(
+    const Json::Value& app_layers, const boost::filesystem::path& blob_dir,
+    const std::unordered_set<std::string>& shared_blobs) {
   std::unordered_set<std::string> store_blobs;
 
   if (boost::filesystem::exists(blob_dir)) {
@@ -890,6 +1206,7 @@ uint64_t RestorableAppEngine::getAppUpdateSize(const Json::Value& app_layers, co
   // layers set/list.
 
   uint64_t skopeo_total_update_size{0};
+  uint64_t missing_blobs_size{0};
 
   for (Json::ValueConstIterator ii = app_layers.begin(); ii != app_layers.end(); ++ii) {
     const HashedDigest digest{(*ii)["digest"].asString()};
@@ -906,19 +1223,24 @@ uint64_t RestorableAppEngine::getAppUpdateSize(const Json::Value& app_layers, co
         throw std::range_error("Invalid value of a layer size, must be > 0, got: " + std::to_string(size));
       }
 
-      const uint64_t new_total_update_size = skopeo_total_update_size + size;
-      if (new_total_update_size < skopeo_total_update_size || new_total_update_size < size) {
+      const uint64_t new_missing_blobs_size = missing_blobs_size + size;
+      if (new_missing_blobs_size < missing_blobs_size || new_missing_blobs_size < size) {
         throw std::overflow_error("Sum of layer sizes exceeded the maximum allowed value: " +
                                   std::to_string(std::numeric_limits<uint64_t>::max()));
       }
+      missing_blobs_size = new_missing_blobs_size;
+      if (shared_blobs.count(digest.hash()) > 0) {
+        LOG_INFO << "\t" << digest.hash() << " -> missing; to be shared with the local store; size: " << size;
+        continue;
+      }
 
       LOG_INFO << "\t" << digest.hash() << " -> missing; to be downloaded; size: " << size;
-      skopeo_total_update_size = new_total_update_size;
+      skopeo_total_update_size += size;
     } else {
       LOG_INFO << "\t" << digest.hash() << " -> exists";
     }
   }
-  return skopeo_total_update_size;
+  return {skopeo_total_update_size, missing_blobs_size};
 }
 
 uint64_t RestorableAppEngine::getDockerStoreSizeForAppUpdate(const uint64_t& compressed_update_size,
@@ -933,8 +1255,9 @@ uint64_t RestorableAppEngine::getDockerStoreSizeForAppUpdate(const uint64_t& com
   return docker_total_update_size;
 }
 
-std::tuple<uint64_t, uint64_t> RestorableAppEngine::getPreciseAppUpdateSize(const Json::Value& app_layers,
-                                                                            const boost::filesystem::path& blob_dir) {
+std::tuple<uint64_t, uint64_t> RestorableAppEngine::getPreciseAppUpdateSize(
+    const Json::Value& app_layers, const boost::filesystem::path& blob_dir,
+    const std::unordered_set<std::string>& shared_blobs) {
   std::unordered_set<std::string> store_blobs;
 
   if (boost::filesystem::exists(blob_dir)) {
@@ -970,8 +1293,10 @@ std::tuple<uint64_t, uint64_t> RestorableAppEngine::getPreciseAppUpdateSize(cons
     const std::int64_t usage{(*ii)["usage"].asInt64()};
     const std::int64_t archive_size{(*ii)["archive_size"].asInt64()};
 
-    const uint64_t new_skopeo_total_update_size = skopeo_total_update_size + archive_size;
-    if (new_skopeo_total_update_size < skopeo_total_update_size || new_skopeo_total_update_size < archive_size) {
+    // a shared blob doesn't take additional space in the store, but the layer is still extracted to the docker store
+    const bool is_shared{shared_blobs.count(digest.hash()) > 0};
+    const uint64_t new_skopeo_total_update_size = skopeo_total_update_size + (is_shared ? 0 : archive_size);
+    if (new_skopeo_total_update_size < skopeo_total_update_size) {
       throw std::overflow_error("Sum of layer sizes exceeded the maximum allowed value: " +
                                 std::to_string(std::numeric_limits<uint64_t>::max()));
     }
@@ -982,7 +1307,8 @@ std::tuple<uint64_t, uint64_t> RestorableAppEngine::getPreciseAppUpdateSize(cons
                                 std::to_string(std::numeric_limits<uint64_t>::max()));
     }
 
-    LOG_INFO << "\t" << digest.hash() << " -> missing; to be downloaded; blob size: " << archive_size
+    LOG_INFO << "\t" << digest.hash() << " -> missing; to be " << (is_shared ? "shared" : "downloaded")
+             << "; blob size: " << archive_size
              << ", diff size: " << size << ", disk usage: " << usage;
     skopeo_total_update_size = new_skopeo_total_update_size;
     docker_total_update_size = new_docker_total_update_size;
@@ -4,8 +4,13 @@
 #include "appengine.h"
 
 #include <functional>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
 
 #include "aktualizr-lite/storage/stat.h"
+#include "docker/blobindex.h"
+#include "docker/blobreftable.h"
 #include "docker/docker.h"
 #include "docker/dockerclient.h"
 
@@ -49,6 +54,9 @@ namespace Docker {
  *          ...
  *          <blob-N>
  *
+ *      blob-index.json (hashes of the verified App manifests, archives, image manifests and configs along with
+ *                       their inode metadata, allows skipping re-hashing of the blobs that haven't been changed)
+ *
  *
  * Compose App dir layout
  *
@@ -83,6 +91,15 @@ class RestorableAppEngine : public AppEngine {
   static StorageSpaceFunc GetDefStorageSpaceFunc(int watermark = 80);
   static const int SkopeoMaxParallelPullsHighLimit{10};
   static const int SkopeoMaxParallelPullsLowLimit{1};
+  static const int DockerMaxParallelLoadsDefault{4};
+  static const int DockerMaxParallelLoadsHighLimit{10};
+  static const int DockerMaxParallelLoadsLowLimit{1};
+  static const size_t HashReadChunkSize{64 * 1024};
+
+  struct ReclaimableSpace {
+    size_t blob_numb{0};
+    uint64_t bytes{0};
+  };
 
   RestorableAppEngine(
       boost::filesystem::path store_root, boost::filesystem::path install_root, boost::filesystem::path docker_root,
@@ -92,7 +109,8 @@ class RestorableAppEngine : public AppEngine {
       StorageSpaceFunc storage_space_func = RestorableAppEngine::GetDefStorageSpaceFunc(),
       ClientImageSrcFunc client_image_src_func = [](const Docker::Uri& /* app_uri */,
                                                     const std::string& image_uri) { return "docker://" + image_uri; },
-      bool create_containers_if_install = true, bool offline = false);
+      bool create_containers_if_install = true, bool offline = false, bool deep_verify = false,
+      boost::filesystem::path local_blobs_root = "");
 
   Result fetch(const App& app) override;
   Result verify(const App& app) override;
@@ -105,10 +123,24 @@ class RestorableAppEngine : public AppEngine {
   Apps getInstalledApps() const override;
   Json::Value getRunningAppsInfo() const override;
   void prune(const Apps& app_shortlist) override;
+  // dry run of `prune`, returns the number and the size of blobs it would remove, nothing is removed
+  ReclaimableSpace getReclaimableSpace(const Apps& app_shortlist);
 
   static void removeTmpFiles(const boost::filesystem::path& apps_root);
   static bool areDockerAndSkopeoOnTheSameVolume(const boost::filesystem::path& skopeo_path,
                                                 const boost::filesystem::path& docker_path);
+  static std::string getContentHash(const boost::filesystem::path& path);
+  // shares the file data by means of a reflink or, if not supported, a hardlink, returns false if neither succeeds
+  static bool shareFile(const boost::filesystem::path& src, const boost::filesystem::path& dst);
+  // returns the size of blobs to be added to the store and the size of all missing blobs, the shared blobs don't
+  // take additional space in the store but they still take it in the docker store once extracted
+  static std::tuple<uint64_t, uint64_t> getAppUpdateSize(const Json::Value& app_layers,
+                                                         const boost::filesystem::path& blob_dir,
+                                                         const std::unordered_set<std::string>& shared_blobs = {});
+  // returns the size of blobs to be added to the store and the size of the extracted layers in the docker store
+  static std::tuple<uint64_t, uint64_t> getPreciseAppUpdateSize(
+      const Json::Value& app_layers, const boost::filesystem::path& blob_dir,
+      const std::unordered_set<std::string>& shared_blobs = {});
 
  protected:
   const boost::filesystem::path& storeRoot() const { return store_root_; }
@@ -128,7 +160,10 @@ class RestorableAppEngine : public AppEngine {
   };
   // pull App&Images
   void pullApp(const Uri& uri, const boost::filesystem::path& app_dir);
-  void checkAppUpdateSize(const Uri& uri, const boost::filesystem::path& app_dir) const;
+  // returns the missing blobs that can be shared with the local blob store instead of being copied from it
+  std::unordered_set<std::string> checkAppUpdateSize(const Uri& uri, const boost::filesystem::path& app_dir) const;
+  std::unordered_set<std::string> getShareableBlobs(const std::vector<std::string>& hashes) const;
+  void shareBlobs(const std::unordered_set<std::string>& hashes);
   void pullAppImages(const Uri& app_uri, const boost::filesystem::path& app_compose_file,
                      const boost::filesystem::path& dst_dir);
 
@@ -137,9 +172,18 @@ class RestorableAppEngine : public AppEngine {
   Result installContainerless(const App& app);
   static void installApp(const boost::filesystem::path& app_dir, const boost::filesystem::path& dst_dir);
   void installAppImages(const boost::filesystem::path& app_dir);
+  bool isImageLoaded(const std::string& image_uri, const std::string& tag);
 
   bool areAppImagesFetched(const App& app) const;
 
+  // garbage collection of App blobs
+  BlobRefTable::Blobs getAppBlobs(const Uri& uri, const boost::filesystem::path& app_version_dir,
+                                  bool remove_invalid_images) const;
+  ReclaimableSpace collectGarbage(const Apps& app_shortlist, bool dry_run, bool& prune_docker_store);
+  bool sweepBlobs(const BlobRefTable::Blobs& garbage, bool full_sweep,
+                  const std::function<bool(const std::string&)>& is_referenced, bool dry_run,
+                  ReclaimableSpace& reclaimed, BlobRefTable::Blobs& removed_blobs) const;
+
   // check if App&Images are running
   static bool isRunning(const App& app, const std::string& compose_file,
                         const Docker::DockerClient::Ptr& docker_client);
@@ -169,13 +213,10 @@ class RestorableAppEngine : public AppEngine {
                               const std::string& flags = "up --remove-orphans -d");
 
   static void stopComposeApp(const std::string& compose_cmd, const boost::filesystem::path& app_dir);
-  static std::string getContentHash(const boost::filesystem::path& path);
+  std::string getVerifiedContentHash(const std::string& expected_hash, const boost::filesystem::path& path) const;
 
-  static uint64_t getAppUpdateSize(const Json::Value& app_layers, const boost::filesystem::path& blob_dir);
   static uint64_t getDockerStoreSizeForAppUpdate(const uint64_t& compressed_update_size,
                                                  uint32_t average_compression_ratio);
-  static std::tuple<uint64_t, uint64_t> getPreciseAppUpdateSize(const Json::Value& app_layers,
-                                                                const boost::filesystem::path& blob_dir);
 
   void checkAvailableStorageInStores(const std::string& app_name, const uint64_t& skopeo_required_storage,
                                      const uint64_t& docker_required_storage) const;
@@ -198,7 +239,19 @@ class RestorableAppEngine : public AppEngine {
   ClientImageSrcFunc client_image_src_func_;
   bool create_containers_if_install_;
   bool offline_;
+  // if set, the blob index is ignored and the content hash of each blob is re-calculated on every check
+  bool deep_verify_;
+  // Blobs of a local update source are shared with the store by means of reflinks or hardlinks if both are located
+  // on the same volume, otherwise they are copied by an image transfer utility.
+  const boost::filesystem::path local_blobs_root_;
+  bool local_blobs_same_volume_{false};
   int max_parallel_pulls_{-1};
+  int max_parallel_loads_{DockerMaxParallelLoadsDefault};
+  // images loaded to the docker store by this engine, so an image shared by Apps is loaded just once
+  std::mutex loaded_images_mutex_;
+  std::unordered_set<std::string> loaded_images_;
+  mutable BlobIndex blob_index_{store_root_ / BlobIndex::Filename};
+  BlobRefTable blob_refs_{store_root_ / BlobRefTable::Filename};
 };
 
 }  // namespace Docker
@@ -7,12 +7,17 @@
 #include "logging/logging.h"
 
 #include <fcntl.h>
+#include <poll.h>
 #include <spawn.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <algorithm>
 #include <array>
+#include <csignal>
 #include <cstring>
 #include <iostream>
+#include <limits>
 #include <string>
 #include <vector>
 
@@ -23,11 +28,24 @@ struct ProcessResult {
 };
 
 static long long convertToSeconds(std::string input);
+static int openPidFd(pid_t pid);
+
 class Process {
  private:
+  static const size_t ReadBufferSize{64 * 1024};
+  // How often to check whether the child has exited if a pidfd is not supported by the kernel
+  static const int ExitCheckIntervalMs{200};
+  // A descendant of the child may keep writing to the inherited pipes after the child exits, so what is left in
+  // the pipes is collected for a limited time and up to a limited size
+  static const int MaxDrainTimeMs{500};
+  static const size_t MaxDrainSize{16 * ReadBufferSize};
+
   int stdout_pipe[2];
   int stderr_pipe[2];
+  int pid_fd;
   pid_t pid;
+  bool exited;
+  int status;
 
   // Set file descriptor to non-blocking mode
   bool setNonBlocking(int fd) {
@@ -36,12 +54,55 @@ class Process {
     return fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
   }
 
-  // Read from both pipes simultaneously to avoid deadlock
+  // Read the data available in the pipe and pass it to `consume`, returns false if the pipe has been closed
+  static bool readFromPipe(int fd, std::vector<char>& buffer, const std::function<void(const char*, size_t)>& consume) {
+    while (true) {
+      ssize_t bytes_read = read(fd, buffer.data(), buffer.size());
+      if (bytes_read > 0) {
+        consume(buffer.data(), static_cast<size_t>(bytes_read));
+        return true;
+      }
+      if (bytes_read == 0) {
+        return false;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+  }
+
+  // Read what is left in the pipe until there is no more data, but no more than `budget` bytes and not after `deadline`
+  static void drainPipe(int fd, std::vector<char>& buffer, const std::function<void(const char*, size_t)>& consume,
+                        size_t& budget, const boost::chrono::steady_clock::time_point& deadline) {
+    while (budget > 0 && boost::chrono::steady_clock::now() < deadline) {
+      ssize_t bytes_read = read(fd, buffer.data(), std::min(buffer.size(), budget));
+      if (bytes_read > 0) {
+        consume(buffer.data(), static_cast<size_t>(bytes_read));
+        budget -= static_cast<size_t>(bytes_read);
+        continue;
+      }
+      if (bytes_read == -1 && errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    LOG_DEBUG << "The child process has exited but its output is still being written, the rest of it is dropped";
+  }
+
+  bool checkIfExited() {
+    if (!exited && waitpid(pid, &status, WNOHANG) == pid) {
+      exited = true;
+    }
+    return exited;
+  }
+
+  // Wait for data on both pipes and for the child exit to avoid deadlock and return as soon as the child exits,
+  // even if its descendants still hold the pipes open
   void readFromBothPipes(std::string& stdout_data, std::string& stderr_data, bool print_output,
-                         const std::string& timeout) {
-    std::array<char, 4096> buffer;
-    fd_set read_fds;
-    int max_fd = std::max(stdout_pipe[0], stderr_pipe[0]) + 1;
+                         const std::string& timeout, bool capture_stdout, const ExecOutputLineHandler& line_handler) {
+    std::vector<char> buffer(ReadBufferSize);
+    std::string line_buffer;
     bool stdout_open = true;
     bool stderr_open = true;
 
@@ -49,80 +110,143 @@ class Process {
     setNonBlocking(stdout_pipe[0]);
     setNonBlocking(stderr_pipe[0]);
 
-    auto start_time = boost::chrono::steady_clock::now();
-    auto end_time = start_time;
+    const auto consume_stdout = [&](const char* data, size_t size) {
+      if (print_output) {
+        std::cout.write(data, size);
+        std::cout.flush();
+      }
+      if (line_handler) {
+        line_buffer.append(data, size);
+        size_t line_start{0};
+        size_t line_end;
+        while ((line_end = line_buffer.find('\n', line_start)) != std::string::npos) {
+          line_handler(line_buffer.substr(line_start, line_end - line_start));
+          line_start = line_end + 1;
+        }
+        line_buffer.erase(0, line_start);
+        if (line_buffer.size() > ExecMaxOutputSize) {
+          throw std::runtime_error("Command output line exceeds the limit of " + std::to_string(ExecMaxOutputSize) +
+                                   " bytes");
+        }
+      } else if (capture_stdout) {
+        if (stdout_data.size() + size > ExecMaxOutputSize) {
+          throw std::runtime_error("Command output exceeds the limit of " + std::to_string(ExecMaxOutputSize) +
+                                   " bytes");
+        }
+        stdout_data.append(data, size);
+      }
+    };
+    const auto consume_stderr = [&](const char* data, size_t size) {
+      stderr_data.append(data, size);
+      if (stderr_data.size() > ExecMaxErrOutputSize) {
+        // keep the tail, it usually contains the actual error
+        stderr_data.erase(0, stderr_data.size() - ExecMaxErrOutputSize);
+      }
+    };
+
+    auto end_time = boost::chrono::steady_clock::now();
     if (!timeout.empty()) {
-      end_time = start_time + boost::chrono::seconds(convertToSeconds(timeout));
+      end_time += boost::chrono::seconds(convertToSeconds(timeout));
     }
     while (stdout_open || stderr_open) {
-      FD_ZERO(&read_fds);
-
-      if (stdout_open) FD_SET(stdout_pipe[0], &read_fds);
-      if (stderr_open) FD_SET(stderr_pipe[0], &read_fds);
+      std::array<struct pollfd, 3> fds{};
+      nfds_t fds_numb{0};
+      int stdout_idx{-1};
+      int stderr_idx{-1};
+      int pid_idx{-1};
+      if (stdout_open) {
+        stdout_idx = static_cast<int>(fds_numb);
+        fds[fds_numb++] = {stdout_pipe[0], POLLIN, 0};
+      }
+      if (stderr_open) {
+        stderr_idx = static_cast<int>(fds_numb);
+        fds[fds_numb++] = {stderr_pipe[0], POLLIN, 0};
+      }
+      if (pid_fd != -1) {
+        pid_idx = static_cast<int>(fds_numb);
+        fds[fds_numb++] = {pid_fd, POLLIN, 0};
+      }
 
-      // Wait for data on either pipe (with timeout)
-      struct timeval select_timeout;
-      select_timeout.tv_sec = 1;
-      select_timeout.tv_usec = 0;
+      int poll_timeout{-1};
+      if (!timeout.empty()) {
+        const auto time_left{
+            boost::chrono::duration_cast<boost::chrono::milliseconds>(end_time - boost::chrono::steady_clock::now())
+                .count()};
+        if (time_left <= 0) {
+          throw std::runtime_error("Timeout occurred while waiting for a child process completion");
+        }
+        poll_timeout = static_cast<int>(std::min<long long>(time_left, std::numeric_limits<int>::max()));
+      }
+      if (pid_fd == -1 && (poll_timeout == -1 || poll_timeout > ExitCheckIntervalMs)) {
+        poll_timeout = ExitCheckIntervalMs;
+      }
 
-      int result = select(max_fd, &read_fds, nullptr, nullptr, &select_timeout);
+      int result = poll(fds.data(), fds_numb, poll_timeout);
       if (result == -1) {
-        LOG_ERROR << "Error in select: " << strerror(errno);
-        throw std::runtime_error("exec: Error creating pipes");
-      }
-
-      // Read from stdout if data is available
-      if (stdout_open && FD_ISSET(stdout_pipe[0], &read_fds)) {
-        ssize_t bytes_read = read(stdout_pipe[0], buffer.data(), buffer.size());
-        if (bytes_read > 0) {
-          stdout_data.append(buffer.data(), bytes_read);
-          if (print_output) {
-            std::cout.write(buffer.data(), bytes_read);
-            std::cout.flush();
-          }
-        } else if (bytes_read == 0) {
-          stdout_open = false;
-        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
-          stdout_open = false;
+        if (errno == EINTR) {
+          continue;
         }
+        LOG_ERROR << "Error in poll: " << strerror(errno);
+        throw std::runtime_error("exec: Error waiting for child process output");
       }
 
-      // Read from stderr if data is available
-      if (stderr_open && FD_ISSET(stderr_pipe[0], &read_fds)) {
-        ssize_t bytes_read = read(stderr_pipe[0], buffer.data(), buffer.size());
-        if (bytes_read > 0) {
-          stderr_data.append(buffer.data(), bytes_read);
-        } else if (bytes_read == 0) {
-          stderr_open = false;
-        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
-          stderr_open = false;
-        }
+      if (stdout_idx != -1 && fds[stdout_idx].revents != 0) {
+        stdout_open = readFromPipe(stdout_pipe[0], buffer, consume_stdout);
       }
-      if (!timeout.empty() && boost::chrono::steady_clock::now() > end_time) {
-        throw std::runtime_error("Timeout occurred while waiting for a child process completion");
+      if (stderr_idx != -1 && fds[stderr_idx].revents != 0) {
+        stderr_open = readFromPipe(stderr_pipe[0], buffer, consume_stderr);
+      }
+      if ((pid_idx == -1 || fds[pid_idx].revents != 0) && checkIfExited()) {
+        // The child has exited, collect what is left in the pipes and don't wait for the pipes to be closed
+        size_t drain_budget{MaxDrainSize};
+        const auto drain_deadline{boost::chrono::steady_clock::now() + boost::chrono::milliseconds(MaxDrainTimeMs)};
+        if (stdout_open) {
+          drainPipe(stdout_pipe[0], buffer, consume_stdout, drain_budget, drain_deadline);
+        }
+        if (stderr_open) {
+          drainPipe(stderr_pipe[0], buffer, consume_stderr, drain_budget, drain_deadline);
+        }
+        break;
       }
     }
+    if (line_handler && !line_buffer.empty()) {
+      line_handler(line_buffer);
+    }
+  }
+
+  void terminate() {
+    if (pid != -1 && !exited) {
+      kill(pid, SIGKILL);
+      waitpid(pid, &status, 0);
+      exited = true;
+    }
   }
 
  public:
-  Process() : pid(-1) {
+  Process() : pid_fd(-1), pid(-1), exited(false), status(0) {
     stdout_pipe[0] = stdout_pipe[1] = -1;
     stderr_pipe[0] = stderr_pipe[1] = -1;
   }
 
-  ~Process() { closeAllPipes(); }
+  ~Process() {
+    terminate();
+    closeAllPipes();
+  }
 
   void closeAllPipes() {
     if (stdout_pipe[0] != -1) close(stdout_pipe[0]);
     if (stdout_pipe[1] != -1) close(stdout_pipe[1]);
     if (stderr_pipe[0] != -1) close(stderr_pipe[0]);
     if (stderr_pipe[1] != -1) close(stderr_pipe[1]);
+    if (pid_fd != -1) close(pid_fd);
 
     stdout_pipe[0] = stdout_pipe[1] = -1;
     stderr_pipe[0] = stderr_pipe[1] = -1;
+    pid_fd = -1;
   }
 
-  ProcessResult execute(const std::string& command, bool print_output, const std::string& timeout) {
+  ProcessResult execute(const std::string& command, bool print_output, const std::string& timeout,
+                        bool capture_stdout = true, const ExecOutputLineHandler& line_handler = nullptr) {
     ProcessResult result;
     result.exit_code = -1;
 
@@ -157,6 +281,7 @@ class Process {
 
     if (spawn_result != 0) {
       LOG_ERROR << "Error spawning process: " << strerror(spawn_result);
+      pid = -1;
       closeAllPipes();
       throw std::runtime_error("exec: Error spawning process");
     }
@@ -167,18 +292,26 @@ class Process {
     close(stderr_pipe[1]);
     stderr_pipe[1] = -1;
 
-    // Read from both pipes simultaneously to avoid deadlock
-    readFromBothPipes(result.stdout_output, result.stderr_output, print_output, timeout);
+    // A pidfd becomes readable once the child exits, so the child exit wakes up the loop right away
+    pid_fd = openPidFd(pid);
+
+    // Read from both pipes simultaneously to avoid deadlock, kill the child if something goes wrong
+    try {
+      readFromBothPipes(result.stdout_output, result.stderr_output, print_output, timeout, capture_stdout,
+                        line_handler);
+    } catch (...) {
+      terminate();
+      throw;
+    }
 
-    // Close read ends
-    close(stdout_pipe[0]);
-    stdout_pipe[0] = -1;
-    close(stderr_pipe[0]);
-    stderr_pipe[0] = -1;
+    closeAllPipes();
 
     // Wait for child process to finish
-    int status;
-    waitpid(pid, &status, 0);
+    if (!exited) {
+      while (waitpid(pid, &status, 0) == -1 && errno == EINTR) {
+      }
+      exited = true;
+    }
 
     if (WIFEXITED(status)) {
       result.exit_code = WEXITSTATUS(status);
@@ -188,6 +321,15 @@ class Process {
   }
 };
 
+static int openPidFd(pid_t pid) {
+#ifdef SYS_pidfd_open
+  return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+  (void)pid;
+  return -1;
+#endif
+}
+
 static long long convertToSeconds(std::string input) {
   if (input.empty()) return 0;
 
@@ -206,8 +348,9 @@ static long long convertToSeconds(std::string input) {
   }
 }
 
-void exec(const std::string& cmd, const std::string& err_msg_prefix, const boost::filesystem::path& start_dir,
-          std::string* output, const std::string& timeout, bool print_output) {
+static void runCommand(const std::string& cmd, const std::string& err_msg_prefix,
+                       const boost::filesystem::path& start_dir, std::string* output,
+                       const ExecOutputLineHandler& line_handler, const std::string& timeout, bool print_output) {
   std::string command;
 
   if (print_output) {
@@ -225,7 +368,7 @@ void exec(const std::string& cmd, const std::string& err_msg_prefix, const boost
 
   LOG_DEBUG << "Running: `" << command << "`";
   Process proc;
-  auto result = proc.execute(command.c_str(), print_output, timeout);
+  auto result = proc.execute(command.c_str(), print_output, timeout, output != nullptr, line_handler);
 
   LOG_DEBUG << "Command exited with code " << result.exit_code;
 
@@ -233,14 +376,24 @@ void exec(const std::string& cmd, const std::string& err_msg_prefix, const boost
     throw ExecError(err_msg_prefix, cmd, result.stderr_output, result.exit_code);
   }
   if (output != nullptr) {
-    *output = result.stdout_output;
+    *output = std::move(result.stdout_output);
   }
   if (result.stderr_output.size() > 0) {
     LOG_DEBUG << "Command stderr: " << result.stderr_output;
   }
 }
 
+void exec(const std::string& cmd, const std::string& err_msg_prefix, const boost::filesystem::path& start_dir,
+          std::string* output, const std::string& timeout, bool print_output) {
+  runCommand(cmd, err_msg_prefix, start_dir, output, nullptr, timeout, print_output);
+}
+
 void exec(const boost::format& cmd, const std::string& err_msg, const boost::filesystem::path& start_dir,
           std::string* output, const std::string& timeout, bool print_output) {
   exec(cmd.str(), err_msg, start_dir, output, timeout, print_output);
 }
+
+void execStreaming(const std::string& cmd, const std::string& err_msg_prefix, const ExecOutputLineHandler& line_handler,
+                   const boost::filesystem::path& start_dir, const std::string& timeout, bool print_output) {
+  runCommand(cmd, err_msg_prefix, start_dir, nullptr, line_handler, timeout, print_output);
+}
@@ -1,6 +1,8 @@
 #ifndef AKTUALIZR_LITE_EXEC_H_
 #define AKTUALIZR_LITE_EXEC_H_
 
+#include <functional>
+
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 
@@ -13,10 +15,23 @@ struct ExecError : std::runtime_error {
   const std::string StdErr;
 };
 
+// Maximum size of a command stdout captured into the `output` string, a command producing more output fails
+static const size_t ExecMaxOutputSize{64 * 1024 * 1024};
+// Maximum size of a command stderr kept for an error report, only the tail of a longer stderr output is kept
+static const size_t ExecMaxErrOutputSize{256 * 1024};
+
+// Invoked for each line of a command stdout, the line is passed without the trailing newline character
+using ExecOutputLineHandler = std::function<void(const std::string& line)>;
+
 void exec(const std::string& cmd, const std::string& err_msg_prefix, const boost::filesystem::path& start_dir = "",
           std::string* output = nullptr, const std::string& timeout = "900s", bool print_output = false);
 
 void exec(const boost::format& cmd, const std::string& err_msg, const boost::filesystem::path& start_dir = "",
           std::string* output = nullptr, const std::string& timeout = "900s", bool print_output = false);
 
+// Streams a command stdout line by line to `line_handler` instead of capturing it as a whole
+void execStreaming(const std::string& cmd, const std::string& err_msg_prefix, const ExecOutputLineHandler& line_handler,
+                   const boost::filesystem::path& start_dir = "", const std::string& timeout = "900s",
+                   bool print_output = false);
+
 #endif  // AKTUALIZR_LITE_EXEC_H_
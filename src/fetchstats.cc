@@ -0,0 +1,129 @@
+#include "fetchstats.h"
+
+#include <algorithm>
+#include <cctype>
+#include <vector>
+
+FetchStats::FetchStats() : started_at_{Clock::now()} {}
+
+void FetchStats::addExpectedBlob(const std::string& digest, uint64_t size) { addBlob(digest, size); }
+
+void FetchStats::addFetchedBlob(const std::string& digest, uint64_t size) { addBlob(digest, size).fetched = true; }
+
+FetchStats::Blob& FetchStats::addBlob(const std::string& digest, uint64_t size) {
+  const auto hash_pos{digest.find(':')};
+  const auto hash{hash_pos == std::string::npos ? digest : digest.substr(hash_pos + 1)};
+  auto& blob{blobs_[hash]};
+  blob.size = size;
+  // the blob might have been referred to by the fetch utility before it was registered
+  for (auto it = unmatched_digests_.begin(); it != unmatched_digests_.end();) {
+    if (hash.compare(0, it->first.size(), it->first) != 0) {
+      ++it;
+      continue;
+    }
+    if (blob.first_seen_ms == -1 || it->second.first_seen_ms < blob.first_seen_ms) {
+      blob.first_seen_ms = it->second.first_seen_ms;
+    }
+    blob.last_seen_ms = std::max(blob.last_seen_ms, it->second.last_seen_ms);
+    it = unmatched_digests_.erase(it);
+  }
+  return blob;
+}
+
+void FetchStats::onOutputLine(const std::string& line) {
+  const auto now_ms{elapsedMs()};
+  size_t pos{0};
+  while (pos < line.size()) {
+    if (std::isxdigit(static_cast<unsigned char>(line[pos])) == 0) {
+      ++pos;
+      continue;
+    }
+    const auto token_start{pos};
+    while (pos < line.size() && std::isxdigit(static_cast<unsigned char>(line[pos])) != 0) {
+      ++pos;
+    }
+    if (pos - token_start < MinDigestPrefixLen) {
+      continue;
+    }
+    std::string token{line.substr(token_start, pos - token_start)};
+    std::transform(token.begin(), token.end(), token.begin(), ::tolower);
+    // the first hash not less than the token is the only one that can start with the token
+    auto found_it{blobs_.lower_bound(token)};
+    if (found_it == blobs_.end() || found_it->first.compare(0, token.size(), token) != 0) {
+      found_it = unmatched_digests_.emplace(token, Blob{}).first;
+    }
+    if (found_it->second.first_seen_ms == -1) {
+      found_it->second.first_seen_ms = now_ms;
+    }
+    found_it->second.last_seen_ms = now_ms;
+  }
+}
+
+void FetchStats::finish(const IsBlobFetchedFunc& is_blob_fetched) {
+  duration_ms_ = elapsedMs();
+  for (auto& blob : blobs_) {
+    blob.second.fetched = is_blob_fetched(blob.first);
+  }
+}
+
+Json::Value FetchStats::toJson() const {
+  Json::Value stats;
+  uint64_t bytes_total{0};
+  uint64_t bytes_done{0};
+  Json::UInt blobs_done{0};
+  std::vector<std::pair<int64_t, std::string>> blob_durations;
+  for (const auto& blob : blobs_) {
+    bytes_total += blob.second.size;
+    if (blob.second.fetched) {
+      bytes_done += blob.second.size;
+      ++blobs_done;
+    }
+    if (blob.second.first_seen_ms != -1) {
+      blob_durations.emplace_back(blob.second.last_seen_ms - blob.second.first_seen_ms, blob.first);
+    }
+  }
+  stats["duration_ms"] = Json::Int64(duration_ms_);
+  stats["bytes_total"] = Json::UInt64(bytes_total);
+  stats["bytes_done"] = Json::UInt64(bytes_done);
+  stats["bytes_per_sec"] = Json::UInt64(duration_ms_ > 0 ? bytes_done * 1000 / duration_ms_ : 0);
+  stats["blobs_total"] = Json::UInt(blobs_.size());
+  stats["blobs_done"] = blobs_done;
+
+  std::sort(blob_durations.begin(), blob_durations.end(),
+            [](const std::pair<int64_t, std::string>& lhs, const std::pair<int64_t, std::string>& rhs) {
+              return lhs.first > rhs.first;
+            });
+  stats["slowest_blobs"] = Json::Value(Json::arrayValue);
+  for (size_t ii = 0; ii < blob_durations.size() && ii < MaxListedBlobs; ++ii) {
+    const auto& blob{blobs_.at(blob_durations[ii].second)};
+    Json::Value blob_json;
+    blob_json["digest"] = "sha256:" + blob_durations[ii].second;
+    blob_json["size"] = Json::UInt64(blob.size);
+    blob_json["duration_ms"] = Json::Int64(blob_durations[ii].first);
+    blob_json["fetched"] = blob.fetched;
+    stats["slowest_blobs"].append(blob_json);
+  }
+  return stats;
+}
+
+Json::Value FetchStats::summarize(const Json::Value& apps_stats) {
+  Json::Value summary;
+  uint64_t bytes_total{0};
+  uint64_t bytes_done{0};
+  int64_t duration_ms{0};
+  for (const auto& app_stats : apps_stats) {
+    bytes_total += app_stats["bytes_total"].asUInt64();
+    bytes_done += app_stats["bytes_done"].asUInt64();
+    duration_ms += app_stats["duration_ms"].asInt64();
+  }
+  summary["duration_ms"] = Json::Int64(duration_ms);
+  summary["bytes_total"] = Json::UInt64(bytes_total);
+  summary["bytes_done"] = Json::UInt64(bytes_done);
+  summary["bytes_per_sec"] = Json::UInt64(duration_ms > 0 ? bytes_done * 1000 / duration_ms : 0);
+  summary["apps"] = apps_stats;
+  return summary;
+}
+
+int64_t FetchStats::elapsedMs() const {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - started_at_).count();
+}
@@ -0,0 +1,63 @@
+#ifndef AKTUALIZR_LITE_FETCH_STATS_H_
+#define AKTUALIZR_LITE_FETCH_STATS_H_
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+
+#include "json/json.h"
+
+/**
+ * @brief FetchStats, statistics of an App fetch: fetched bytes, throughput and per-blob timings
+ *
+ * The output of the fetch utility is fed to the stats line by line, a blob is considered being fetched since the
+ * first line referring to its digest (full or a short prefix of it) till the last one. The blobs can be registered
+ * along with their size either upfront or once the fetch completes, e.g. the blobs that landed in the store during
+ * the fetch and the ones still missing after a failed fetch. Once the fetch completes, the stats check which of
+ * the blobs have actually landed in the store.
+ */
+class FetchStats {
+ public:
+  // The file the last download statistics are stored in, relative to the storage directory
+  static constexpr const char* const Filename{"download-stats.json"};
+  // Maximum number of blobs listed in the stats, the blobs that took longest to fetch are listed
+  static const size_t MaxListedBlobs{5};
+  // Minimum length of a digest prefix in the fetch utility output that is matched against the expected blobs
+  static const size_t MinDigestPrefixLen{12};
+
+  using IsBlobFetchedFunc = std::function<bool(const std::string& hash)>;
+
+  FetchStats();
+
+  void addExpectedBlob(const std::string& digest, uint64_t size);
+  void addFetchedBlob(const std::string& digest, uint64_t size);
+  void onOutputLine(const std::string& line);
+  void finish(const IsBlobFetchedFunc& is_blob_fetched);
+  Json::Value toJson() const;
+
+  // Aggregate stats of several App fetches, `apps_stats` maps an App name to its stats
+  static Json::Value summarize(const Json::Value& apps_stats);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+  struct Blob {
+    uint64_t size{0};
+    bool fetched{false};
+    // time since the fetch start the blob was referred to by the fetch utility for the first and the last time
+    int64_t first_seen_ms{-1};
+    int64_t last_seen_ms{-1};
+  };
+
+  int64_t elapsedMs() const;
+  Blob& addBlob(const std::string& digest, uint64_t size);
+
+  const Clock::time_point started_at_;
+  int64_t duration_ms_{0};
+  // blob hash (without the algorithm prefix) -> blob
+  std::map<std::string, Blob> blobs_;
+  // digests or their prefixes referred to by the fetch utility that don't match any registered blob (yet)
+  std::map<std::string, Blob> unmatched_digests_;
+};
+
+#endif  // AKTUALIZR_LITE_FETCH_STATS_H_
@@ -4,15 +4,21 @@
 #include <sys/file.h>
 #include <cstdlib>
 
+#include <boost/algorithm/hex.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/process.hpp>
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/uuid/uuid_io.hpp>
 
 #include "aklitereportqueue.h"
 #include "composeappmanager.h"
+#include "compression.h"
+#include "connectivitymonitor.h"
+#include "crypto/crypto.h"
 #include "crypto/keymanager.h"
 #include "crypto/p11engine.h"
+#include "fetchstats.h"
 #include "helpers.h"
 #include "http/httpclient.h"
 #include "primary/reportqueue.h"
@@ -55,10 +61,12 @@ class OfflineMetaFetcher : public Uptane::IMetadataFetcher {
 };
 
 LiteClient::LiteClient(Config config_in, const AppEngine::Ptr& app_engine, const std::shared_ptr<P11EngineGuard>& p11,
-                       std::shared_ptr<Uptane::IMetadataFetcher> meta_fetcher, bool read_only_storage)
+                       std::shared_ptr<Uptane::IMetadataFetcher> meta_fetcher, bool read_only_storage,
+                       std::shared_ptr<ConnectivityMonitor> connectivity_monitor)
     : config{std::move(config_in)},
       primary_ecu{Uptane::EcuSerial::Unknown(), ""},
-      uptane_fetcher_{std::move(meta_fetcher)} {
+      uptane_fetcher_{std::move(meta_fetcher)},
+      connectivity_monitor_{std::move(connectivity_monitor)} {
   storage = INvStorage::newStorage(config.storage, read_only_storage, StorageClient::kTUF);
   storage->importData(config.import);
 
@@ -79,6 +87,33 @@ LiteClient::LiteClient(Config config_in, const AppEngine::Ptr& app_engine, const
     }
   }
 
+  if (raw.count("apps_state_delta_report") == 1) {
+    apps_state_delta_report_ = boost::lexical_cast<bool>(raw.at("apps_state_delta_report"));
+  }
+  if (raw.count("apps_state_full_report_interval") == 1) {
+    apps_state_full_report_interval_ =
+        std::chrono::seconds(boost::lexical_cast<int64_t>(raw.at("apps_state_full_report_interval")));
+  }
+  if (raw.count("apps_state_compression") == 1) {
+    apps_state_encoding_ = parseContentEncoding(raw.at("apps_state_compression"));
+  }
+
+  EventBatchConfig events_batch_config;
+  ContentEncoding events_encoding{ContentEncoding::Identity};
+  if (raw.count("events_batch_size") == 1) {
+    events_batch_config.batch_size = boost::lexical_cast<int>(raw.at("events_batch_size"));
+  }
+  if (raw.count("events_batch_interval") == 1) {
+    events_batch_config.min_interval =
+        std::chrono::seconds(boost::lexical_cast<int64_t>(raw.at("events_batch_interval")));
+  }
+  if (raw.count("events_max_queued") == 1) {
+    events_batch_config.max_queued_events = boost::lexical_cast<size_t>(raw.at("events_max_queued"));
+  }
+  if (raw.count("events_compression") == 1) {
+    events_encoding = parseContentEncoding(raw.at("events_compression"));
+  }
+
   // figure out the Docker Registry Auth creds endpoint
   const auto& repo_endpoint = config.uptane.repo_server;
   std::string auth_creds_endpoint = Docker::RegistryClient::DefAuthCredsEndpoint;
@@ -122,12 +157,27 @@ LiteClient::LiteClient(Config config_in, const AppEngine::Ptr& app_engine, const
   key_manager_ = std_::make_unique<KeyManager>(storage, config.keymanagerConfig(), p11);
   key_manager_->loadKeys();
   key_manager_->copyCertsToCurl(*http_client);
+  if (apps_state_encoding_ == ContentEncoding::Gzip || events_encoding == ContentEncoding::Gzip) {
+    // The encoding header is set only for the client that sends compressed reports, so their body can be decoded
+    // by Device Gateway, other requests are sent as before.
+    headers.emplace_back("Content-Encoding: " + contentEncodingToString(ContentEncoding::Gzip));
+    gzip_http_client_ = std::make_shared<HttpClientWithShare>(&headers);
+    key_manager_->copyCertsToCurl(*gzip_http_client_);
+  }
+  if (events_encoding == ContentEncoding::Gzip) {
+    events_batch_config.gzip_http_client = gzip_http_client_;
+  }
 
   if (!uptane_fetcher_) {
     uptane_fetcher_ = std::make_shared<Uptane::Fetcher>(config, http_client);
   }
-  report_queue = std_::make_unique<AkLiteReportQueue>(config, http_client, storage, report_queue_run_pause_s_,
-                                                      report_queue_event_limit_);
+  if (!connectivity_monitor_) {
+    // it's started by the daemon, so the CLI commands don't spawn a thread to monitor the network
+    connectivity_monitor_ = std::make_shared<ConnectivityMonitor>();
+  }
+  report_queue =
+      std_::make_unique<AkLiteReportQueue>(config, http_client, storage, report_queue_run_pause_s_,
+                                           report_queue_event_limit_, events_batch_config, connectivity_monitor_);
 
   std::shared_ptr<RootfsTreeManager> basepacman;
   // Deduce a package manager type if not set explicitly by a user
@@ -435,9 +485,12 @@ class DetailedDownloadReport : public EcuDownloadStartedReport {
 class DetailedDownloadCompletedReport : public EcuDownloadCompletedReport {
  public:
   DetailedDownloadCompletedReport(const Uptane::EcuSerial& ecu, const std::string& correlation_id, bool success,
-                                  const std::string& details)
+                                  const std::string& details, const Json::Value& stats = Json::Value())
       : EcuDownloadCompletedReport(ecu, correlation_id, success) {
     custom["details"] = details;
+    if (!stats.isNull()) {
+      custom["stats"] = stats;
+    }
   }
 };
 
@@ -448,7 +501,7 @@ void LiteClient::notifyTufUpdateStarted() {
     auto& d = tuf_update_details_[role.ToString()];
     d.from = version;
   });
-  targets_ = getTargetList(storage);
+  targets_digest_ = getTargetListDigest();
 }
 
 void LiteClient::notifyTufUpdateFinished(const std::string& err, const Uptane::Target& t) {
@@ -460,6 +513,7 @@ void LiteClient::notifyTufUpdateFinished(const std::string& err, const Uptane::T
   auto cor_id = prefix + "-" + boost::uuids::to_string(uuid_gen());
 
   bool was_updated;
+  bool targets_updated{false};
   std::string details;
   bool need_separator{false};
 
@@ -467,16 +521,26 @@ void LiteClient::notifyTufUpdateFinished(const std::string& err, const Uptane::T
     auto& d = tuf_update_details_[role.ToString()];
     d.to = version;
     was_updated = d.from != d.to;
+    if (role == Uptane::Role::Targets() && was_updated) {
+      targets_updated = true;
+      targets_view_.reset();
+    }
   });
 
-  if (was_updated && targets_ && targets_->isInitialized()) {
+  if (was_updated && !targets_digest_.empty()) {
     // If TUF meta was updated and the target list before the update is valid,
-    // then check if the target list was updated too.
-    const auto current_targets{getTargetList(storage)};
-    if (current_targets && current_targets->isInitialized()) {
-      was_updated = !Uptane::MatchTargetVector(current_targets->targets, targets_->targets);
+    // then check if the target list was updated too. The same version of the targets meta has the same target list,
+    // so the stored targets meta are loaded and parsed only if their version has changed.
+    if (!targets_updated) {
+      was_updated = false;
+    } else {
+      const auto& current_digest{getTargetListDigest()};
+      if (!current_digest.empty()) {
+        was_updated = current_digest != targets_digest_;
+      }
     }
   }
+  targets_digest_.clear();
 
   if (!err.empty() || was_updated) {
     // Compose the "details" string with info about metadata if there is an error or metadata was updated
@@ -517,8 +581,32 @@ void LiteClient::notifyDownloadStarted(const Uptane::Target& t, const std::strin
 
 void LiteClient::notifyDownloadFinished(const Uptane::Target& t, bool success, const std::string& err_msg) {
   callback("download-post", t, success ? "OK" : "FAILED");
-  notify(t,
-         std_::make_unique<DetailedDownloadCompletedReport>(primary_ecu.first, t.correlation_id(), success, err_msg));
+  const auto stats{getDownloadStats(t, success)};
+  if (!stats.isNull()) {
+    // store the stats so they can be queried by `aklite status`
+    try {
+      Utils::writeFile(config.storage.path / FetchStats::Filename, Utils::jsonToCanonicalStr(stats));
+    } catch (const std::exception& exc) {
+      LOG_WARNING << "Failed to store the download statistics: " << exc.what();
+    }
+  }
+  notify(t, std_::make_unique<DetailedDownloadCompletedReport>(primary_ecu.first, t.correlation_id(), success, err_msg,
+                                                               stats));
+}
+
+Json::Value LiteClient::getDownloadStats(const Uptane::Target& t, bool success) const {
+  Json::Value stats;
+  if (package_manager_->name() != ComposeAppManager::Name) {
+    return stats;
+  }
+  auto compose_pacman = std::dynamic_pointer_cast<ComposeAppManager>(package_manager_);
+  if (!compose_pacman || compose_pacman->getFetchStats().isNull()) {
+    return stats;
+  }
+  stats = compose_pacman->getFetchStats();
+  stats["target"] = t.filename();
+  stats["success"] = success;
+  return stats;
 }
 
 void LiteClient::notifyInstallStarted(const Uptane::Target& t) {
@@ -640,13 +728,16 @@ std::tuple<bool, std::string> LiteClient::updateImageMeta() {
   return {true, ""};
 }
 
-const std::vector<Uptane::Target>& LiteClient::allTargets() const {
-  std::shared_ptr<const Uptane::Targets> targets{image_repo_.getTargets()};
-  if (targets) {
-    return image_repo_.getTargets()->targets;
-  } else {
-    return no_targets_;
+std::shared_ptr<const std::vector<Uptane::Target>> LiteClient::allTargets() const {
+  const std::shared_ptr<const Uptane::Targets> targets{image_repo_.getTargets()};
+  const int version{targets ? targets->version() : -1};
+  if (!targets_view_ || version != targets_view_version_) {
+    // the view aliases the Target list of the loaded metadata, so the list is not copied
+    targets_view_ = targets ? std::shared_ptr<const std::vector<Uptane::Target>>(targets, &targets->targets)
+                            : std::make_shared<const std::vector<Uptane::Target>>();
+    targets_view_version_ = version;
   }
+  return targets_view_;
 }
 
 bool LiteClient::checkImageMetaOffline() {
@@ -686,7 +777,17 @@ DownloadResult LiteClient::downloadImage(const Uptane::Target& target, const api
       if (download_result || download_result.noSpace() || (token != nullptr && !token->canContinue(false))) {
         break;
       } else if (tries < max_tries - 1) {
-        std::this_thread::sleep_for(wait);
+        // there is no point to retry until the device is back online, retry as soon as it is,
+        // unless an update is downloaded from a local source
+        if (boost::starts_with(config.pacman.ostree_server, "http") &&
+            !connectivity_monitor_->isRouteAvailable(config.pacman.ostree_server) &&
+            !connectivity_monitor_->isReachable(config.pacman.ostree_server)) {
+          LOG_INFO << "No network connectivity, waiting up to " << DownloadConnectivityWait.count()
+                   << " seconds for it before retrying the download";
+          connectivity_monitor_->waitForDefaultRoute(DownloadConnectivityWait);
+        } else {
+          std::this_thread::sleep_for(wait);
+        }
         wait *= 2;
       }
     }
@@ -779,10 +880,46 @@ void LiteClient::reportAppsState() {
     LOG_DEBUG << "Apps state has not changed, skipping sending it to Device Gateway";
     return;
   }
-  auto resp = http_client->post(config.tls.server + "/apps-states", apps_state);
+
+  Json::Value report{apps_state};
+  const auto now{std::chrono::steady_clock::now()};
+  // A full state is sent if a delta is not enabled, there is no reported state Device Gateway could apply it to,
+  // or it's time to send a full snapshot so Device Gateway recovers from a delta it could have missed.
+  const bool full_report{!apps_state_delta_report_ || apps_state_.isNull() ||
+                         apps_state_.get("ostree", "") != apps_state.get("ostree", "") ||
+                         now - apps_state_full_report_time_ >= apps_state_full_report_interval_};
+  if (!full_report) {
+    const auto reported_digests{ComposeAppManager::getAppsStateDigests(apps_state_)};
+    const auto digests{ComposeAppManager::getAppsStateDigests(apps_state)};
+    report["delta"] = true;
+    report["apps"] = Json::objectValue;
+    report["removed_apps"] = Json::arrayValue;
+    for (const auto& app : digests) {
+      const auto reported_app{reported_digests.find(app.first)};
+      if (reported_app == reported_digests.end() || reported_app->second != app.second) {
+        report["apps"][app.first] = apps_state["apps"][app.first];
+      }
+    }
+    for (const auto& reported_app : reported_digests) {
+      if (digests.count(reported_app.first) == 0) {
+        report["removed_apps"].append(reported_app.first);
+      }
+    }
+  }
+
+  const std::string url{config.tls.server + "/apps-states"};
+  const auto resp{apps_state_encoding_ == ContentEncoding::Gzip
+                      ? gzip_http_client_->post(url, "application/json", gzip(Utils::jsonToCanonicalStr(report)))
+                      : http_client->post(url, report)};
   if (resp.isOk()) {
     apps_state_ = apps_state;
+    if (full_report) {
+      apps_state_full_report_time_ = now;
+    }
+    LOG_DEBUG << "Sent " << (full_report ? "full" : "delta") << " Apps state to Device Gateway";
   } else {
+    // Device Gateway may have applied the report or not, so the next report is a full one
+    apps_state_ = Json::Value();
     LOG_WARNING << "Failed to send App states to Device Gateway: " << resp.getStatusStr();
   }
 }
@@ -899,6 +1036,14 @@ void LiteClient::updateRequestHeaders() {
     http_client->updateHeader("x-ats-dockerapps",
                               Target::appsStr(current, ComposeAppManager::Config(config.pacman).apps));
   }
+  if (gzip_http_client_) {
+    gzip_http_client_->updateHeader("x-ats-target", current.filename());
+    gzip_http_client_->updateHeader("x-ats-ostreehash", current.sha256Hash());
+    if (config.pacman.type == ComposeAppManager::Name) {
+      gzip_http_client_->updateHeader("x-ats-dockerapps",
+                                      Target::appsStr(current, ComposeAppManager::Config(config.pacman).apps));
+    }
+  }
 }
 
 void LiteClient::logTarget(const std::string& prefix, const Uptane::Target& target) const {
@@ -966,25 +1111,48 @@ void LiteClient::forEachRoleVersion(std::shared_ptr<const INvStorage> storage,
   }
 }
 
-std::shared_ptr<Uptane::Targets> LiteClient::getTargetList(std::shared_ptr<const INvStorage> storage) {
-  std::shared_ptr<Uptane::Targets> targets;
-  std::string meta;
-  bool loaded;
+const std::string& LiteClient::getTargetListDigest() {
+  // The snapshot metadata refer to the version of the targets metadata, so the stored targets metadata are loaded and
+  // parsed again only if new snapshot metadata are stored, and not on each check-in. Just the small snapshot metadata
+  // are loaded and hashed to find it out.
+  std::string snapshot;
+  std::string snapshot_hash;
+  if (storage->loadNonRoot(&snapshot, Uptane::RepositoryType::Image(), Uptane::Role::Snapshot())) {
+    snapshot_hash = boost::algorithm::hex(Crypto::sha256digest(snapshot));
+  }
+  if (snapshot_hash.empty() || snapshot_hash != stored_targets_snapshot_hash_) {
+    int targets_version{-1};
+    stored_targets_digest_ = loadTargetListDigest(storage, &targets_version);
+    // the snapshot metadata are stored before the targets metadata they refer to are fetched, the digest is cached
+    // only if the stored targets metadata are the referred ones
+    stored_targets_snapshot_hash_.clear();
+    if (!snapshot_hash.empty()) {
+      const auto snapshot_json{Utils::parseJSON(snapshot)};
+      const auto& targets_meta{snapshot_json["signed"]["meta"]["targets.json"]};
+      if (targets_meta.isObject() && targets_meta["version"].isInt() &&
+          targets_meta["version"].asInt() == targets_version) {
+        stored_targets_snapshot_hash_ = snapshot_hash;
+      }
+    }
+  }
+  return stored_targets_digest_;
+}
 
-  loaded = storage->loadNonRoot(&meta, Uptane::RepositoryType::Image(), Uptane::Role::Targets());
-  if (!loaded) {
-    return targets;
+std::string LiteClient::loadTargetListDigest(std::shared_ptr<const INvStorage> storage, int* version) {
+  std::string meta;
+  if (!storage->loadNonRoot(&meta, Uptane::RepositoryType::Image(), Uptane::Role::Targets())) {
+    return "";
   }
 
   const auto meta_json{Utils::parseJSON(meta)};
-  if (meta_json.empty() || !meta_json.isObject()) {
-    return targets;
+  // the raw metadata are not needed anymore, they are released before the Target list is serialized again
+  std::string().swap(meta);
+  if (meta_json.empty() || !meta_json.isObject() || !meta_json["signed"]["targets"].isObject()) {
+    LOG_DEBUG << "Failed to load targets meta: no Target list";
+    return "";
   }
-
-  try {
-    targets = std::make_shared<Uptane::Targets>(meta_json);
-  } catch (const std::exception& exc) {
-    LOG_DEBUG << "Failed to load targets meta: " << exc.what();
+  if (version != nullptr && meta_json["signed"]["version"].isInt()) {
+    *version = meta_json["signed"]["version"].asInt();
   }
-  return targets;
+  return boost::algorithm::hex(Crypto::sha256digest(Utils::jsonToCanonicalStr(meta_json["signed"]["targets"])));
 }
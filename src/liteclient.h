@@ -1,7 +1,10 @@
 #ifndef AKTUALIZR_LITE_CLIENT_H_
 #define AKTUALIZR_LITE_CLIENT_H_
 
+#include <chrono>
+
 #include "composeappmanager.h"
+#include "compression.h"
 #include "downloader.h"
 #include "gtest/gtest_prod.h"
 #include "libaktualizr/config.h"
@@ -11,6 +14,7 @@
 #include "uptane/imagerepository.h"
 
 class AppEngine;
+class ConnectivityMonitor;
 class HttpClient;
 class INvStorage;
 class KeyManager;
@@ -31,7 +35,8 @@ class LiteClient {
 
   explicit LiteClient(Config config_in, const std::shared_ptr<AppEngine>& app_engine = nullptr,
                       const std::shared_ptr<P11EngineGuard>& p11 = nullptr,
-                      std::shared_ptr<Uptane::IMetadataFetcher> meta_fetcher = nullptr, bool read_only_storage = false);
+                      std::shared_ptr<Uptane::IMetadataFetcher> meta_fetcher = nullptr, bool read_only_storage = false,
+                      std::shared_ptr<ConnectivityMonitor> connectivity_monitor = nullptr);
   ~LiteClient();
   LiteClient(const LiteClient&) = delete;
   LiteClient& operator=(const LiteClient&) = delete;
@@ -61,7 +66,9 @@ class LiteClient {
   Uptane::Target getCurrent() const { return package_manager_->getCurrent(); }
   std::tuple<bool, std::string> updateImageMeta();
   bool checkImageMetaOffline();
-  const std::vector<Uptane::Target>& allTargets() const;
+  // Returns an immutable view of the Target list of the loaded targets metadata. The view is made again only if the
+  // version of the metadata changes, and it shares them, so it stays valid if new metadata are loaded meanwhile.
+  std::shared_ptr<const std::vector<Uptane::Target>> allTargets() const;
   TargetStatus VerifyTarget(const Uptane::Target& target) const { return package_manager_->verifyTarget(target); }
   void reportAktualizrConfiguration();
   void reportNetworkInfo();
@@ -93,8 +100,12 @@ class LiteClient {
   Type type() const { return type_; }
   boost::optional<std::vector<std::string>> getAppShortlist() const;
   void disableHwInfoReporting() { hwinfo_reported_ = true; }
+  const std::shared_ptr<ConnectivityMonitor>& connectivityMonitor() const { return connectivity_monitor_; }
 
  private:
+  static constexpr std::chrono::seconds AppsStateFullReportIntervalDefault{24 * 60 * 60};
+  static constexpr std::chrono::seconds DownloadConnectivityWait{60};
+
   struct Diff {
     int from;
     int to;
@@ -105,11 +116,14 @@ class LiteClient {
   FRIEND_TEST(helpers, callback);
   FRIEND_TEST(AkliteTest, RollbackIfAppsInstallFails);
   FRIEND_TEST(AkliteTest, RollbackIfAppsInstallFailsAndPowerCut);
+  FRIEND_TEST(LiteClientTest, TargetListDigestCache);
+  FRIEND_TEST(LiteClientTest, TargetListCache);
 
   virtual void callback(const char* msg, const Uptane::Target& install_target, const std::string& result);
 
   void notify(const Uptane::Target& t, std::unique_ptr<ReportEvent> event) const;
   void notifyInstallStarted(const Uptane::Target& t);
+  Json::Value getDownloadStats(const Uptane::Target& t, bool success) const;
   void writeCurrentTarget(const Uptane::Target& t) const;
 
   data::InstallationResult installPackage(const Uptane::Target& target, InstallMode install_mode = InstallMode::All);
@@ -124,7 +138,10 @@ class LiteClient {
   static void forEachRoleVersion(std::shared_ptr<const INvStorage> storage,
                                  const std::function<void(const Uptane::Role&, int)>& func);
 
-  static std::shared_ptr<Uptane::Targets> getTargetList(std::shared_ptr<const INvStorage> storage);
+  // Returns a digest of the Target list of the stored targets metadata, or an empty string if there is no valid one
+  static std::string loadTargetListDigest(std::shared_ptr<const INvStorage> storage, int* version = nullptr);
+  // Returns the digest of the stored Target list, it's re-loaded only if the stored snapshot metadata change
+  const std::string& getTargetListDigest();
 
   boost::filesystem::path callback_program;
   std::unique_ptr<KeyManager> key_manager_;
@@ -138,17 +155,31 @@ class LiteClient {
   bool is_reboot_required_{false};
 
   std::shared_ptr<OSTree::Sysroot> sysroot_;
-  std::vector<Uptane::Target> no_targets_;
 
+  std::shared_ptr<ConnectivityMonitor> connectivity_monitor_;
   std::shared_ptr<Downloader> downloader_;
   std::shared_ptr<Installer> installer_;
+  // the last Apps state reported to Device Gateway, a next report is a delta against it if delta reports are enabled
   Json::Value apps_state_;
+  bool apps_state_delta_report_{false};
+  std::chrono::seconds apps_state_full_report_interval_{AppsStateFullReportIntervalDefault};
+  std::chrono::steady_clock::time_point apps_state_full_report_time_;
+  ContentEncoding apps_state_encoding_{ContentEncoding::Identity};
+  // sends compressed reports (apps-states, events) if their compression is enabled
+  std::shared_ptr<HttpClient> gzip_http_client_;
   const int report_queue_run_pause_s_{10};
   const int report_queue_event_limit_{6};
   Type type_{Type::Undefined};
 
   TufUpdateDetails tuf_update_details_;
-  std::shared_ptr<Uptane::Targets> targets_;
+  // a digest of the Target list before a TUF metadata update, just the digest is kept since the list may be big
+  std::string targets_digest_;
+  std::string stored_targets_digest_;
+  // a hash of the snapshot metadata referring to the targets metadata `stored_targets_digest_` is of
+  std::string stored_targets_snapshot_hash_;
+  // the Target list view returned by allTargets() and the version of the targets metadata it's of
+  mutable std::shared_ptr<const std::vector<Uptane::Target>> targets_view_;
+  mutable int targets_view_version_{-1};
 };
 
 #endif  // AKTUALIZR_LITE_CLIENT_H_
@@ -0,0 +1,128 @@
+#include "scheduler.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+Scheduler::Scheduler() : wakeup_fd_{::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)} {
+  if (wakeup_fd_ == -1) {
+    throw std::runtime_error(std::string("Failed to create an eventfd for the scheduler: ") + std::strerror(errno));
+  }
+}
+
+Scheduler::~Scheduler() { ::close(wakeup_fd_); }
+
+void Scheduler::addTask(const std::string& name, std::chrono::milliseconds interval, std::chrono::milliseconds jitter,
+                        Task task, bool jitter_first_run) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  TaskEntry entry{name, interval, jitter, std::move(task), Clock::time_point::max()};
+  if (interval.count() > 0) {
+    entry.due = Clock::now() + (jitter_first_run ? getJitter(entry) : std::chrono::milliseconds(0));
+  }
+  tasks_.emplace_back(std::move(entry));
+}
+
+void Scheduler::trigger(const std::string& name) {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    for (auto& entry : tasks_) {
+      if (entry.name == name) {
+        entry.due = Clock::now();
+      }
+    }
+  }
+  const uint64_t wakeup{1};
+  if (::write(wakeup_fd_, &wakeup, sizeof(wakeup)) != sizeof(wakeup) && errno != EAGAIN) {
+    throw std::runtime_error(std::string("Failed to wake up the scheduler: ") + std::strerror(errno));
+  }
+}
+
+void Scheduler::addWatch(int fd, WatchHandler handler) { watches_.emplace_back(fd, std::move(handler)); }
+
+void Scheduler::runDueTasks() {
+  for (size_t ii = 0;; ++ii) {
+    Task task;
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      if (ii >= tasks_.size()) {
+        break;
+      }
+      auto& entry{tasks_[ii]};
+      if (entry.due > Clock::now()) {
+        continue;
+      }
+      // a task triggered while it's running is run once again
+      entry.due = Clock::time_point::max();
+      task = entry.task;
+    }
+    task();
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto& entry{tasks_[ii]};
+    if (entry.due == Clock::time_point::max()) {
+      entry.due = getNextRunTime(entry);
+    }
+  }
+}
+
+void Scheduler::waitForDueTask() {
+  std::vector<pollfd> fds{pollfd{wakeup_fd_, POLLIN, 0}};
+  for (const auto& watch : watches_) {
+    fds.emplace_back(pollfd{watch.first, POLLIN, 0});
+  }
+
+  while (true) {
+    Clock::time_point next_due{Clock::time_point::max()};
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      for (const auto& entry : tasks_) {
+        next_due = std::min(next_due, entry.due);
+      }
+    }
+    const auto now{Clock::now()};
+    if (next_due <= now) {
+      return;
+    }
+    int timeout_ms{-1};
+    if (next_due != Clock::time_point::max()) {
+      // round up so the task is due once the poll times out
+      const auto wait{std::chrono::ceil<std::chrono::milliseconds>(next_due - now)};
+      timeout_ms = static_cast<int>(std::min<int64_t>(wait.count(), std::numeric_limits<int>::max()));
+    }
+
+    const auto res{::poll(fds.data(), fds.size(), timeout_ms)};
+    if (res == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error(std::string("Failed to wait for a scheduled task: ") + std::strerror(errno));
+    }
+    if ((fds[0].revents & POLLIN) != 0) {
+      uint64_t wakeups;
+      if (::read(wakeup_fd_, &wakeups, sizeof(wakeups)) == -1 && errno != EAGAIN) {
+        throw std::runtime_error(std::string("Failed to read the scheduler's eventfd: ") + std::strerror(errno));
+      }
+    }
+    for (size_t ii = 1; ii < fds.size(); ++ii) {
+      if ((fds[ii].revents & (POLLIN | POLLERR | POLLHUP)) != 0) {
+        watches_[ii - 1].second();
+      }
+    }
+  }
+}
+
+Scheduler::Clock::time_point Scheduler::getNextRunTime(const TaskEntry& entry) {
+  if (entry.interval.count() == 0) {
+    return Clock::time_point::max();
+  }
+  return Clock::now() + entry.interval + getJitter(entry);
+}
+
+std::chrono::milliseconds Scheduler::getJitter(const TaskEntry& entry) {
+  std::uniform_int_distribution<int64_t> jitter{0, entry.jitter.count()};
+  return std::chrono::milliseconds(jitter(random_engine_));
+}
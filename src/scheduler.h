@@ -0,0 +1,66 @@
+#ifndef AKTUALIZR_LITE_SCHEDULER_H_
+#define AKTUALIZR_LITE_SCHEDULER_H_
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Scheduler, runs periodic tasks each with its own interval and can be woken up by events
+ *
+ * A task is run each `interval` plus a random jitter, so devices of a fleet that were started at the same time don't
+ * hit the backend at the same time. The next run of a task is scheduled once its current run finishes.
+ * Tasks can be triggered to run immediately from any thread, and file descriptors can be watched in order to trigger
+ * tasks when something happens, e.g. a signal is received or a directory is created.
+ * All tasks and watch handlers are run in the thread that calls runDueTasks() and waitForDueTask().
+ */
+class Scheduler {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using Task = std::function<void()>;
+  using WatchHandler = std::function<void()>;
+
+  Scheduler();
+  ~Scheduler();
+  Scheduler(const Scheduler&) = delete;
+  Scheduler(Scheduler&&) = delete;
+  Scheduler& operator=(const Scheduler&) = delete;
+  Scheduler& operator=(Scheduler&&) = delete;
+
+  // The first run of a task is due immediately, or after a random jitter if `jitter_first_run` is set.
+  // A task with zero interval is run only if it's triggered.
+  void addTask(const std::string& name, std::chrono::milliseconds interval, std::chrono::milliseconds jitter,
+               Task task, bool jitter_first_run = false);
+  void trigger(const std::string& name);
+  // `handler` is invoked each time `fd` becomes readable, it must consume the available data
+  void addWatch(int fd, WatchHandler handler);
+
+  // runs the tasks that are due, in the order they were added
+  void runDueTasks();
+  // blocks until a task is due, handles the watched file descriptors meanwhile
+  void waitForDueTask();
+
+ private:
+  struct TaskEntry {
+    std::string name;
+    std::chrono::milliseconds interval;
+    std::chrono::milliseconds jitter;
+    Task task;
+    Clock::time_point due;
+  };
+
+  Clock::time_point getNextRunTime(const TaskEntry& entry);
+  std::chrono::milliseconds getJitter(const TaskEntry& entry);
+
+  std::mutex mutex_;
+  std::vector<TaskEntry> tasks_;
+  std::vector<std::pair<int, WatchHandler>> watches_;
+  int wakeup_fd_{-1};
+  std::mt19937 random_engine_{std::random_device{}()};
+};
+
+#endif  // AKTUALIZR_LITE_SCHEDULER_H_
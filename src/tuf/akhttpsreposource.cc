@@ -1,10 +1,15 @@
+#include <set>
+
 #include <boost/filesystem.hpp>
 #include <boost/property_tree/ptree.hpp>
 
 #include "http/httpclient.h"
+#include "logging/logging.h"
+#include "uptane/exceptions.h"
 #include "uptane/imagerepository.h"
 
 #include "akhttpsreposource.h"
+#include "compression.h"
 #include "crypto/p11engine.h"
 
 #ifdef BUILD_P11
@@ -15,6 +20,12 @@ static constexpr bool built_with_p11 = false;
 
 namespace aklite::tuf {
 
+static const std::string IfNoneMatchHeader{"If-None-Match"};
+static const std::string IfModifiedSinceHeader{"If-Modified-Since"};
+static const std::string ETagHeader{"etag"};
+static const std::string LastModifiedHeader{"last-modified"};
+static const std::set<std::string> ValidatorHeaders{ETagHeader, LastModifiedHeader};
+
 AkHttpsRepoSource::AkHttpsRepoSource(const std::string& name_in, boost::property_tree::ptree& pt) {
   boost::program_options::variables_map m;
   Config config(m);
@@ -46,7 +57,20 @@ void AkHttpsRepoSource::init(const std::string& name_in, boost::property_tree::p
   for (const auto& key : {"dockerapps", "target", "ostreehash"}) {
     headers.emplace_back("x-ats-" + std::string(key) + ": " + Utils::stripQuotes(pt.get<std::string>(key, "")));
   }
-  auto http_client = std::make_shared<HttpClientWithShare>(&headers);
+  // targets metadata of a factory with many Targets is a few MB of JSON that compresses well, so ask for it
+  // compressed, a server that doesn't support it just sends it as is
+  std::string compression{"gzip"};
+  if (config.pacman.extra.count("tuf_compression") == 1) {
+    compression = config.pacman.extra.at("tuf_compression");
+  }
+  if (parseContentEncoding(compression) == ContentEncoding::Gzip) {
+    headers.emplace_back("Accept-Encoding: gzip");
+  }
+  // Headers can only be modified after the client creation, so the conditional request headers are added with no
+  // value, curl doesn't send such headers. Their values are set just for the timestamp metadata request.
+  headers.emplace_back(IfNoneMatchHeader + ":");
+  headers.emplace_back(IfModifiedSinceHeader + ":");
+  auto http_client = std::make_shared<HttpClientWithShare>(&headers, &ValidatorHeaders);
 
 #ifdef BUILD_P11
   P11EngineGuard p11(config.p11.module, config.p11.pass, config.p11.label);
@@ -67,6 +91,8 @@ void AkHttpsRepoSource::init(const std::string& name_in, boost::property_tree::p
                         config.tls.pkey_source);
 
   meta_fetcher_ = std::make_shared<Uptane::Fetcher>(config, http_client);
+  http_client_ = std::move(http_client);
+  repo_server_ = config.uptane.repo_server;
 }
 
 void AkHttpsRepoSource::fillConfig(Config& config, boost::property_tree::ptree& pt) {
@@ -112,7 +138,21 @@ void AkHttpsRepoSource::fillConfig(Config& config, boost::property_tree::ptree&
 std::string AkHttpsRepoSource::fetchRole(const Uptane::Role& role, int64_t maxsize, Uptane::Version version) {
   std::string reply;
   meta_fetcher_->fetchRole(&reply, maxsize, Uptane::RepositoryType::Image(), role, version);
-  return reply;
+  return decode(reply, role, maxsize);
+}
+
+std::string AkHttpsRepoSource::decode(const std::string& meta, const Uptane::Role& role, int64_t maxsize) {
+  // the gzip magic number is checked instead of the `Content-Encoding` header, libaktualizr's fetcher doesn't return
+  // response headers, a JSON document never starts with it anyway
+  if (!isGzip(meta)) {
+    return meta;
+  }
+  try {
+    return gunzip(meta, static_cast<size_t>(maxsize));
+  } catch (const std::exception& exc) {
+    LOG_ERROR << "Failed to decompress the " << role.ToString() << " metadata: " << exc.what();
+    throw Uptane::MetadataFetchFailure(Uptane::RepositoryType::Image().ToString(), role.ToString());
+  }
 }
 
 std::string AkHttpsRepoSource::FetchRoot(int version) {
@@ -120,6 +160,11 @@ std::string AkHttpsRepoSource::FetchRoot(int version) {
 }
 
 std::string AkHttpsRepoSource::FetchTimestamp() {
+  if (fetched_timestamp_) {
+    std::string timestamp{std::move(*fetched_timestamp_)};
+    fetched_timestamp_ = boost::none;
+    return timestamp;
+  }
   return fetchRole(Uptane::Role::Timestamp(), Uptane::kMaxTimestampSize, Uptane::Version());
 }
 
@@ -131,4 +176,29 @@ std::string AkHttpsRepoSource::FetchTargets() {
   return fetchRole(Uptane::Role::Targets(), Uptane::kMaxImageTargetsSize, Uptane::Version());
 }
 
+bool AkHttpsRepoSource::FetchTimestampIfModified(Validators& validators) {
+  ResetFetchedTimestamp();
+  http_client_->updateHeader(IfNoneMatchHeader, validators.etag);
+  http_client_->updateHeader(IfModifiedSinceHeader, validators.etag.empty() ? validators.last_modified : "");
+  const auto resp{http_client_->get(repo_server_ + "/" + Uptane::Version().RoleFileName(Uptane::Role::Timestamp()),
+                                    Uptane::kMaxTimestampSize)};
+  // the following requests, e.g. of the snapshot and targets metadata, are not conditional
+  http_client_->updateHeader(IfNoneMatchHeader, "");
+  http_client_->updateHeader(IfModifiedSinceHeader, "");
+  if (resp.http_status_code == 304 && !validators.empty()) {
+    return false;
+  }
+  if (!resp.isOk()) {
+    LOG_ERROR << "Failed to fetch the timestamp metadata: " << resp.getStatusStr();
+    throw Uptane::MetadataFetchFailure(Uptane::RepositoryType::Image().ToString(),
+                                       Uptane::Role::Timestamp().ToString());
+  }
+  const auto etag{resp.headers.find(ETagHeader)};
+  const auto last_modified{resp.headers.find(LastModifiedHeader)};
+  validators.etag = etag != resp.headers.end() ? etag->second : "";
+  validators.last_modified = last_modified != resp.headers.end() ? last_modified->second : "";
+  fetched_timestamp_ = decode(resp.body, Uptane::Role::Timestamp(), Uptane::kMaxTimestampSize);
+  return true;
+}
+
 }  // namespace aklite::tuf
@@ -1,6 +1,9 @@
 #ifndef AKTUALIZR_LITE_AK_HTTP_REPO_SOURCE_H_
 #define AKTUALIZR_LITE_AK_HTTP_REPO_SOURCE_H_
 
+#include <boost/optional.hpp>
+
+#include "http/httpclient.h"
 #include "uptane/fetcher.h"
 
 #include "aktualizr-lite/tuf/tuf.h"
@@ -18,13 +21,32 @@ class AkHttpsRepoSource : public RepoSource {
   std::string FetchSnapshot() override;
   std::string FetchTargets() override;
 
+  // Validators of metadata returned by a server along with it, they are sent back in a conditional request
+  struct Validators {
+    std::string etag;
+    std::string last_modified;
+    bool empty() const { return etag.empty() && last_modified.empty(); }
+  };
+  // Fetches the timestamp metadata unless it still matches `validators` (304 Not Modified), returns whether it was
+  // fetched. `validators` are set to the ones of the fetched metadata, which is returned by the next FetchTimestamp().
+  bool FetchTimestampIfModified(Validators& validators);
+  // Drops the timestamp metadata fetched by FetchTimestampIfModified() if it hasn't been returned by FetchTimestamp(),
+  // e.g. if the update has failed before, so the following update doesn't get it.
+  void ResetFetchedTimestamp() { fetched_timestamp_ = boost::none; }
+
  private:
   void init(const std::string& name_in, boost::property_tree::ptree& pt, Config& config);
   static void fillConfig(Config& config, boost::property_tree::ptree& pt);
   std::string fetchRole(const Uptane::Role& role, int64_t maxsize, Uptane::Version version);
+  // decompresses metadata if they were sent compressed, `maxsize` limits the size of decompressed metadata
+  static std::string decode(const std::string& meta, const Uptane::Role& role, int64_t maxsize);
 
   std::string name_;
+  // the client the metadata are fetched with, it sends the conditional request headers only if their values are set
+  std::shared_ptr<HttpClient> http_client_;
   std::shared_ptr<Uptane::IMetadataFetcher> meta_fetcher_;
+  std::string repo_server_;
+  boost::optional<std::string> fetched_timestamp_;
 };
 
 }  // namespace aklite::tuf
@@ -1,5 +1,13 @@
 #include "akrepo.h"
+
+#include <boost/algorithm/hex.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+
+#include "crypto/crypto.h"
+#include "logging/logging.h"
 #include "target.h"
+#include "uptane/exceptions.h"
 
 namespace aklite::tuf {
 
@@ -9,19 +17,21 @@ AkRepo::AkRepo(const boost::filesystem::path& storage_path) { init(storage_path)
 AkRepo::AkRepo(const Config& config, bool read_only_storage) {
   storage_ = INvStorage::newStorage(config.storage, read_only_storage, StorageClient::kTUF);
   storage_->importData(config.import);
+  validators_file_ = config.storage.path / ValidatorsFilename;
+  read_only_storage_ = read_only_storage;
 }
 
-std::vector<TufTarget> AkRepo::GetTargets() {
+std::vector<TufTarget> AkRepo::GetTargets() { return GetTargetIndex().Targets(); }
+
+const TargetIndex& AkRepo::GetTargetIndex() {
+  // `image_repo_` replaces its targets metadata object each time the metadata are loaded or updated,
+  // holding the indexed one prevents a new object from getting the same address
   std::shared_ptr<const Uptane::Targets> targets{image_repo_.getTargets()};
-  if (targets) {
-    auto ret = std::vector<TufTarget>();
-    for (const auto& up_target : image_repo_.getTargets()->targets) {
-      ret.emplace_back(Target::toTufTarget(up_target));
-    }
-    return ret;
-  } else {
-    return std::vector<TufTarget>();
+  if (targets != indexed_targets_) {
+    target_index_ = TargetIndex(targets);
+    indexed_targets_ = std::move(targets);
   }
+  return target_index_;
 }
 
 std::string AkRepo::GetRoot(int version) {
@@ -34,14 +44,115 @@ std::string AkRepo::GetRoot(int version) {
 }
 
 void AkRepo::UpdateMeta(std::shared_ptr<RepoSource> repo_src) {
+  // Only the timestamp metadata is fetched unconditionally, `image_repo_` fetches the snapshot and targets metadata
+  // only if the timestamp and snapshot metadata refer to their new versions, so only its validators are kept.
+  auto* https_src{dynamic_cast<AkHttpsRepoSource*>(repo_src.get())};
+  AkHttpsRepoSource::Validators validators;
+  if (https_src != nullptr) {
+    if (loaded_timestamp_hash_.empty()) {
+      // e.g. the first update after a restart or a CLI run, the validators are usable if the stored metadata are
+      loadStoredMeta();
+    }
+    validators = loadValidators();
+    if (!https_src->FetchTimestampIfModified(validators) && isMetaCurrent(*https_src)) {
+      LOG_INFO << "TUF metadata haven't changed since the last update";
+      return;
+    }
+  }
+
   FetcherWrapper wrapper(repo_src);
-  image_repo_.updateMeta(*storage_, wrapper);
+  try {
+    image_repo_.updateMeta(*storage_, wrapper);
+  } catch (const std::exception&) {
+    loaded_timestamp_hash_.clear();
+    if (https_src != nullptr) {
+      https_src->ResetFetchedTimestamp();
+    }
+    throw;
+  }
+  loaded_timestamp_hash_ = getStoredTimestampHash();
+  if (https_src != nullptr) {
+    storeValidators(validators);
+  }
 }
 
 void AkRepo::init(const boost::filesystem::path& storage_path) {
   StorageConfig sc;
   sc.path = storage_path;
   storage_ = INvStorage::newStorage(sc, false, StorageClient::kTUF);
+  validators_file_ = storage_path / ValidatorsFilename;
+}
+
+void AkRepo::loadStoredMeta() {
+  try {
+    image_repo_.checkMetaOffline(*storage_);
+    loaded_timestamp_hash_ = getStoredTimestampHash();
+  } catch (const std::exception& exc) {
+    LOG_DEBUG << "Failed to load the stored TUF metadata: " << exc.what();
+  }
+}
+
+AkHttpsRepoSource::Validators AkRepo::loadValidators() const {
+  if (loaded_timestamp_hash_.empty() || !boost::filesystem::exists(validators_file_)) {
+    return {};
+  }
+  try {
+    const auto timestamp_json{Utils::parseJSONFile(validators_file_)[Uptane::Role::Timestamp().ToString()]};
+    // the metadata might have been updated by another process since they were loaded to `image_repo_`
+    if (timestamp_json["sha256"].asString() != loaded_timestamp_hash_ ||
+        getStoredTimestampHash() != loaded_timestamp_hash_) {
+      return {};
+    }
+    return {timestamp_json["etag"].asString(), timestamp_json["last_modified"].asString()};
+  } catch (const std::exception& exc) {
+    LOG_WARNING << "Failed to load TUF metadata validators: " << validators_file_ << ", err: " << exc.what();
+    return {};
+  }
+}
+
+void AkRepo::storeValidators(const AkHttpsRepoSource::Validators& validators) {
+  if (read_only_storage_) {
+    return;
+  }
+  Json::Value validators_json;
+  auto& timestamp_json{validators_json[Uptane::Role::Timestamp().ToString()]};
+  timestamp_json["etag"] = validators.etag;
+  timestamp_json["last_modified"] = validators.last_modified;
+  timestamp_json["sha256"] = loaded_timestamp_hash_;
+  try {
+    // write to a tmp file and rename it so a power cut in the middle of writing doesn't leave a broken file
+    const boost::filesystem::path tmp_file{validators_file_.string() + ".tmp"};
+    Utils::writeFile(tmp_file, Utils::jsonToCanonicalStr(validators_json));
+    boost::filesystem::rename(tmp_file, validators_file_);
+  } catch (const std::exception& exc) {
+    LOG_WARNING << "Failed to store TUF metadata validators: " << validators_file_ << ", err: " << exc.what();
+  }
+}
+
+bool AkRepo::isMetaCurrent(AkHttpsRepoSource& repo_src) {
+  try {
+    image_repo_.checkTimestampExpired();
+    image_repo_.checkSnapshotExpired();
+    image_repo_.checkTargetsExpired();
+  } catch (const Uptane::ExpiredMetadata&) {
+    // let the full update either get renewed metadata or report the expiration
+    return false;
+  }
+  // a new root version might be published without changing the timestamp metadata, e.g. a root key rotation
+  try {
+    repo_src.FetchRoot(image_repo_.rootVersion() + 1);
+  } catch (const std::exception&) {
+    return true;
+  }
+  return false;
+}
+
+std::string AkRepo::getStoredTimestampHash() const {
+  std::string timestamp;
+  if (!storage_->loadNonRoot(&timestamp, Uptane::RepositoryType::Image(), Uptane::Role::Timestamp())) {
+    return "";
+  }
+  return boost::algorithm::to_lower_copy(boost::algorithm::hex(Crypto::sha256digest(timestamp)));
 }
 
 // FetcherWrapper
@@ -71,6 +182,9 @@ void AkRepo::FetcherWrapper::fetchLatestRole(std::string* result, int64_t maxsiz
   fetchRole(result, maxsize, repo, role, Uptane::Version());
 }
 
-void AkRepo::CheckMeta() { image_repo_.checkMetaOffline(*storage_); }
+void AkRepo::CheckMeta() {
+  image_repo_.checkMetaOffline(*storage_);
+  loaded_timestamp_hash_ = getStoredTimestampHash();
+}
 
 }  // namespace aklite::tuf
@@ -8,24 +8,53 @@
 
 #include "aktualizr-lite/tuf/tuf.h"
 #include "target.h"
+#include "tuf/akhttpsreposource.h"
+#include "tuf/targetindex.h"
 
 namespace aklite::tuf {
 
 // Repo implementation that uses libaktualizr to provide TUF metadata handling and storage
+//
+// If metadata are fetched from a server, the validators (ETag, Last-Modified) of the timestamp metadata are stored
+// in `<storage-path>/tuf-meta-validators.json` and sent back in the next update. If the server replies that the
+// timestamp metadata haven't changed, the update is skipped, so the stored snapshot and targets metadata are neither
+// fetched nor parsed and verified again. The stored metadata are loaded before the first update, so the validators
+// are also used after a restart.
+//
+// The Targets are indexed by hardware ID and tag once per loaded targets metadata, the index is reused until
+// the targets metadata change.
 class AkRepo : public Repo {
  public:
+  static constexpr const char* const ValidatorsFilename{"tuf-meta-validators.json"};
+
   explicit AkRepo(const boost::filesystem::path& storage_path);
   explicit AkRepo(const Config& config, bool read_only_storage = false);
   std::vector<TufTarget> GetTargets() override;
   std::string GetRoot(int version) override;
   void UpdateMeta(std::shared_ptr<RepoSource> repo_src) override;
   void CheckMeta() override;
+  const TargetIndex& GetTargetIndex();
 
  private:
   void init(const boost::filesystem::path& storage_path);
+  // loads the stored metadata to `image_repo_` if they are valid
+  void loadStoredMeta();
+  // returns the validators of the timestamp metadata loaded to `image_repo_` if they are still stored
+  AkHttpsRepoSource::Validators loadValidators() const;
+  void storeValidators(const AkHttpsRepoSource::Validators& validators);
+  // checks whether the metadata loaded to `image_repo_` are still valid if the timestamp metadata haven't changed
+  bool isMetaCurrent(AkHttpsRepoSource& repo_src);
+  std::string getStoredTimestampHash() const;
 
   Uptane::ImageRepository image_repo_;
   std::shared_ptr<INvStorage> storage_;
+  boost::filesystem::path validators_file_;
+  bool read_only_storage_{false};
+  // a hash of the timestamp metadata loaded to `image_repo_` by the last successful update or check
+  std::string loaded_timestamp_hash_;
+  // the targets metadata `target_index_` was built of
+  std::shared_ptr<const Uptane::Targets> indexed_targets_;
+  TargetIndex target_index_;
 
   // Wrapper around any TufRepoSource implementation to make it usable directly by libaktualizr,
   // by implementing Uptane::IMetadataFetcher interface
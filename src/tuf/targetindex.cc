@@ -0,0 +1,122 @@
+#include "targetindex.h"
+
+#include <algorithm>
+
+#include "logging/logging.h"
+#include "target.h"
+
+namespace aklite::tuf {
+
+TargetIndex::TargetIndex(std::vector<TufTarget> targets) : tuf_targets_{std::move(targets)} {
+  for (size_t pos = 0; pos < tuf_targets_.size(); ++pos) {
+    add(pos, tuf_targets_[pos]);
+  }
+  sort();
+}
+
+TargetIndex::TargetIndex(std::shared_ptr<const Uptane::Targets> targets) : meta_targets_{std::move(targets)} {
+  if (!meta_targets_) {
+    return;
+  }
+  for (size_t pos = 0; pos < meta_targets_->targets.size(); ++pos) {
+    add(pos, Target::toTufTarget(meta_targets_->targets[pos]));
+  }
+  sort();
+}
+
+std::vector<TufTarget> TargetIndex::Find(const std::string& hwid, const std::vector<std::string>& tags,
+                                         const std::vector<std::string>& secondary_hwids) const {
+  std::vector<const TargetList*> lists;
+  const auto add_lists{[&](const std::string& target_hwid) {
+    if (tags.empty()) {
+      const auto it{by_hwid_.find(target_hwid)};
+      if (it != by_hwid_.end()) {
+        lists.push_back(&it->second);
+      }
+      return;
+    }
+    for (const auto& tag : tags) {
+      const auto it{by_hwid_and_tag_.find({target_hwid, tag})};
+      if (it != by_hwid_and_tag_.end()) {
+        lists.push_back(&it->second);
+      }
+    }
+  }};
+  add_lists(hwid);
+  for (const auto& secondary_hwid : secondary_hwids) {
+    if (secondary_hwid != hwid) {
+      add_lists(secondary_hwid);
+    }
+  }
+
+  TargetList found;
+  if (lists.size() == 1) {
+    found = *lists.front();
+  } else if (lists.size() > 1) {
+    // A Target may be listed under a few of the given tags or hardware IDs
+    for (const auto* list : lists) {
+      found.insert(found.end(), list->begin(), list->end());
+    }
+    std::sort(found.begin(), found.end(), [this](size_t a, size_t b) {
+      return std::make_pair(versions_[a], a) < std::make_pair(versions_[b], b);
+    });
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+  }
+
+  std::vector<TufTarget> ret;
+  ret.reserve(found.size());
+  for (const auto pos : found) {
+    ret.emplace_back(get(pos));
+  }
+  return ret;
+}
+
+std::vector<TufTarget> TargetIndex::Targets() const {
+  if (!meta_targets_) {
+    return tuf_targets_;
+  }
+  std::vector<TufTarget> ret;
+  ret.reserve(Size());
+  for (size_t pos = 0; pos < Size(); ++pos) {
+    ret.emplace_back(get(pos));
+  }
+  return ret;
+}
+
+void TargetIndex::add(size_t pos, const TufTarget& target) {
+  versions_.push_back(target.Version());
+  if (target.Custom()["targetFormat"] != "OSTREE") {
+    LOG_WARNING << "Unexpected target format: \"" << target.Custom()["targetFormat"]
+                << "\" target: " << target.Name();
+    return;
+  }
+  const auto hwid{target.HardwareId()};
+  by_hwid_[hwid].push_back(pos);
+  const auto& tags{target.Custom()[TufTarget::TagsField]};
+  if (!tags.isArray()) {
+    return;
+  }
+  for (const auto& tag : tags) {
+    auto& list{by_hwid_and_tag_[{hwid, tag.asString()}]};
+    // a tag listed twice in the same Target
+    if (list.empty() || list.back() != pos) {
+      list.push_back(pos);
+    }
+  }
+}
+
+void TargetIndex::sort() {
+  const auto by_version{[this](size_t a, size_t b) { return versions_[a] < versions_[b]; }};
+  for (auto& entry : by_hwid_) {
+    std::stable_sort(entry.second.begin(), entry.second.end(), by_version);
+  }
+  for (auto& entry : by_hwid_and_tag_) {
+    std::stable_sort(entry.second.begin(), entry.second.end(), by_version);
+  }
+}
+
+TufTarget TargetIndex::get(size_t pos) const {
+  return meta_targets_ ? Target::toTufTarget(meta_targets_->targets[pos]) : tuf_targets_[pos];
+}
+
+}  // namespace aklite::tuf
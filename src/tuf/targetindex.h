@@ -0,0 +1,52 @@
+#ifndef AKTUALIZR_LITE_TARGET_INDEX_H_
+#define AKTUALIZR_LITE_TARGET_INDEX_H_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "aktualizr-lite/tuf/tuf.h"
+#include "uptane/tuf.h"
+
+namespace aklite::tuf {
+
+// Index of OSTREE Targets by hardware ID and tag
+//
+// Each list of the index is ordered by Target version, so Targets matching a device are found without scanning
+// and sorting all Targets of a Factory. The index is supposed to be built once per version of the targets metadata.
+// An index of the targets metadata refers to the metadata Targets instead of holding their TufTarget copies,
+// only the found Targets are converted to TufTarget.
+class TargetIndex {
+ public:
+  TargetIndex() = default;
+  explicit TargetIndex(std::vector<TufTarget> targets);
+  explicit TargetIndex(std::shared_ptr<const Uptane::Targets> targets);
+
+  // Returns a sorted by version list of OSTREE Targets matching one of tags, if any, and hwid or one of secondary_hwids
+  std::vector<TufTarget> Find(const std::string& hwid, const std::vector<std::string>& tags,
+                              const std::vector<std::string>& secondary_hwids = {}) const;
+  // All indexed Targets in the order they were listed in the targets metadata, including the non-OSTREE ones
+  std::vector<TufTarget> Targets() const;
+  size_t Size() const { return versions_.size(); }
+
+ private:
+  using TargetList = std::vector<size_t>;
+
+  void add(size_t pos, const TufTarget& target);
+  void sort();
+  TufTarget get(size_t pos) const;
+
+  // the indexed Targets, only one of them is set
+  std::vector<TufTarget> tuf_targets_;
+  std::shared_ptr<const Uptane::Targets> meta_targets_;
+  std::vector<int> versions_;
+  // positions of Targets, ordered by Target version and position
+  std::map<std::string, TargetList> by_hwid_;
+  std::map<std::pair<std::string, std::string>, TargetList> by_hwid_and_tag_;
+};
+
+}  // namespace aklite::tuf
+
+#endif
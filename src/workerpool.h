@@ -0,0 +1,74 @@
+#ifndef AKTUALIZR_LITE_WORKER_POOL_H_
+#define AKTUALIZR_LITE_WORKER_POOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Invokes `func(ii)` for each `ii` in [0, count) by means of up to `concurrency` worker threads.
+// If `concurrency` is less than 2 or there is a single item to process, then `func` is invoked sequentially
+// in the caller's context. `func` is supposed to store its result at the given index so the result order
+// doesn't depend on the order in which the items are processed.
+// An exception thrown by `func` is re-thrown in the caller's context after all workers have finished;
+// if more than one invocation throws, then the exception of the invocation with the lowest index is re-thrown.
+// If a worker thread can't be started, then the exception is re-thrown after the started workers have finished.
+inline void forEachConcurrently(std::size_t count, int concurrency, const std::function<void(std::size_t)>& func) {
+  if (concurrency < 2 || count < 2) {
+    for (std::size_t ii = 0; ii < count; ++ii) {
+      func(ii);
+    }
+    return;
+  }
+
+  std::vector<std::exception_ptr> errors(count);
+  std::atomic<std::size_t> next_item{0};
+  const auto worker_numb{std::min(count, static_cast<std::size_t>(concurrency))};
+
+  // joins the started workers also if starting one of them throws, destroying a joinable thread terminates the process
+  struct Joiner {
+    std::vector<std::thread>& workers;
+    ~Joiner() {
+      for (auto& worker : workers) {
+        if (worker.joinable()) {
+          worker.join();
+        }
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  Joiner joiner{workers};
+  workers.reserve(worker_numb);
+  for (std::size_t ww = 0; ww < worker_numb; ++ww) {
+    try {
+      workers.emplace_back([&]() {
+        std::size_t ii;
+        while ((ii = next_item++) < count) {
+          try {
+            func(ii);
+          } catch (...) {
+            errors[ii] = std::current_exception();
+          }
+        }
+      });
+    } catch (...) {
+      // the started workers don't take further items, the error is re-thrown once they finish the current ones
+      next_item = count;
+      throw;
+    }
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  for (const auto& err : errors) {
+    if (err) {
+      std::rethrow_exception(err);
+    }
+  }
+}
+
+#endif  // AKTUALIZR_LITE_WORKER_POOL_H_
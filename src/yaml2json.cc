@@ -1,26 +1,77 @@
 #include "yaml2json.h"
 
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include <libfyaml.h>
+
+#include <boost/algorithm/hex.hpp>
 
 #include <logging/logging.h>
+#include "crypto/crypto.h"
 #include "utilities/utils.h"
 
 Yaml2Json::Yaml2Json(const std::string& yaml) {
   if (!std::filesystem::exists(yaml)) {
     throw std::invalid_argument("The specified `yaml` file is not found: " + yaml);
   }
-  std::string cmd = "/usr/bin/fy-tool --mode json " + yaml;
-  std::string data;
-  // Parse the input yaml file
-  if (Utils::shell(cmd, &data, true) != EXIT_SUCCESS) {
-    throw std::invalid_argument("Failed to parse the input `yaml` file; path: " + yaml + ", err: " + data);
+  const auto yaml_content{Utils::readFile(yaml)};
+  const auto content_hash{boost::algorithm::hex(Crypto::sha256digest(yaml_content))};
+
+  static std::mutex parse_cache_mutex;
+  static std::unordered_map<std::string, Json::Value> parse_cache;
+  {
+    std::lock_guard<std::mutex> lock{parse_cache_mutex};
+    const auto found_it{parse_cache.find(content_hash)};
+    if (found_it != parse_cache.end()) {
+      root_ = found_it->second;
+      return;
+    }
+  }
+
+  root_ = parse(yaml_content, yaml);
+
+  std::lock_guard<std::mutex> lock{parse_cache_mutex};
+  if (parse_cache.size() >= ParseCacheMaxSize) {
+    // the number of distinct compose files in use is small, so just start over if the cache is full
+    parse_cache.clear();
+  }
+  parse_cache.emplace(content_hash, root_);
+}
+
+Json::Value Yaml2Json::parse(const std::string& yaml_content, const std::string& source) {
+  // resolve anchors, aliases and merge keys, so the output matches the one of `fy-tool --mode json`
+  fy_parse_cfg parse_cfg{};
+  parse_cfg.flags = static_cast<fy_parse_cfg_flags>(FYPCF_QUIET | FYPCF_RESOLVE_DOCUMENT);
+
+  std::unique_ptr<fy_document, decltype(&fy_document_destroy)> doc{
+      fy_document_build_from_string(&parse_cfg, yaml_content.c_str(), yaml_content.size()), fy_document_destroy};
+  if (!doc) {
+    throw std::invalid_argument("Failed to parse the input `yaml` file; path: " + source + ", err: invalid yaml");
+  }
+  if (fy_document_root(doc.get()) == nullptr) {
+    throw std::invalid_argument("Failed to parse the json representation of the input `yaml` file; path: " + source +
+                                ", err: empty document");
   }
+
+  std::unique_ptr<char, decltype(&free)> json_str{
+      fy_emit_document_to_string(doc.get(), static_cast<fy_emitter_cfg_flags>(FYECF_MODE_JSON | FYECF_WIDTH_INF)),
+      free};
+  if (!json_str) {
+    throw std::invalid_argument("Failed to parse the input `yaml` file; path: " + source +
+                                ", err: failed to emit json");
+  }
+
   // Parse the resultant json representation of the input yaml file
+  Json::Value root;
   try {
-    std::istringstream sin(data);
-    sin >> root_;
+    std::istringstream sin(json_str.get());
+    sin >> root;
   } catch (const std::exception& exc) {
-    throw std::invalid_argument("Failed to parse the json representation of the input `yaml` file; path: " + yaml +
+    throw std::invalid_argument("Failed to parse the json representation of the input `yaml` file; path: " + source +
                                 ", err: " + exc.what());
   }
+  return root;
 }
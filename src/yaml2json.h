@@ -4,9 +4,17 @@
 #include <json/json.h>
 #include <string>
 
+// Parses a yaml file into Json::Value in-process by means of libfyaml.
+// The results are cached by a hash of the file content, so parsing the same (e.g. compose) file again and again
+// costs just reading and hashing it.
 class Yaml2Json {
  public:
+  static const size_t ParseCacheMaxSize{64};
+
   explicit Yaml2Json(const std::string& yaml);
+  // Parse the given yaml content bypassing the cache, `source` is used just for error reporting
+  static Json::Value parse(const std::string& yaml_content, const std::string& source);
+
   Json::Value root_;
 };
 
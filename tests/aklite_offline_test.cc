@@ -1,7 +1,11 @@
 #include <gtest/gtest.h>
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
+#include <atomic>
+#include <chrono>
 #include <fstream>
+#include <future>
+#include <thread>
 
 #include "test_utils.h"
 #include "uptane_generator/image_repo.h"
@@ -11,6 +15,7 @@
 #include "appengine.h"
 #include "composeapp/appengine.h"
 #include "composeappmanager.h"
+#include "daemon.h"
 #include "liteclient.h"
 #include "target.h"
 #include "tuf/akrepo.h"
@@ -908,6 +913,43 @@ TEST_F(AkliteOffline, InvalidTargetInstallApps) {
   ASSERT_TRUE(ic == nullptr);
 }
 
+TEST_F(AkliteOffline, DaemonLocalUpdateDir) {
+  const auto target{addTarget({createApp("app-01")})};
+  boost::filesystem::remove_all(app_store_.appsDir());
+  cfg_.pacman.type = RootfsTreeManager::Name;
+  // the daemon checks in against an unreachable server and applies an update found in the local update directory
+  cfg_.uptane.repo_server = "http://localhost:1";
+  cfg_.pacman.extra["daemon_jitter"] = "0";
+  const auto local_update_dir{test_dir_.Path() / "media" / "update"};
+  cfg_.pacman.extra["local_update_dir"] = local_update_dir.string();
+  // the update is prepared aside and moved to the watched location at once, e.g. as a udev rule would do
+  const auto prepared_dir{test_dir_.Path() / "media" / "prepared"};
+  boost::filesystem::create_directories(prepared_dir);
+  boost::filesystem::create_directory_symlink(tuf_repo_.getRepoPath(), prepared_dir / "tuf");
+  boost::filesystem::create_directory_symlink(ostree_repo_.getPath(), prepared_dir / "ostree_repo");
+  boost::filesystem::create_directory_symlink(app_store_.dir(), prepared_dir / "apps");
+
+  auto lite_cli = createLiteClient();
+  std::atomic<bool> checked_in{false};
+  ON_CALL(*lite_cli, callback(testing::StrEq("check-for-update-post"), testing::_, testing::_))
+      .WillByDefault(testing::InvokeWithoutArgs([&checked_in]() { checked_in = true; }));
+  auto daemon{std::async(std::launch::async, [&lite_cli]() { return run_daemon(*lite_cli, 3600, false, false); })};
+  const auto deadline{std::chrono::steady_clock::now() + std::chrono::seconds(30)};
+  while (!checked_in && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  ASSERT_TRUE(checked_in);
+  // no update is applied until the directory appears
+  ASSERT_EQ(daemon.wait_for(std::chrono::seconds(1)), std::future_status::timeout);
+
+  boost::filesystem::rename(prepared_dir, local_update_dir);
+  ASSERT_EQ(daemon.wait_for(std::chrono::seconds(60)), std::future_status::ready);
+  ASSERT_EQ(daemon.get(), EXIT_SUCCESS);
+  reboot();
+  ASSERT_EQ(aklite::cli::StatusCode::Ok, run());
+  ASSERT_EQ(target, getCurrent());
+}
+
 int main(int argc, char** argv) {
   if (argc != 2) {
     std::cerr << argv[0] << " invalid arguments\n";
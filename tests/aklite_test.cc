@@ -394,6 +394,116 @@ TEST_P(AkliteTest, InvalidAppComposeUpdate) {
 
 INSTANTIATE_TEST_SUITE_P(MultiEngine, AkliteTest, ::testing::Values("ComposeAppEngine", "RestorableAppEngine"));
 
+class AkliteAppsStateTest : public AkliteTest {
+ protected:
+  void tweakConf(Config& conf) override {
+    AkliteTest::tweakConf(conf);
+    conf.pacman.extra["apps_state_delta_report"] = "1";
+    conf.pacman.extra["apps_state_compression"] = "gzip";
+    conf.pacman.extra["apps_state_full_report_interval"] = full_report_interval_;
+  }
+
+  // sets the state of the App containers listed by the fake dockerd, removes them if `state` is empty
+  void setAppContainersState(const std::string& app, const std::string& state, const std::string& status = "") {
+    const auto containers_file{daemon_.dir() / fixtures::DockerDaemon::ContainersFile};
+    const auto cur_containers{Utils::parseJSONFile(containers_file)};
+    Json::Value containers{Json::arrayValue};
+    for (auto container : cur_containers) {
+      if (container["Labels"]["com.docker.compose.project"].asString() == app) {
+        if (state.empty()) {
+          continue;
+        }
+        container["State"] = state;
+        container["Status"] = status;
+      }
+      containers.append(container);
+    }
+    Utils::writeFile(containers_file, containers);
+  }
+
+  std::string full_report_interval_{"3600"};
+};
+
+TEST_P(AkliteAppsStateTest, DeltaReport) {
+  auto app01 = registry.addApp(fixtures::ComposeApp::create("app-01"));
+  auto app02 = registry.addApp(fixtures::ComposeApp::create("app-02"));
+  auto client = createLiteClient();
+  auto target01 = createAppTarget({app01, app02});
+  updateApps(*client, getInitialTarget(), target01);
+  ASSERT_TRUE(app_engine->isRunning(app01));
+  ASSERT_TRUE(app_engine->isRunning(app02));
+
+  // the first report is a full one
+  client->reportAppsState();
+  auto reports{getDeviceGateway().getAppsStates()};
+  ASSERT_EQ(reports.size(), 1);
+  ASSERT_EQ(reports[0]["encoding"].asString(), "gzip");
+  ASSERT_FALSE(reports[0]["body"].isMember("delta"));
+  ASSERT_TRUE(reports[0]["body"]["apps"].isMember("app-01"));
+  ASSERT_TRUE(reports[0]["body"]["apps"].isMember("app-02"));
+
+  // nothing is sent if the state has not changed
+  client->reportAppsState();
+  ASSERT_EQ(getDeviceGateway().getAppsStates().size(), 1);
+
+  // only the changed App is reported
+  setAppContainersState("app-02", "exited", "Exited (1) 5 seconds ago");
+  client->reportAppsState();
+  reports = getDeviceGateway().getAppsStates();
+  ASSERT_EQ(reports.size(), 2);
+  ASSERT_EQ(reports[1]["encoding"].asString(), "gzip");
+  ASSERT_TRUE(reports[1]["body"]["delta"].asBool());
+  ASSERT_EQ(reports[1]["body"]["apps"].getMemberNames(), std::vector<std::string>{"app-02"});
+  ASSERT_EQ(reports[1]["body"]["apps"]["app-02"]["state"].asString(), "unhealthy");
+  ASSERT_EQ(reports[1]["body"]["removed_apps"].size(), 0);
+
+  // the App whose containers are gone is reported as removed
+  setAppContainersState("app-01", "");
+  client->reportAppsState();
+  reports = getDeviceGateway().getAppsStates();
+  ASSERT_EQ(reports.size(), 3);
+  ASSERT_TRUE(reports[2]["body"]["delta"].asBool());
+  ASSERT_EQ(reports[2]["body"]["apps"].size(), 0);
+  ASSERT_EQ(reports[2]["body"]["removed_apps"].size(), 1);
+  ASSERT_EQ(reports[2]["body"]["removed_apps"][0].asString(), "app-01");
+
+  // Device Gateway may have missed the failed report, so the next one is a full one
+  getDeviceGateway().setAppsStatesFailure(true);
+  setAppContainersState("app-02", "running", "Up 1 minute");
+  client->reportAppsState();
+  getDeviceGateway().setAppsStatesFailure(false);
+  ASSERT_EQ(getDeviceGateway().getAppsStates().size(), 3);
+  client->reportAppsState();
+  reports = getDeviceGateway().getAppsStates();
+  ASSERT_EQ(reports.size(), 4);
+  ASSERT_FALSE(reports[3]["body"].isMember("delta"));
+  ASSERT_EQ(reports[3]["body"]["apps"].getMemberNames(), std::vector<std::string>{"app-02"});
+  ASSERT_EQ(reports[3]["body"]["apps"]["app-02"]["state"].asString(), "healthy");
+}
+
+TEST_P(AkliteAppsStateTest, FullReportInterval) {
+  // each report is a full one if the full report interval has passed
+  full_report_interval_ = "0";
+  auto app01 = registry.addApp(fixtures::ComposeApp::create("app-01"));
+  auto app02 = registry.addApp(fixtures::ComposeApp::create("app-02"));
+  auto client = createLiteClient();
+  auto target01 = createAppTarget({app01, app02});
+  updateApps(*client, getInitialTarget(), target01);
+
+  client->reportAppsState();
+  setAppContainersState("app-02", "exited", "Exited (1) 5 seconds ago");
+  client->reportAppsState();
+  const auto reports{getDeviceGateway().getAppsStates()};
+  ASSERT_EQ(reports.size(), 2);
+  for (const auto& report : reports) {
+    ASSERT_FALSE(report["body"].isMember("delta"));
+    ASSERT_EQ(report["body"]["apps"].size(), 2);
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(MultiEngine, AkliteAppsStateTest,
+                         ::testing::Values("ComposeAppEngine", "RestorableAppEngine"));
+
 int main(int argc, char** argv) {
   if (argc != 3) {
     std::cerr << argv[0] << " invalid arguments\n";
@@ -0,0 +1,202 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "logging/logging.h"
+#include "primary/reportqueue.h"
+#include "storage/invstorage.h"
+#include "utilities/utils.h"
+
+#include "aklitereportqueue.h"
+#include "compression.h"
+
+#include "fixtures/basehttpclient.cc"
+
+// Records the events posted to Device Gateway and responds with the configured HTTP status
+class EventsHttpClient : public fixtures::BaseHttpClient {
+ public:
+  HttpResponse post(const std::string& url, const std::string& content_type, const std::string& data) override {
+    content_type_ = content_type;
+    return onPost(url, Utils::parseJSON(gunzip(data)));
+  }
+
+  HttpResponse post(const std::string& url, const Json::Value& data) override { return onPost(url, data); }
+
+  void setStatus(int status) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    status_ = status;
+  }
+
+  // waits until the given number of requests have been posted and returns sizes of the posted batches
+  std::vector<size_t> waitForRequests(size_t numb, std::chrono::seconds timeout = std::chrono::seconds{20}) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    cv_.wait_for(lock, timeout, [this, numb]() { return requests_.size() >= numb; });
+    std::vector<size_t> sizes;
+    for (const auto& request : requests_) {
+      sizes.push_back(request.size());
+    }
+    return sizes;
+  }
+
+  Json::Value request(size_t index) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return requests_.at(index);
+  }
+
+  std::string content_type_;
+
+ private:
+  HttpResponse onPost(const std::string& url, const Json::Value& data) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    EXPECT_EQ(url, "http://localhost:1/events");
+    requests_.push_back(data);
+    cv_.notify_all();
+    return HttpResponse("", status_, CURLE_OK, "");
+  }
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<Json::Value> requests_;
+  int status_{200};
+};
+
+class AkLiteReportQueueTest : public ::testing::Test {
+ protected:
+  AkLiteReportQueueTest() {
+    config_.storage.path = dir_.Path();
+    config_.tls.server = "http://localhost:1";
+    storage_ = INvStorage::newStorage(config_.storage);
+  }
+
+  std::unique_ptr<AkLiteReportQueue> createQueue(EventBatchConfig batch_config) {
+    return std_::make_unique<AkLiteReportQueue>(config_, http_client_, storage_, 1, -1, std::move(batch_config));
+  }
+
+  void enqueue(AkLiteReportQueue& queue, size_t numb) {
+    for (size_t ii = 0; ii < numb; ++ii) {
+      queue.enqueue(std_::make_unique<EcuDownloadStartedReport>(Uptane::EcuSerial("test-ecu"),
+                                                                "correlation-" + std::to_string(event_counter_++)));
+    }
+  }
+
+  // returns the correlation IDs of the events in the storage
+  std::vector<std::string> storedEvents() const {
+    Json::Value events{Json::arrayValue};
+    int64_t id_max{0};
+    storage_->loadReportEvents(&events, &id_max);
+    std::vector<std::string> ids;
+    for (const auto& event : events) {
+      ids.push_back(event["event"]["correlationId"].asString());
+    }
+    return ids;
+  }
+
+  static bool waitFor(const std::function<bool()>& condition,
+                      std::chrono::seconds timeout = std::chrono::seconds{20}) {
+    const auto deadline{std::chrono::steady_clock::now() + timeout};
+    while (!condition()) {
+      if (std::chrono::steady_clock::now() > deadline) {
+        return false;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    return true;
+  }
+
+  TemporaryDirectory dir_;
+  Config config_;
+  std::shared_ptr<INvStorage> storage_;
+  std::shared_ptr<EventsHttpClient> http_client_{std::make_shared<EventsHttpClient>()};
+  size_t event_counter_{0};
+};
+
+TEST_F(AkLiteReportQueueTest, BatchSize) {
+  auto queue{createQueue({3, std::chrono::seconds{2}, 1000, nullptr})};
+  enqueue(*queue, 1);
+  // the first event goes right away
+  ASSERT_EQ(http_client_->waitForRequests(1), std::vector<size_t>({1}));
+
+  // the following burst of events is coalesced and sent no more often than each `min_interval`
+  const auto burst_time{std::chrono::steady_clock::now()};
+  enqueue(*queue, 5);
+  ASSERT_EQ(http_client_->waitForRequests(3), std::vector<size_t>({1, 3, 2}));
+  ASSERT_GE(std::chrono::steady_clock::now() - burst_time, std::chrono::seconds{2});
+  ASSERT_TRUE(waitFor([this]() { return storedEvents().empty(); }));
+  ASSERT_EQ(http_client_->request(1)[0]["event"]["correlationId"].asString(), "correlation-1");
+}
+
+TEST_F(AkLiteReportQueueTest, Backoff) {
+  http_client_->setStatus(503);
+  auto queue{createQueue({3, std::chrono::seconds{0}, 1000, nullptr})};
+  enqueue(*queue, 1);
+  ASSERT_EQ(http_client_->waitForRequests(1).size(), 1);
+
+  // no attempt is made until the backoff, at least the fixed half of `BackoffMin`, expires
+  enqueue(*queue, 1);
+  ASSERT_EQ(http_client_->waitForRequests(2, AkLiteReportQueue::BackoffMin / 2 - std::chrono::seconds{1}).size(), 1);
+  ASSERT_EQ(storedEvents().size(), 2);
+
+  // the failed events are kept and sent in the next attempt
+  http_client_->setStatus(200);
+  ASSERT_EQ(http_client_->waitForRequests(2, AkLiteReportQueue::BackoffMin + std::chrono::seconds{5}),
+            std::vector<size_t>({1, 2}));
+  ASSERT_TRUE(waitFor([this]() { return storedEvents().empty(); }));
+}
+
+TEST_F(AkLiteReportQueueTest, DropOldest) {
+  http_client_->setStatus(503);
+  auto queue{createQueue({10, std::chrono::seconds{0}, 3, nullptr})};
+  enqueue(*queue, 1);
+  ASSERT_EQ(http_client_->waitForRequests(1).size(), 1);
+
+  // the queue is trimmed at the next run even if the sending is held back
+  enqueue(*queue, 4);
+  ASSERT_TRUE(waitFor([this]() { return storedEvents().size() == 3; }));
+  ASSERT_EQ(storedEvents(), std::vector<std::string>({"correlation-2", "correlation-3", "correlation-4"}));
+
+  // the dropped events are not sent
+  http_client_->setStatus(200);
+  ASSERT_EQ(http_client_->waitForRequests(2, AkLiteReportQueue::BackoffMin + std::chrono::seconds{5}),
+            std::vector<size_t>({1, 3}));
+  ASSERT_EQ(http_client_->request(1)[0]["event"]["correlationId"].asString(), "correlation-2");
+  ASSERT_TRUE(waitFor([this]() { return storedEvents().empty(); }));
+}
+
+TEST_F(AkLiteReportQueueTest, DropOldestOverLoadLimit) {
+  http_client_->setStatus(503);
+  auto queue{createQueue({10, std::chrono::seconds{0}, 2, nullptr})};
+  enqueue(*queue, 1);
+  ASSERT_EQ(http_client_->waitForRequests(1).size(), 1);
+
+  // more than twice the maximum number of events are trimmed in a few steps
+  enqueue(*queue, 9);
+  ASSERT_TRUE(waitFor([this]() { return storedEvents().size() == 2; }));
+  ASSERT_EQ(storedEvents(), std::vector<std::string>({"correlation-8", "correlation-9"}));
+}
+
+TEST_F(AkLiteReportQueueTest, Gzip) {
+  const auto gzip_http_client{std::make_shared<EventsHttpClient>()};
+  auto queue{createQueue({3, std::chrono::seconds{0}, 1000, gzip_http_client})};
+  enqueue(*queue, 2);
+  ASSERT_TRUE(waitFor([this]() { return storedEvents().empty(); }));
+
+  const auto sizes{gzip_http_client->waitForRequests(1)};
+  size_t event_numb{0};
+  for (const auto size : sizes) {
+    event_numb += size;
+  }
+  ASSERT_EQ(event_numb, 2);
+  ASSERT_EQ(gzip_http_client->content_type_, "application/json");
+  ASSERT_EQ(gzip_http_client->request(0)[0]["event"]["correlationId"].asString(), "correlation-0");
+  ASSERT_TRUE(http_client_->waitForRequests(1, std::chrono::seconds{0}).empty());
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  logger_init();
+  return RUN_ALL_TESTS();
+}
@@ -149,6 +149,96 @@ TEST_F(ApiClientTest, CheckIn) {
   ASSERT_EQ(new_target.sha256Hash(), result.Targets()[1].Sha256Hash());
 }
 
+TEST_F(ApiClientTest, CheckInTufMetaNotModified) {
+  auto lite_client = createLiteClient(InitialVersion::kOn);
+  AkliteClient client(lite_client);
+  ASSERT_EQ(CheckInResult::Status::Ok, client.CheckIn().status);
+  ASSERT_TRUE(boost::filesystem::exists(lite_client->config.storage.path / "tuf-meta-validators.json"));
+
+  // the timestamp metadata is not modified, so nothing else is fetched
+  getDeviceGateway().resetTufStats();
+  auto result{client.CheckIn()};
+  ASSERT_EQ(CheckInResult::Status::Ok, result.status);
+  ASSERT_EQ(1, result.Targets().size());
+  ASSERT_EQ(getDeviceGateway().getTufStats()["requests"].asUInt(), 1U);
+  ASSERT_EQ(getDeviceGateway().getTufStats()["bytes"].asUInt64(), 0U);
+
+  // a new Target modifies the timestamp metadata
+  auto new_target = createTarget();
+  getDeviceGateway().resetTufStats();
+  result = client.CheckIn();
+  ASSERT_EQ(CheckInResult::Status::Ok, result.status);
+  ASSERT_EQ(2, result.Targets().size());
+  ASSERT_EQ(new_target.filename(), result.Targets()[1].Name());
+  ASSERT_GT(getDeviceGateway().getTufStats()["requests"].asUInt(), 1U);
+  ASSERT_GT(getDeviceGateway().getTufStats()["bytes"].asUInt64(), 0U);
+}
+
+TEST_F(ApiClientTest, CheckInTufMetaNotModifiedAfterRestart) {
+  auto lite_client = createLiteClient(InitialVersion::kOn);
+  ASSERT_EQ(CheckInResult::Status::Ok, AkliteClient(lite_client).CheckIn().status);
+
+  // the stored validators are used by a new client instance, e.g. after a restart or by a CLI run
+  lite_client = createLiteClient(InitialVersion::kOff);
+  AkliteClient client(lite_client);
+  getDeviceGateway().resetTufStats();
+  auto result{client.CheckIn()};
+  ASSERT_EQ(CheckInResult::Status::Ok, result.status);
+  ASSERT_EQ(1, result.Targets().size());
+  ASSERT_EQ(getDeviceGateway().getTufStats()["requests"].asUInt(), 1U);
+  ASSERT_EQ(getDeviceGateway().getTufStats()["bytes"].asUInt64(), 0U);
+  auto req_headers{getDeviceGateway().getReqHeaders()};
+  ASSERT_FALSE(req_headers["If-None-Match"].asString().empty());
+  ASSERT_EQ(req_headers["x-ats-target"], lite_client->getCurrent().filename());
+
+  // only the timestamp metadata request is conditional
+  createTarget();
+  getDeviceGateway().resetTufStats();
+  result = client.CheckIn();
+  ASSERT_EQ(CheckInResult::Status::Ok, result.status);
+  ASSERT_EQ(2, result.Targets().size());
+  ASSERT_GT(getDeviceGateway().getTufStats()["requests"].asUInt(), 1U);
+  req_headers = getDeviceGateway().getReqHeaders();
+  ASSERT_FALSE(req_headers.isMember("If-None-Match"));
+  ASSERT_FALSE(req_headers.isMember("If-Modified-Since"));
+}
+
+/*
+ * Benchmarks TUF metadata transfer of a check-in against a factory with many Targets: the bytes sent by Device Gateway
+ * and the check-in time are logged for the uncompressed and compressed metadata.
+ */
+TEST_F(ApiClientTest, CheckInTufMetaTransfer) {
+  const int target_numb{500};
+  auto lite_client = createLiteClient(InitialVersion::kOn);
+  AkliteClient client(lite_client);
+  const auto add_targets = [this](int first, int numb) {
+    for (int ii = first; ii < first + numb; ++ii) {
+      getTufRepo().addTarget("target-" + std::to_string(ii), getInitialTarget().sha256Hash(), hw_id,
+                             std::to_string(ii + 2));
+    }
+  };
+  const auto check_in = [&](const std::string& compression, const std::string& desc) {
+    lite_client->config.pacman.extra["tuf_compression"] = compression;
+    getDeviceGateway().resetTufStats();
+    const auto start{std::chrono::steady_clock::now()};
+    const auto result{client.CheckIn()};
+    const auto duration{
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start)};
+    EXPECT_EQ(CheckInResult::Status::Ok, result.status);
+    const auto stats{getDeviceGateway().getTufStats()};
+    LOG_INFO << "Check-in, " << desc << " metadata: " << stats["bytes"].asUInt64() << " bytes in "
+             << stats["requests"].asUInt() << " requests, " << duration.count() << " ms";
+    return stats["bytes"].asUInt64();
+  };
+
+  add_targets(0, target_numb);
+  const auto uncompressed_bytes{check_in("none", "uncompressed")};
+  add_targets(target_numb, 1);
+  const auto compressed_bytes{check_in("gzip", "compressed")};
+  ASSERT_LT(compressed_bytes, uncompressed_bytes / 4);
+  ASSERT_EQ(target_numb + 2, client.CheckIn().Targets().size());
+}
+
 TEST_F(ApiClientTest, CheckInLocal) {
   setPacmanType(RootfsTreeManager::Name);
   AkliteClient client(createLiteClient(InitialVersion::kOn));
@@ -178,6 +178,18 @@ TEST(ComposeApp, Config) {
   config.pacman.extra["storage_watermark"] = "50";
   cfg = ComposeAppManager::Config(config.pacman);
   ASSERT_EQ(cfg.storage_watermark, 50);
+
+  ASSERT_EQ(cfg.apps_check_concurrency, 1);
+  config.pacman.extra["apps_check_concurrency"] = "4";
+  cfg = ComposeAppManager::Config(config.pacman);
+  ASSERT_EQ(cfg.apps_check_concurrency, 4);
+
+  config.pacman.extra["apps_check_concurrency"] = "0";
+  EXPECT_THROW(ComposeAppManager::Config(config.pacman), std::invalid_argument);
+
+  config.pacman.extra["apps_check_concurrency"] =
+      std::to_string(ComposeAppManager::AppsCheckConcurrencyHighLimit + 1);
+  EXPECT_THROW(ComposeAppManager::Config(config.pacman), std::invalid_argument);
 }
 
 class TestSysroot: public OSTree::Sysroot {
@@ -1030,6 +1042,45 @@ TEST(ComposeApp, AppsStateComparison) {
     new_state["apps"]["app-01"]["services"][1] = "";
     ASSERT_FALSE(ComposeAppManager::compareAppsStates(cur_state, new_state));
    }
+   {
+    Json::Value service_01;
+    service_01["name"] = "service-01";
+    service_01["state"] = "running";
+    service_01["status"] = "Up 5 seconds";
+    service_01["health"] = "healthy";
+    Json::Value service_02{service_01};
+    service_02["name"] = "service-02";
+
+    Json::Value cur_state;
+    cur_state["ostree"] = "ostree-hash";
+    cur_state["apps"]["app-01"]["state"] = "healthy";
+    cur_state["apps"]["app-01"]["services"].append(service_01);
+    cur_state["apps"]["app-01"]["services"].append(service_02);
+    cur_state["apps"]["app-02"]["state"] = "healthy";
+
+    // the container uptime, its logs and the order of services don't matter
+    Json::Value new_state{cur_state};
+    new_state["deviceTime"] = "2024-01-01T00:00:00Z";
+    new_state["apps"]["app-01"]["services"][0] = service_02;
+    new_state["apps"]["app-01"]["services"][1] = service_01;
+    new_state["apps"]["app-01"]["services"][1]["status"] = "Up 5 minutes";
+    new_state["apps"]["app-01"]["services"][1]["logs"] = "foo";
+    ASSERT_TRUE(ComposeAppManager::compareAppsStates(cur_state, new_state));
+    ASSERT_EQ(ComposeAppManager::getAppsStateDigests(cur_state), ComposeAppManager::getAppsStateDigests(new_state));
+
+    // a change of a service health is detected even if the App state and the number of services are the same
+    new_state["apps"]["app-01"]["services"][1]["health"] = "starting";
+    ASSERT_FALSE(ComposeAppManager::compareAppsStates(cur_state, new_state));
+    const auto cur_digests{ComposeAppManager::getAppsStateDigests(cur_state)};
+    const auto new_digests{ComposeAppManager::getAppsStateDigests(new_state)};
+    ASSERT_NE(cur_digests.at("app-01"), new_digests.at("app-01"));
+    ASSERT_EQ(cur_digests.at("app-02"), new_digests.at("app-02"));
+
+    // as well as an ostree deployment change
+    new_state = cur_state;
+    new_state["ostree"] = "new-ostree-hash";
+    ASSERT_FALSE(ComposeAppManager::compareAppsStates(cur_state, new_state));
+   }
 }
 
 #ifndef __NO_MAIN__
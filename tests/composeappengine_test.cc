@@ -115,6 +115,71 @@ TEST_F(ComposeAppEngineTest, FetchRunCompare) {
   ASSERT_EQ(apps_info["app-02"]["services"][0]["image"].asString(), app->image().uri());
 }
 
+TEST_F(ComposeAppEngineTest, FetchAuthCache) {
+  const auto app_01{registry.addApp(fixtures::ComposeApp::create("app-01"))};
+  const auto app_02{registry.addApp(fixtures::ComposeApp::create("app-02"))};
+
+  // the credentials are obtained once, a token is obtained once per repository and is reused by all its requests
+  ASSERT_TRUE(app_engine->fetch(app_01));
+  ASSERT_EQ(registry.credsRequestNumb(), 1);
+  ASSERT_EQ(registry.tokenRequestNumb(), 1);
+  ASSERT_TRUE(app_engine->fetch(app_02));
+  ASSERT_EQ(registry.credsRequestNumb(), 1);
+  ASSERT_EQ(registry.tokenRequestNumb(), 2);
+  ASSERT_TRUE(app_engine->fetch(app_01));
+  ASSERT_EQ(registry.credsRequestNumb(), 1);
+  ASSERT_EQ(registry.tokenRequestNumb(), 2);
+}
+
+TEST_F(ComposeAppEngineTest, DownloadBlobResume) {
+  const auto compose_app{fixtures::ComposeApp::create("app-01")};
+  const auto app{registry.addApp(compose_app)};
+  const auto archive_uri{
+      Docker::Uri::parseUri(app.uri).createUri(Docker::HashedDigest("sha256:" + compose_app->archHash()))};
+  const auto archive_size{compose_app->archive().size()};
+  const auto blob_file{test_dir_.Path() / "archive.tgz"};
+  const boost::filesystem::path partial_file{blob_file.string() + Docker::RegistryClient::PartialFileSuffix};
+
+  // the connection drops in the middle of the blob transfer, the received part is kept
+  registry.setBlobTransferLimit(archive_size / 2);
+  ASSERT_THROW(registry_client_->downloadBlob(archive_uri, blob_file, archive_size), std::runtime_error);
+  ASSERT_FALSE(boost::filesystem::exists(blob_file));
+  ASSERT_EQ(boost::filesystem::file_size(partial_file), archive_size / 2);
+
+  // the next attempt requests just the missing part of the blob
+  registry.setBlobTransferLimit(0);
+  registry_client_->downloadBlob(archive_uri, blob_file, archive_size);
+  ASSERT_EQ(Utils::readFile(blob_file), compose_app->archive());
+  ASSERT_FALSE(boost::filesystem::exists(partial_file));
+  ASSERT_EQ(registry.blobRequestRanges().back(), std::make_pair(archive_size / 2, archive_size - 1));
+}
+
+TEST_F(ComposeAppEngineTest, DownloadBlobInChunks) {
+  const auto compose_app{fixtures::ComposeApp::create("app-01")};
+  const auto app{registry.addApp(compose_app)};
+  const auto archive_uri{
+      Docker::Uri::parseUri(app.uri).createUri(Docker::HashedDigest("sha256:" + compose_app->archHash()))};
+  const auto archive_size{compose_app->archive().size()};
+  const auto blob_file{test_dir_.Path() / "archive.tgz"};
+  const int connections{4};
+
+  Docker::RegistryClient registry_client{registry.getClient(), registry.authURL(), registry.getClientFactory(), 1,
+                                         connections};
+  registry_client.downloadBlob(archive_uri, blob_file, archive_size);
+  ASSERT_EQ(Utils::readFile(blob_file), compose_app->archive());
+
+  // the chunks requested over concurrent connections cover the whole blob
+  auto ranges{registry.blobRequestRanges()};
+  ASSERT_EQ(ranges.size(), std::min<size_t>(connections, archive_size));
+  std::sort(ranges.begin(), ranges.end());
+  size_t next_byte{0};
+  for (const auto& range : ranges) {
+    ASSERT_EQ(range.first, next_byte);
+    next_byte = range.second + 1;
+  }
+  ASSERT_EQ(next_byte, archive_size);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   logger_init();
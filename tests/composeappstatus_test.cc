@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+
+#include "logging/logging.h"
+#include "test_utils.h"
+#include "utilities/utils.h"
+
+#include "composeapp/appengine.h"
+
+// A fake `composectl` that logs its invocations and outputs the content of `check.json` and `ps.json`
+static const std::string FakeComposectl{R"(#!/bin/bash
+dir=$(dirname "$0")
+echo "$@" >> "${dir}/calls.log"
+for arg in "$@"; do
+  case "${arg}" in
+    check) cat "${dir}/check.json"; exit 0;;
+    ps) cat "${dir}/ps.json"; exit 0;;
+  esac
+done
+exit 1
+)"};
+
+class ComposeAppStatusTest : public ::testing::Test {
+ protected:
+  ComposeAppStatusTest() {
+    const auto composectl{dir_.Path() / "composectl"};
+    Utils::writeFile(composectl, FakeComposectl);
+    boost::filesystem::permissions(composectl, boost::filesystem::owner_all);
+    setFetchStatus(true);
+    Json::Value ps;
+    for (const auto& app : apps_) {
+      ps[app.uri]["in_store"] = true;
+      ps[app.uri]["services"][0]["state"] = "running";
+    }
+    Utils::writeFile(dir_.Path() / "ps.json", Utils::jsonToStr(ps));
+    engine_ = std::make_shared<composeapp::AppEngine>(dir_.Path() / "store", dir_.Path() / "compose",
+                                                      dir_.Path() / "docker", nullptr, nullptr,
+                                                      "unix:///var/run/docker.sock", "/usr/bin/docker-compose",
+                                                      composectl.string());
+  }
+
+  void setFetchStatus(bool fetched) {
+    Json::Value check;
+    check["fetch_check"]["missing_blobs"] = Json::arrayValue;
+    if (!fetched) {
+      check["fetch_check"]["missing_blobs"][0]["descriptor"]["digest"] = "sha256:" + std::string(64, 'a');
+      check["fetch_check"]["missing_blobs"][0]["descriptor"]["size"] = 1024;
+    }
+    Utils::writeFile(dir_.Path() / "check.json", Utils::jsonToStr(check));
+  }
+
+  std::vector<std::string> calls() const {
+    const auto log{dir_.Path() / "calls.log"};
+    if (!boost::filesystem::exists(log)) {
+      return {};
+    }
+    std::vector<std::string> lines;
+    const auto content{Utils::readFile(log)};
+    boost::split(lines, content, boost::is_any_of("\n"), boost::token_compress_on);
+    lines.erase(std::remove(lines.begin(), lines.end(), ""), lines.end());
+    return lines;
+  }
+
+  TemporaryDirectory dir_;
+  const AppEngine::Apps apps_{{"app-01", "hub.foundries.io/factory/app-01@sha256:" + std::string(64, '1')},
+                              {"app-02", "hub.foundries.io/factory/app-02@sha256:" + std::string(64, '2')}};
+  std::shared_ptr<composeapp::AppEngine> engine_;
+};
+
+TEST_F(ComposeAppStatusTest, CheckOnce) {
+  engine_->cacheAppsStatus(apps_);
+  // one `check` and one `ps` for all apps
+  const auto batched_calls{calls()};
+  ASSERT_EQ(batched_calls.size(), 2);
+  for (const auto& app : apps_) {
+    ASSERT_NE(batched_calls[0].find(app.uri), std::string::npos);
+    ASSERT_NE(batched_calls[1].find(app.uri), std::string::npos);
+  }
+
+  // the status is served from the cache for the whole check, even if an app status is queried a few times
+  for (int ii = 0; ii < 2; ++ii) {
+    for (const auto& app : apps_) {
+      ASSERT_TRUE(engine_->isRunning(app));
+      ASSERT_TRUE(engine_->isFetched(app));
+    }
+  }
+  ASSERT_EQ(calls().size(), 2);
+
+  engine_->clearAppsStatusCache();
+  ASSERT_TRUE(engine_->isRunning(apps_[0]));
+  ASSERT_EQ(calls().size(), 3);
+}
+
+TEST_F(ComposeAppStatusTest, FetchStatusOnly) {
+  engine_->cacheAppsStatus(apps_, true);
+  ASSERT_EQ(calls().size(), 1);
+  for (const auto& app : apps_) {
+    ASSERT_TRUE(engine_->isFetched(app));
+  }
+  ASSERT_EQ(calls().size(), 1);
+}
+
+TEST_F(ComposeAppStatusTest, MissingBlobs) {
+  setFetchStatus(false);
+  engine_->cacheAppsStatus(apps_);
+  ASSERT_EQ(calls().size(), 2);
+  // the missing blobs can't be attributed to a specific app, so each app is checked on its own
+  for (const auto& app : apps_) {
+    ASSERT_FALSE(engine_->isFetched(app));
+  }
+  ASSERT_EQ(calls().size(), 4);
+  ASSERT_NE(calls()[2].find(apps_[0].uri), std::string::npos);
+  ASSERT_EQ(calls()[2].find(apps_[1].uri), std::string::npos);
+}
+
+TEST_F(ComposeAppStatusTest, CacheClearedOnError) {
+  try {
+    const AppEngine::AppsStatusCache status_cache{*engine_, apps_};
+    ASSERT_TRUE(engine_->isRunning(apps_[0]));
+    ASSERT_EQ(calls().size(), 2);
+    throw std::runtime_error("status check failure");
+  } catch (const std::runtime_error&) {
+  }
+  // the status is queried again since the cache is cleared when the check is aborted
+  ASSERT_TRUE(engine_->isRunning(apps_[0]));
+  ASSERT_EQ(calls().size(), 3);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  logger_init();
+  return RUN_ALL_TESTS();
+}
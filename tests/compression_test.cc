@@ -0,0 +1,40 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "compression.h"
+
+TEST(Compression, Gzip) {
+  std::string data;
+  for (int ii = 0; ii < 1000; ++ii) {
+    data += R"({"name":"app-)" + std::to_string(ii % 10) + R"(","state":"healthy"})";
+  }
+  const auto compressed{gzip(data)};
+  // gzip magic number
+  ASSERT_EQ(compressed.substr(0, 2), std::string("\x1f\x8b"));
+  ASSERT_LT(compressed.size(), data.size() / 10);
+  ASSERT_EQ(gunzip(compressed), data);
+
+  ASSERT_EQ(gunzip(gzip("")), "");
+  ASSERT_THROW(gunzip(compressed.substr(0, compressed.size() / 2)), std::runtime_error);
+  ASSERT_THROW(gunzip(data), std::runtime_error);
+
+  ASSERT_TRUE(isGzip(compressed));
+  ASSERT_FALSE(isGzip(data));
+  ASSERT_FALSE(isGzip(""));
+  ASSERT_EQ(gunzip(compressed, data.size()), data);
+  ASSERT_THROW(gunzip(compressed, data.size() - 1), std::runtime_error);
+}
+
+TEST(Compression, ContentEncoding) {
+  ASSERT_EQ(parseContentEncoding(""), ContentEncoding::Identity);
+  ASSERT_EQ(parseContentEncoding("none"), ContentEncoding::Identity);
+  ASSERT_EQ(parseContentEncoding("gzip"), ContentEncoding::Gzip);
+  ASSERT_EQ(contentEncodingToString(ContentEncoding::Gzip), "gzip");
+  ASSERT_THROW(parseContentEncoding("zstd"), std::invalid_argument);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <atomic>
+#include <cstring>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "connectivitymonitor.h"
+
+// Lets tests set the default route presence instead of reading it from rtnetlink
+class RouteMock : public ConnectivityMonitor {
+ public:
+  using ConnectivityMonitor::ConnectivityMonitor;
+  using ConnectivityMonitor::setDefaultRoute;
+};
+
+// Builds an rtnetlink message of the given type with the given payload and attributes
+template <typename Payload>
+static std::vector<char> makeMessage(uint16_t type, const Payload& payload,
+                                     const std::vector<std::pair<uint16_t, int>>& int_attrs = {}) {
+  std::vector<char> buffer(NLMSG_SPACE(sizeof(Payload)) + int_attrs.size() * RTA_SPACE(sizeof(int)));
+  auto* msg{reinterpret_cast<nlmsghdr*>(buffer.data())};
+  msg->nlmsg_type = type;
+  msg->nlmsg_len = NLMSG_LENGTH(sizeof(Payload));
+  std::memcpy(NLMSG_DATA(msg), &payload, sizeof(Payload));
+  for (const auto& int_attr : int_attrs) {
+    auto* attr{reinterpret_cast<rtattr*>(buffer.data() + NLMSG_ALIGN(msg->nlmsg_len))};
+    attr->rta_type = int_attr.first;
+    attr->rta_len = RTA_LENGTH(sizeof(int));
+    std::memcpy(RTA_DATA(attr), &int_attr.second, sizeof(int));
+    msg->nlmsg_len = NLMSG_ALIGN(msg->nlmsg_len) + RTA_ALIGN(attr->rta_len);
+  }
+  return buffer;
+}
+
+static std::vector<char> makeLink(int index, unsigned flags) {
+  ifinfomsg link{};
+  link.ifi_index = index;
+  link.ifi_flags = flags;
+  return makeMessage(RTM_NEWLINK, link);
+}
+
+static std::vector<char> makeRoute(unsigned char dst_len, int oif, unsigned char type = RTN_UNICAST) {
+  rtmsg route{};
+  route.rtm_family = AF_INET;
+  route.rtm_dst_len = dst_len;
+  route.rtm_type = type;
+  return makeMessage(RTM_NEWROUTE, route, {{RTA_OIF, oif}});
+}
+
+static const nlmsghdr* msg(const std::vector<char>& buffer) {
+  return reinterpret_cast<const nlmsghdr*>(buffer.data());
+}
+
+TEST(ConnectivityMonitor, ReachabilityIsCached) {
+  int probe_numb{0};
+  ConnectivityMonitor monitor{[&probe_numb](const std::string& server) {
+    ++probe_numb;
+    return server != "http://localhost:1";
+  }};
+
+  // a server on a loopback interface doesn't need a default route, so it's probed regardless of the route presence
+  ASSERT_TRUE(monitor.isRouteAvailable("http://localhost:8080/repo"));
+  ASSERT_TRUE(monitor.isRouteAvailable("https://127.0.0.1"));
+  ASSERT_TRUE(monitor.isRouteAvailable("http://user@[::1]:8080"));
+
+  ASSERT_TRUE(monitor.isReachable("http://localhost:8080"));
+  ASSERT_TRUE(monitor.isReachable("http://localhost:8080"));
+  ASSERT_EQ(probe_numb, 1);
+  ASSERT_FALSE(monitor.isReachable("http://localhost:1"));
+  ASSERT_FALSE(monitor.isReachable("http://localhost:1"));
+  ASSERT_EQ(probe_numb, 2);
+}
+
+TEST(ConnectivityMonitor, NoDefaultRoute) {
+  int probe_numb{0};
+  RouteMock monitor{[&probe_numb](const std::string& server) {
+    ++probe_numb;
+    return server == "https://static-route.example.com";
+  }};
+  // a default route is assumed to be present until the monitor is started
+  ASSERT_TRUE(monitor.hasDefaultRoute());
+  ASSERT_TRUE(monitor.isRouteAvailable("https://ota-lite.foundries.io"));
+
+  int listener_calls{0};
+  monitor.addListener([&listener_calls](bool has_default_route) { listener_calls += has_default_route ? 1 : -1; });
+  monitor.setDefaultRoute(false);
+  ASSERT_EQ(listener_calls, -1);
+  ASSERT_FALSE(monitor.isRouteAvailable("https://ota-lite.foundries.io"));
+  ASSERT_TRUE(monitor.isRouteAvailable("http://localhost:8080"));
+  ASSERT_FALSE(monitor.waitForDefaultRoute(std::chrono::milliseconds(10)));
+
+  // the lack of a default route doesn't mean that a server is unreachable, so it's probed anyway
+  ASSERT_TRUE(monitor.isReachable("https://static-route.example.com"));
+  ASSERT_FALSE(monitor.isReachable("https://ota-lite.foundries.io"));
+  ASSERT_EQ(probe_numb, 2);
+
+  // a change of the network configuration invalidates the cached probe results
+  monitor.setDefaultRoute(true);
+  ASSERT_EQ(listener_calls, 0);
+  ASSERT_TRUE(monitor.waitForDefaultRoute(std::chrono::milliseconds(0)));
+  ASSERT_FALSE(monitor.isReachable("https://ota-lite.foundries.io"));
+  ASSERT_EQ(probe_numb, 3);
+}
+
+TEST(ConnectivityMonitor, RemoveListenerWhileInvoked) {
+  RouteMock monitor{[](const std::string&) { return true; }};
+  std::promise<void> invoked;
+  std::promise<void> resume;
+  auto resume_future{resume.get_future().share()};
+  std::atomic<bool> returned{false};
+  const auto id{monitor.addListener([&](bool) {
+    invoked.set_value();
+    resume_future.wait();
+    returned = true;
+  })};
+
+  std::thread route_thread{[&monitor]() { monitor.setDefaultRoute(false); }};
+  invoked.get_future().wait();
+  // removing the listener waits for it to return, so the objects it refers to can be destroyed right after
+  auto removal{std::async(std::launch::async, [&monitor, id]() { monitor.removeListener(id); })};
+  ASSERT_EQ(removal.wait_for(std::chrono::milliseconds(100)), std::future_status::timeout);
+  resume.set_value();
+  removal.wait();
+  ASSERT_TRUE(returned);
+  route_thread.join();
+
+  // the removed listener is not invoked anymore
+  monitor.setDefaultRoute(true);
+}
+
+TEST(ConnectivityMonitor, UpLinks) {
+  ASSERT_EQ(ConnectivityMonitor::getUpLinkIndex(msg(makeLink(2, IFF_UP | IFF_RUNNING))), 2);
+  // the link is configured up but has no carrier
+  ASSERT_EQ(ConnectivityMonitor::getUpLinkIndex(msg(makeLink(2, IFF_UP))), -1);
+  ASSERT_EQ(ConnectivityMonitor::getUpLinkIndex(msg(makeLink(2, 0))), -1);
+  ASSERT_EQ(ConnectivityMonitor::getUpLinkIndex(msg(makeLink(1, IFF_UP | IFF_RUNNING | IFF_LOOPBACK))), -1);
+  ifinfomsg link{};
+  link.ifi_index = 2;
+  link.ifi_flags = IFF_UP | IFF_RUNNING;
+  ASSERT_EQ(ConnectivityMonitor::getUpLinkIndex(msg(makeMessage(RTM_DELLINK, link))), -1);
+}
+
+TEST(ConnectivityMonitor, DefaultRoutes) {
+  const std::unordered_set<int> up_links{2, 3};
+  ASSERT_TRUE(ConnectivityMonitor::isDefaultRoute(msg(makeRoute(0, 2)), up_links));
+  ASSERT_TRUE(ConnectivityMonitor::isDefaultRoute(msg(makeRoute(0, 3)), up_links));
+  // the route's link is down
+  ASSERT_FALSE(ConnectivityMonitor::isDefaultRoute(msg(makeRoute(0, 4)), up_links));
+  ASSERT_FALSE(ConnectivityMonitor::isDefaultRoute(msg(makeRoute(0, 2)), {}));
+  // not a default route
+  ASSERT_FALSE(ConnectivityMonitor::isDefaultRoute(msg(makeRoute(24, 2)), up_links));
+  ASSERT_FALSE(ConnectivityMonitor::isDefaultRoute(msg(makeRoute(0, 2, RTN_UNREACHABLE)), up_links));
+
+  // the nexthops of a multipath route are not evaluated
+  rtmsg route{};
+  route.rtm_type = RTN_UNICAST;
+  ASSERT_TRUE(ConnectivityMonitor::isDefaultRoute(msg(makeMessage(RTM_NEWROUTE, route, {{RTA_MULTIPATH, 0}})), {}));
+  ASSERT_FALSE(ConnectivityMonitor::isDefaultRoute(msg(makeMessage(RTM_DELROUTE, route, {{RTA_OIF, 2}})), up_links));
+}
+
+TEST(ConnectivityMonitor, Start) {
+  ConnectivityMonitor monitor{[](const std::string&) { return true; }};
+  // whatever the network configuration of the host is, the monitor evaluates it and stops cleanly
+  monitor.start();
+  monitor.start();
+  ASSERT_TRUE(monitor.isReachable("https://ota-lite.foundries.io"));
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
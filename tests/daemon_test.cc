@@ -1,6 +1,13 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <signal.h>
+#include <unistd.h>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <thread>
+
 #include <boost/filesystem.hpp>
 
 #include "libaktualizr/types.h"
@@ -28,6 +35,30 @@ class DaemonTest : public fixtures::ClientTest {
     return lite_client_;
   }
 
+  void tweakConf(Config& conf) override { conf.pacman.extra["daemon_jitter"] = "0"; }
+
+  // runs the daemon until it stops because a reboot is required to apply an installed Target
+  static std::future<int> startDaemon(LiteClient& client, uint64_t interval = 3600) {
+    return std::async(std::launch::async, [&client, interval]() { return run_daemon(client, interval, false, false); });
+  }
+
+  static bool waitFor(const std::function<bool()>& condition, std::chrono::seconds timeout = std::chrono::seconds{30}) {
+    const auto deadline{std::chrono::steady_clock::now() + timeout};
+    while (!condition()) {
+      if (std::chrono::steady_clock::now() > deadline) {
+        return false;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    return true;
+  }
+
+  // counts the daemon's check-ins
+  static void countCheckIns(fixtures::LiteClientMock& client, std::atomic<int>& check_ins) {
+    ON_CALL(client, callback(::testing::StrEq("check-for-update-post"), ::testing::_, ::testing::_))
+        .WillByDefault(::testing::InvokeWithoutArgs([&check_ins]() { ++check_ins; }));
+  }
+
  private:
   std::shared_ptr<NiceMock<fixtures::MockAppEngine>> app_engine_mock_;
   std::shared_ptr<fixtures::LiteClientMock> lite_client_;
@@ -59,6 +90,73 @@ TEST_F(DaemonTest, MainDaemonOstreeInstall) {
   ASSERT_TRUE(targetsMatch(liteclient->getCurrent(), new_target));
 }
 
+TEST_F(DaemonTest, CheckInOnceOnline) {
+  connectivity_monitor_ = std::make_shared<fixtures::ConnectivityMonitorMock>(false);
+  auto liteclient = createLiteClient();
+  std::atomic<int> check_ins{0};
+  countCheckIns(*liteclient, check_ins);
+  auto new_target = createTarget();
+
+  // the daemon doesn't check in while offline
+  auto daemon{startDaemon(*liteclient)};
+  ASSERT_EQ(daemon.wait_for(std::chrono::seconds(3)), std::future_status::timeout);
+  ASSERT_TRUE(connectivity_monitor_->started());
+  ASSERT_EQ(check_ins, 0);
+
+  // and checks in as soon as connectivity is restored, the new Target is installed and the daemon stops
+  connectivity_monitor_->setOnline(true);
+  ASSERT_EQ(daemon.wait_for(std::chrono::seconds(60)), std::future_status::ready);
+  ASSERT_EQ(daemon.get(), EXIT_SUCCESS);
+  ASSERT_EQ(check_ins, 1);
+  reboot(liteclient);
+  ASSERT_EQ(run_daemon(*liteclient, 100, true, false), EXIT_SUCCESS);
+  ASSERT_TRUE(targetsMatch(liteclient->getCurrent(), new_target));
+}
+
+TEST_F(DaemonTest, CheckInOnSignal) {
+  auto liteclient = createLiteClient();
+  std::atomic<int> check_ins{0};
+  countCheckIns(*liteclient, check_ins);
+
+  auto daemon{startDaemon(*liteclient)};
+  // the SIGUSR1 handler is installed before the first check-in
+  ASSERT_TRUE(waitFor([&check_ins]() { return check_ins == 1; }));
+  auto new_target = createTarget();
+  ASSERT_EQ(daemon.wait_for(std::chrono::seconds(1)), std::future_status::timeout);
+
+  // a check-in is triggered right away rather than in an hour, the new Target is installed and the daemon stops
+  ASSERT_EQ(::kill(::getpid(), SIGUSR1), 0);
+  ASSERT_EQ(daemon.wait_for(std::chrono::seconds(60)), std::future_status::ready);
+  ASSERT_EQ(daemon.get(), EXIT_SUCCESS);
+  ASSERT_EQ(check_ins, 2);
+  // the previous signal disposition is restored on exit
+  struct sigaction action {};
+  ASSERT_EQ(::sigaction(SIGUSR1, nullptr, &action), 0);
+  ASSERT_EQ(action.sa_handler, SIG_DFL);
+
+  reboot(liteclient);
+  ASSERT_EQ(run_daemon(*liteclient, 100, true, false), EXIT_SUCCESS);
+  ASSERT_TRUE(targetsMatch(liteclient->getCurrent(), new_target));
+}
+
+TEST_F(DaemonTest, CheckInAnywayIfSkipped) {
+  connectivity_monitor_ = std::make_shared<fixtures::ConnectivityMonitorMock>(false);
+  auto liteclient = createLiteClient();
+  std::atomic<int> check_ins{0};
+  countCheckIns(*liteclient, check_ins);
+  auto new_target = createTarget();
+
+  // the first check-in is skipped while offline, the next regular one is done anyway in case connectivity is
+  // not detected properly, e.g. the server is reachable over a route the monitor doesn't take into account
+  auto daemon{startDaemon(*liteclient, 3)};
+  ASSERT_EQ(daemon.wait_for(std::chrono::seconds(1)), std::future_status::timeout);
+  ASSERT_EQ(check_ins, 0);
+  ASSERT_EQ(daemon.wait_for(std::chrono::seconds(60)), std::future_status::ready);
+  ASSERT_EQ(daemon.get(), EXIT_SUCCESS);
+  ASSERT_EQ(check_ins, 1);
+  ASSERT_FALSE(connectivity_monitor_->hasDefaultRoute());
+}
+
 int main(int argc, char** argv) {
   if (argc != 3) {
     std::cerr << argv[0] << " invalid arguments\n";
@@ -3,6 +3,8 @@
 import os
 import sys
 import argparse
+import gzip
+import hashlib
 import json
 import logging
 import ssl
@@ -22,6 +24,7 @@ class Handler(SimpleHTTPRequestHandler):
     EventPrefix = "/events"
     SysInfoPrefix = "/system_info"
     DevicePrefix = "/device"
+    AppsStatesPrefix = "/apps-states"
 
     def do_PUT(self):
         if not self.path.startswith(self.SysInfoPrefix) and not self.path.startswith("/ecus"):
@@ -60,6 +63,8 @@ class Handler(SimpleHTTPRequestHandler):
             self.end_headers()
         elif self.path.startswith(self.EventPrefix):
             self.event_handler()
+        elif self.path.startswith(self.AppsStatesPrefix):
+            self.apps_states_handler()
         else:
             self.send_response(200)
             self.end_headers()
@@ -129,10 +134,24 @@ class Handler(SimpleHTTPRequestHandler):
             self.end_headers()
         else:
             self._tuf_dump_headers()
+            with open(path, 'rb') as source:
+                data = source.read()
+            etag = '"%s"' % hashlib.sha256(data).hexdigest()
+            if self.headers.get('If-None-Match') == etag:
+                self.send_response(304)
+                self.send_header('ETag', etag)
+                self.end_headers()
+                self._tuf_update_stats(0)
+                return
             self.send_response(200)
-            self.send_header('Content-Length', str(os.path.getsize(path)))
+            self.send_header('ETag', etag)
+            if 'gzip' in self.headers.get('Accept-Encoding', ''):
+                data = gzip.compress(data)
+                self.send_header('Content-Encoding', 'gzip')
+            self.send_header('Content-Length', str(len(data)))
             self.end_headers()
-            self._tuf_serve_metadata_file(path)
+            self.wfile.write(data)
+            self._tuf_update_stats(len(data))
 
     def event_handler(self):
         logger.info("Device Gateway: POST /events request %s" % self.path)
@@ -144,13 +163,38 @@ class Handler(SimpleHTTPRequestHandler):
         self.send_header('Content-Length', '0')
         self.end_headers()
 
-    def _tuf_serve_metadata_file(self, uri):
-        with open(uri, 'rb') as source:
-            while True:
-                data = source.read(1024)
-                if not data:
-                    break
-                self.wfile.write(data)
+    def apps_states_handler(self):
+        logger.info("Device Gateway: POST /apps-states request %s" % self.path)
+        body = self._read_body()
+        if not self.server.apps_states_file:
+            self.send_response(200)
+            self.send_header('Content-Length', '0')
+            self.end_headers()
+            return
+        # the failure injection, the report is not stored
+        if os.path.exists(self.server.apps_states_file + ".fail"):
+            self.send_response(500)
+            self.send_header('Content-Length', '0')
+            self.end_headers()
+            return
+        reports = []
+        if os.path.exists(self.server.apps_states_file):
+            with open(self.server.apps_states_file) as f:
+                reports = json.load(f)
+        reports.append({"encoding": self.headers.get('Content-Encoding', 'identity'),
+                        "body": json.loads(body.decode('utf-8'))})
+        with open(self.server.apps_states_file, "w") as f:
+            json.dump(reports, f)
+        self.send_response(200)
+        self.send_header('Content-Length', '0')
+        self.end_headers()
+
+    def _read_body(self):
+        data_len = int(self.headers.get('content-length', 0))
+        body = self.rfile.read(data_len)
+        if self.headers.get('Content-Encoding') == 'gzip':
+            body = gzip.decompress(body)
+        return body
 
     def _tuf_dump_headers(self):
         headers = {}
@@ -160,6 +204,18 @@ class Handler(SimpleHTTPRequestHandler):
         with open(self.server.headers_file, "w") as f:
             json.dump(headers, f)
 
+    def _tuf_update_stats(self, body_size):
+        if not self.server.tuf_stats_file:
+            return
+        stats = {"requests": 0, "bytes": 0}
+        if os.path.exists(self.server.tuf_stats_file):
+            with open(self.server.tuf_stats_file) as f:
+                stats = json.load(f)
+        stats["requests"] += 1
+        stats["bytes"] += body_size
+        with open(self.server.tuf_stats_file, "w") as f:
+            json.dump(stats, f)
+
     def _ostree_repo(self):
         return self.server.ostree_repo
 
@@ -195,9 +251,12 @@ class Handler(SimpleHTTPRequestHandler):
 
 
 class FakeDeviceGateway(HTTPServer):
-    def __init__(self, addr, ostree_repo, tuf_repo, headers_file, events_file, sota_toml_file, mtls=None):
+    def __init__(self, addr, ostree_repo, tuf_repo, headers_file, events_file, sota_toml_file, mtls=None,
+                 tuf_stats_file=None, apps_states_file=None):
         self.ostree_repo = ostree_repo
         self.tuf_repo = tuf_repo
+        self.tuf_stats_file = tuf_stats_file
+        self.apps_states_file = apps_states_file
         self.headers_file = headers_file
         self.events_file = events_file
         self.sota_toml_file = sota_toml_file
@@ -224,12 +283,17 @@ def main():
     parser.add_argument('-S', '--sota-toml-file', help='File to dump sota toml data to')
     parser.add_argument('-s', '--mtls', default=None,
                         help='Enables mTLS (HTTP over mTLS) and specifies directory with certs/key')
+    parser.add_argument('-T', '--tuf-stats-file', default=None,
+                        help='File to dump the number of TUF metadata requests and bytes sent to')
+    parser.add_argument('-A', '--apps-states-file', default=None,
+                        help='File to dump the received apps-states reports to')
 
     args = parser.parse_args()
 
     try:
         httpd = FakeDeviceGateway(('', args.port), args.ostree, args.tuf_repo, args.headers_file,
-                                  args.events_file, args.sota_toml_file, args.mtls)
+                                  args.events_file, args.sota_toml_file, args.mtls, args.tuf_stats_file,
+                                  args.apps_states_file)
         httpd.serve_forever()
     except KeyboardInterrupt:
         httpd.server_close()
@@ -3,17 +3,37 @@ import io
 import os
 import sys
 import argparse
+import hashlib
 import json
 import logging
 import ssl
 import tarfile
+import time
 
 from http.server import SimpleHTTPRequestHandler, HTTPServer
-from socketserver import UnixStreamServer
+from socketserver import ThreadingMixIn, UnixStreamServer
+from urllib.parse import urlparse, parse_qs
 
 logger = logging.getLogger("Fake Docker Daemon")
 
 API_VERSION = "1.44"
+# how often the event stream checks whether the containers have changed
+EVENTS_POLL_INTERVAL_S = 0.1
+
+
+def load_containers(root_dir):
+    try:
+        with open(os.path.join(root_dir, "containers.json"), "r") as f:
+            containers = json.load(f)
+    except FileNotFoundError:
+        return []
+    # the containers started by the docker-compose fake have no ID, so it is derived from the container labels
+    for container in containers:
+        if "Id" not in container:
+            labels = json.dumps(container.get("Labels", {}), sort_keys=True).encode()
+            container["Id"] = hashlib.sha256(labels).hexdigest()
+    return containers
+
 
 class Handler(SimpleHTTPRequestHandler):
     def do_HEAD(self):
@@ -48,13 +68,25 @@ class Handler(SimpleHTTPRequestHandler):
             self.send_header('Content-Type', 'application/json')
             self.end_headers()
             self.wfile.write(json.dumps(dockerd_response).encode())
+        elif self.path.startswith('/images/') and self.path.endswith('/json'):
+            # image inspection, an image is referred by one of the tags it was loaded with
+            try:
+                with open(os.path.join(self.server.root_dir, "images.json"), "r") as f:
+                    images = json.load(f)
+            except FileNotFoundError:
+                images = {}
+            image_ref = self.path[len('/images/'):-len('/json')]
+            self.send_response(200 if image_ref in images else 404)
+            self.send_header('Content-Type', 'application/json')
+            self.end_headers()
+            self.wfile.write(json.dumps({'Id': image_ref} if image_ref in images else {'message': 'No such image'}).encode())
         elif self.path.find('/containers/json') != -1:
             dockerd_response = []
             try:
-                with open(os.path.join(self.server.root_dir, "containers.json"), "r") as f:
-                    dockerd_response = json.load(f)
-            except FileNotFoundError:
-                pass
+                dockerd_response = load_containers(self.server.root_dir)
+                filters = json.loads(parse_qs(urlparse(self.path).query).get('filters', ['{}'])[0])
+                if 'id' in filters:
+                    dockerd_response = [c for c in dockerd_response if c["Id"] in filters['id']]
             except Exception as exc:
                 logger.error(exc)
 
@@ -65,6 +97,8 @@ class Handler(SimpleHTTPRequestHandler):
             self.send_header('Content-Length', len(data_to_send))
             self.end_headers()
             self.wfile.write(json.dumps(dockerd_response).encode())
+        elif self.path.startswith('/events'):
+            self.stream_events()
         else:
             self.send_response(200)
             self.send_header('Api-Version:', API_VERSION)
@@ -95,6 +129,48 @@ class Handler(SimpleHTTPRequestHandler):
     def address_string(self):
         return ""
 
+    def stream_events(self):
+        # The container events are derived from the changes of `containers.json` made since the stream was opened,
+        # the stream is open until the client closes it.
+        self.send_response(200)
+        self.send_header('Content-Type', 'application/json')
+        self.end_headers()
+        self.wfile.flush()
+
+        def container_states():
+            return {c["Id"]: c.get("State") for c in load_containers(self.server.root_dir)}
+
+        states = container_states()
+        try:
+            while True:
+                time.sleep(EVENTS_POLL_INTERVAL_S)
+                try:
+                    cur_states = container_states()
+                except Exception as exc:
+                    # the file is being written
+                    logger.debug(exc)
+                    continue
+                events = []
+                for container_id, state in cur_states.items():
+                    if container_id not in states:
+                        events.append(("create", container_id))
+                        if state == "running":
+                            events.append(("start", container_id))
+                    elif states[container_id] != state:
+                        events.append(("start" if state == "running" else "die", container_id))
+                for container_id in states:
+                    if container_id not in cur_states:
+                        events.append(("destroy", container_id))
+                states = cur_states
+                for action, container_id in events:
+                    logger.info(">>> event  %s %s" % (action, container_id))
+                    event = {"Type": "container", "Action": action, "Actor": {"ID": container_id},
+                             "time": int(time.time())}
+                    self.wfile.write(json.dumps(event).encode() + b'\n')
+                self.wfile.flush()
+        except (BrokenPipeError, ConnectionResetError):
+            logger.info(">>> event stream has been closed")
+
     def post_image(self):
         if 'content-length' in self.headers:
             data_len = int(self.headers.get('content-length', 0))
@@ -168,23 +244,36 @@ class Handler(SimpleHTTPRequestHandler):
             return
 
         # Make the `docker-compose_fake think that the image is installed/pulled/loaded
-        images[image_uri] = True
+        for tag in lm[0]["RepoTags"]:
+            images[tag] = True
         with open(os.path.join(self.server.root_dir, "images.json"), "w+") as f:
             json.dump(images, f)
 
         self.send_response(200)
         self.send_header('Content-Type', 'application/json')
         self.end_headers()
+        if self.path.find('quiet=0') != -1:
+            # the "not quiet" load streams the per-layer progress before the load result
+            for layer in lm[0].get("Layers", []):
+                for current in (0, 512, 1024):
+                    self.wfile.write(json.dumps({'status': 'Loading layer', 'id': layer[:12],
+                                                 'progressDetail': {'current': current, 'total': 1024}}).encode())
+                    self.wfile.write(b'\n')
         self.wfile.write(json.dumps({'stream': image_uri}).encode())
 
 
-class FakeDockerRegistry(HTTPServer):
+class FakeDockerRegistry(ThreadingMixIn, HTTPServer):
+    # the event stream is served concurrently with the other requests
+    daemon_threads = True
+
     def __init__(self, addr, root_dir):
         super(HTTPServer, self).__init__(server_address=addr, RequestHandlerClass=Handler)
         self.root_dir = root_dir
 
 
-class DockerDaemonMock(UnixStreamServer):
+class DockerDaemonMock(ThreadingMixIn, UnixStreamServer):
+    daemon_threads = True
+
     def __init__(self, addr, root_dir):
         super(UnixStreamServer, self).__init__(server_address=addr, RequestHandlerClass=Handler)
         self.root_dir = root_dir
@@ -1,10 +1,23 @@
 #include <gtest/gtest.h>
 
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <thread>
+
 #include <boost/format.hpp>
 #include "boost/format.hpp"
 
 #include "docker/docker.h"
 #include "docker/dockerclient.h"
+#include "docker/dockerdhttpclient.h"
+#include "logging/logging.h"
 #include "test_utils.h"
 
 #include "fixtures/dockerdaemon.cc"
@@ -128,6 +141,21 @@ TEST(Docker, BearerAuth) {
   }
 }
 
+TEST(Docker, TokenTtl) {
+  // a token is considered expired a bit earlier than it actually expires
+  ASSERT_EQ(Docker::RegistryClient::getTokenTtl(Json::Value(300)), 290);
+  ASSERT_EQ(Docker::RegistryClient::getTokenTtl(Json::Value(300.5)), 290);
+  // a short-lived token is cached for a part of its lifetime
+  ASSERT_EQ(Docker::RegistryClient::getTokenTtl(Json::Value(10)), 5);
+  ASSERT_EQ(Docker::RegistryClient::getTokenTtl(Json::Value(1)), 1);
+  // the default lifetime is used if the lifetime is not specified or invalid
+  ASSERT_EQ(Docker::RegistryClient::getTokenTtl(Json::Value()), 50);
+  ASSERT_EQ(Docker::RegistryClient::getTokenTtl(Json::Value("300")), 50);
+  ASSERT_EQ(Docker::RegistryClient::getTokenTtl(Json::Value(0)), 50);
+  ASSERT_EQ(Docker::RegistryClient::getTokenTtl(Json::Value(-300)), 50);
+  ASSERT_EQ(Docker::RegistryClient::getTokenTtl(Json::Value(1e12)), 24 * 60 * 60 - 10);
+}
+
 TEST(Docker, BearerAuthNegative) {
   {
     // unsupported auth type
@@ -275,7 +303,451 @@ TEST_F(ImageTest, LoadImage) {
   ASSERT_THROW(client->loadImage("factory/app@sha256:123", lm), std::runtime_error);
 }
 
+TEST_F(ImageTest, StreamedLoadImage) {
+  TemporaryDirectory dir;
+  fixtures::DockerDaemon daemon{dir / "daemon"};
+  const auto socket{daemon.getUnixSocket().substr(std::string("unix://").size())};
+  // the fake daemon speaks HTTP/1.0, so a response body is delimited by closing the connection
+  auto client{std::make_shared<Docker::DockerClient>(std::make_shared<Docker::DockerdHttpClient>(socket))};
+  auto lm{getLoadManifest()};
+  ASSERT_NO_THROW(client->loadImage("factory/app@sha256:123", lm));
+  lm["x-failure-injection"] = "500";
+  ASSERT_THROW(client->loadImage("factory/app@sha256:123", lm), std::runtime_error);
+  lm["x-failure-injection"] = "load-failure";
+  ASSERT_THROW(client->loadImage("factory/app@sha256:123", lm), std::runtime_error);
+}
+
+// Serves HTTP/1.1 requests over a unix socket, each response echoes the request path and body as separate chunks
+class KeepAliveDockerd {
+ public:
+  explicit KeepAliveDockerd(const boost::filesystem::path& socket) : fd_{::socket(AF_UNIX, SOCK_STREAM, 0)} {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, socket.c_str(), sizeof(addr.sun_path) - 1);
+    if (::bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd_, 8) != 0) {
+      throw std::runtime_error("Failed to listen on " + socket.string());
+    }
+    thread_ = std::thread([this]() {
+      int conn;
+      while ((conn = ::accept(fd_, nullptr, nullptr)) != -1) {
+        ++accepted_numb;
+        serve(conn);
+        ::close(conn);
+      }
+    });
+  }
+  ~KeepAliveDockerd() {
+    ::shutdown(fd_, SHUT_RDWR);
+    ::close(fd_);
+    thread_.join();
+  }
+
+  std::atomic_int accepted_numb{0};
+  std::atomic_int dropped_requests_numb{0};
+
+ private:
+  // serves requests received over the connection until it's closed
+  void serve(int conn) {
+    std::string buffer;
+    std::array<char, 4096> chunk{};
+    const auto recv_more{[&]() {
+      const auto read_size{::recv(conn, chunk.data(), chunk.size(), 0)};
+      if (read_size > 0) {
+        buffer.append(chunk.data(), static_cast<size_t>(read_size));
+      }
+      return read_size > 0;
+    }};
+    while (true) {
+      auto head_end{buffer.find("\r\n\r\n")};
+      while (head_end == std::string::npos) {
+        if (!recv_more()) {
+          return;
+        }
+        head_end = buffer.find("\r\n\r\n");
+      }
+      const auto head{buffer.substr(0, head_end)};
+      const auto length_pos{head.find("Content-Length: ")};
+      const size_t body_size{length_pos == std::string::npos ? 0 : std::stoul(head.substr(length_pos + 16))};
+      while (buffer.size() < head_end + 4 + body_size) {
+        if (!recv_more()) {
+          return;
+        }
+      }
+      const auto body{buffer.substr(head_end + 4, body_size)};
+      buffer.erase(0, head_end + 4 + body_size);
+      const auto path{head.substr(head.find(' ') + 1, head.find(" HTTP/1.1") - head.find(' ') - 1)};
+      if (path == "/drop-request") {
+        // the connection is closed after the request is received, as if the daemon closed it meanwhile
+        ++dropped_requests_numb;
+        return;
+      }
+
+      std::string resp{"HTTP/1.1 200 OK\r\n"};
+      if (path == "/close") {
+        resp += "Connection: close\r\nContent-Length: 2\r\n\r\nok";
+      } else if (path == "/drop") {
+        // the connection is closed right after the response although the client is allowed to keep it
+        resp += "Content-Length: 2\r\n\r\nok";
+      } else {
+        resp += "Transfer-Encoding: chunked\r\n\r\n";
+        for (const auto& data : {path, body}) {
+          if (!data.empty()) {
+            resp += boost::str(boost::format("%x\r\n%s\r\n") % data.size() % data);
+          }
+        }
+        resp += "0\r\n\r\n";
+      }
+      ::send(conn, resp.data(), resp.size(), MSG_NOSIGNAL);
+      if (path == "/close" || path == "/drop") {
+        return;
+      }
+    }
+  }
+
+  const int fd_;
+  std::thread thread_;
+};
+
+TEST(DockerdHttpClient, KeepAlive) {
+  TemporaryDirectory dir;
+  KeepAliveDockerd dockerd{dir / "docker.sock"};
+  Docker::DockerdHttpClient client{(dir / "docker.sock").string()};
+
+  // subsequent requests are sent over the same connection
+  for (int ii = 0; ii < 3; ++ii) {
+    const auto resp{client.get("http://localhost/version", HttpInterface::kNoLimit)};
+    ASSERT_TRUE(resp.isOk()) << resp.getStatusStr();
+    ASSERT_EQ(resp.body, "/version");
+  }
+  const auto post_resp{client.post("http://localhost/images/load?quiet=0", "application/x-tar", "data")};
+  ASSERT_TRUE(post_resp.isOk()) << post_resp.getStatusStr();
+  ASSERT_EQ(post_resp.body, "/images/load?quiet=0data");
+  ASSERT_EQ(dockerd.accepted_numb, 1);
+
+  // a response body is passed to a handler chunk by chunk
+  std::vector<std::string> chunks;
+  const auto streamed_resp{client.postStreaming("http://localhost/images/load", "application/x-tar", "data",
+                                                [&chunks](const char* data, size_t size) {
+                                                  chunks.emplace_back(data, size);
+                                                  return true;
+                                                })};
+  ASSERT_TRUE(streamed_resp.isOk()) << streamed_resp.getStatusStr();
+  ASSERT_TRUE(streamed_resp.body.empty());
+  ASSERT_EQ(chunks, std::vector<std::string>({"/images/load", "data"}));
+  ASSERT_EQ(dockerd.accepted_numb, 1);
+
+  // a connection closed by the daemon isn't reused
+  ASSERT_EQ(client.get("http://localhost/close", HttpInterface::kNoLimit).body, "ok");
+  ASSERT_EQ(client.get("http://localhost/version", HttpInterface::kNoLimit).body, "/version");
+  ASSERT_EQ(dockerd.accepted_numb, 2);
+
+  // a request sent over an idle connection that has been closed by the daemon meanwhile is re-sent
+  ASSERT_EQ(client.get("http://localhost/drop", HttpInterface::kNoLimit).body, "ok");
+  ASSERT_EQ(client.get("http://localhost/version", HttpInterface::kNoLimit).body, "/version");
+  ASSERT_EQ(dockerd.accepted_numb, 3);
+
+  // a request is re-sent if the connection is closed once it's sent only if the request is idempotent
+  ASSERT_EQ(client.get("http://localhost/version", HttpInterface::kNoLimit).body, "/version");
+  ASSERT_FALSE(client.get("http://localhost/drop-request", HttpInterface::kNoLimit).isOk());
+  ASSERT_EQ(dockerd.dropped_requests_numb, 2);
+  ASSERT_EQ(client.get("http://localhost/version", HttpInterface::kNoLimit).body, "/version");
+  ASSERT_FALSE(client.post("http://localhost/drop-request", "application/x-tar", "data").isOk());
+  ASSERT_EQ(dockerd.dropped_requests_numb, 3);
+  ASSERT_EQ(dockerd.accepted_numb, 5);
+
+  // a connection is dropped if a response is not read completely
+  ASSERT_EQ(client.get("http://localhost/version", 4).curl_code, CURLE_FILESIZE_EXCEEDED);
+  ASSERT_EQ(client.get("http://localhost/version", HttpInterface::kNoLimit).body, "/version");
+  ASSERT_EQ(dockerd.accepted_numb, 7);
+}
+
+class DockerdMock : public fixtures::BaseHttpClient {
+ public:
+  HttpResponse get(const std::string& url, int64_t maxsize) override {
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (url == "http://localhost/version") {
+      return HttpResponse("{\"Arch\": \"amd64\"}", 200, CURLE_OK, "");
+    }
+    if (url.find("&filters=") == std::string::npos) {
+      ++full_list_numb;
+      return HttpResponse(Utils::jsonToStr(containers_), 200, CURLE_OK, "");
+    }
+    ++filtered_list_numb;
+    Json::Value filtered{Json::arrayValue};
+    for (const auto& container : containers_) {
+      if (url.find(container["Id"].asString()) != std::string::npos) {
+        filtered.append(container);
+      }
+    }
+    return HttpResponse(Utils::jsonToStr(filtered), 200, CURLE_OK, "");
+  }
+
+  void setContainer(const std::string& id, const std::string& state) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    for (auto& container : containers_) {
+      if (container["Id"].asString() == id) {
+        container["State"] = state;
+        return;
+      }
+    }
+    Json::Value container;
+    container["Id"] = id;
+    container["State"] = state;
+    containers_.append(container);
+  }
+
+  void removeContainer(const std::string& id) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    Json::Value containers{Json::arrayValue};
+    for (const auto& container : containers_) {
+      if (container["Id"].asString() != id) {
+        containers.append(container);
+      }
+    }
+    containers_ = containers;
+  }
+
+  std::atomic_int full_list_numb{0};
+  std::atomic_int filtered_list_numb{0};
+
+ private:
+  std::mutex mutex_;
+  Json::Value containers_{Json::arrayValue};
+};
+
+class DockerEventsMock : public fixtures::BaseHttpClient {
+ public:
+  HttpResponse download(const std::string& url, curl_write_callback write_cb, curl_xferinfo_callback progress_cb,
+                        void* userp, curl_off_t from) override {
+    while (true) {
+      std::unique_lock<std::mutex> lock{mutex_};
+      cv_.wait_for(lock, std::chrono::milliseconds(100));
+      while (!events_.empty()) {
+        auto event{events_.front()};
+        events_.pop_front();
+        if (write_cb(&event[0], 1, event.size(), userp) != event.size()) {
+          return HttpResponse("", 200, CURLE_WRITE_ERROR, "");
+        }
+        ++delivered_numb_;
+        cv_.notify_all();
+      }
+      // the transfer is aborted by the progress callback once the client is being destroyed
+      if (progress_cb(userp, 0, 0, 0, 0) != 0) {
+        return HttpResponse("", 200, CURLE_ABORTED_BY_CALLBACK, "");
+      }
+    }
+  }
+
+  // returns once the event has been handled by the client, or false if it hasn't been handled in time
+  bool emit(const std::string& id, const std::string& action) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    events_.emplace_back("{\"Type\":\"container\",\"Action\":\"" + action + "\",\"Actor\":{\"ID\":\"" + id +
+                         "\"}}\n");
+    const auto event_numb{++emitted_numb_};
+    cv_.notify_all();
+    return cv_.wait_for(lock, std::chrono::seconds(10), [this, event_numb]() { return delivered_numb_ >= event_numb; });
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::string> events_;
+  size_t emitted_numb_{0};
+  size_t delivered_numb_{0};
+};
+
+TEST(DockerClient, ContainerStateCache) {
+  auto dockerd{std::make_shared<DockerdMock>()};
+  auto events{std::make_shared<DockerEventsMock>()};
+  dockerd->setContainer("container-01", "running");
+  Docker::DockerClient client{dockerd, events};
+  // the event stream is considered connected once an event has been received, an ignored one is enough
+  ASSERT_TRUE(events->emit("container-01", "attach"));
+
+  // containers are listed just once, then the cache is used
+  Json::Value containers;
+  client.getContainers(containers);
+  ASSERT_EQ(containers.size(), 1);
+  client.getContainers(containers);
+  client.getContainers(containers);
+  ASSERT_EQ(dockerd->full_list_numb, 1);
+  ASSERT_EQ(dockerd->filtered_list_numb, 0);
+
+  // only changed containers are listed, `exec_*` events are ignored
+  dockerd->setContainer("container-02", "created");
+  ASSERT_TRUE(events->emit("container-02", "create"));
+  dockerd->setContainer("container-01", "exited");
+  ASSERT_TRUE(events->emit("container-01", "die"));
+  ASSERT_TRUE(events->emit("container-01", "exec_start: sh"));
+  client.getContainers(containers);
+  ASSERT_EQ(containers.size(), 2);
+  ASSERT_EQ(dockerd->full_list_numb, 1);
+  ASSERT_EQ(dockerd->filtered_list_numb, 1);
+  for (const auto& container : containers) {
+    if (container["Id"].asString() == "container-01") {
+      ASSERT_EQ(container["State"].asString(), "exited");
+    }
+  }
+
+  // removed containers are dropped from the cache without querying dockerd
+  dockerd->removeContainer("container-01");
+  ASSERT_TRUE(events->emit("container-01", "destroy"));
+  client.getContainers(containers);
+  ASSERT_EQ(containers.size(), 1);
+  ASSERT_EQ(containers[0]["Id"].asString(), "container-02");
+  ASSERT_EQ(dockerd->full_list_numb, 1);
+  ASSERT_EQ(dockerd->filtered_list_numb, 1);
+}
+
+TEST(DockerClient, NoContainerStateCache) {
+  auto dockerd{std::make_shared<DockerdMock>()};
+  Docker::DockerClient client{dockerd};
+  Json::Value containers;
+  client.getContainers(containers);
+  client.getContainers(containers);
+  ASSERT_EQ(dockerd->full_list_numb, 2);
+}
+
+class CountingHttpClient : public fixtures::BaseHttpClient {
+ public:
+  explicit CountingHttpClient(const std::string& socket) : client_{socket} {}
+  HttpResponse get(const std::string& url, int64_t maxsize) override {
+    ++request_numb;
+    return client_.get(url, maxsize);
+  }
+  std::atomic_int request_numb{0};
+
+ private:
+  ::HttpClient client_;
+};
+
+// checks the condition until it holds or the timeout expires
+static bool waitFor(const std::function<bool()>& condition, std::chrono::seconds timeout = std::chrono::seconds(10)) {
+  const auto deadline{std::chrono::steady_clock::now() + timeout};
+  while (!condition()) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  return true;
+}
+
+TEST(DockerClient, ContainerStateCacheDockerd) {
+  TemporaryDirectory dir;
+  fixtures::DockerDaemon daemon{dir / "daemon"};
+  // the fake dockerd derives the container events from the changes of the containers file
+  const auto setContainers{[&daemon](const std::string& containers) {
+    const auto containers_file{daemon.dir() / fixtures::DockerDaemon::ContainersFile};
+    Utils::writeFile(containers_file.string() + ".tmp", containers);
+    boost::filesystem::rename(containers_file.string() + ".tmp", containers_file);
+  }};
+  setContainers(R"([{"Id": "container-01", "State": "running"}])");
+
+  const auto socket{daemon.getUnixSocket().substr(std::string("unix://").size())};
+  auto http_client{std::make_shared<CountingHttpClient>(socket)};
+  Docker::DockerClient client{http_client,
+                              Docker::DockerClient::DefaultEventsHttpClientFactory(daemon.getUnixSocket())};
+  Json::Value containers;
+  const auto isCached{[&]() {
+    const int request_numb{http_client->request_numb};
+    client.getContainers(containers);
+    return http_client->request_numb == request_numb;
+  }};
+  const auto getState{[&containers](const std::string& id) {
+    for (const auto& container : containers) {
+      if (container["Id"].asString() == id) {
+        return container["State"].asString();
+      }
+    }
+    return std::string();
+  }};
+
+  // containers are listed until the event stream is connected, then the cache is used
+  ASSERT_TRUE(waitFor(isCached));
+  ASSERT_EQ(containers.size(), 1);
+
+  setContainers(R"([{"Id": "container-01", "State": "exited"}, {"Id": "container-02", "State": "created"}])");
+  ASSERT_TRUE(waitFor([&]() {
+    client.getContainers(containers);
+    return containers.size() == 2 && getState("container-01") == "exited";
+  }));
+  ASSERT_TRUE(isCached());
+
+  setContainers(R"([{"Id": "container-02", "State": "created"}])");
+  ASSERT_TRUE(waitFor([&]() {
+    client.getContainers(containers);
+    return containers.size() == 1 && getState("container-02") == "created";
+  }));
+  ASSERT_TRUE(isCached());
+}
+
+TEST(DockerClient, RunningAppsBenchmark) {
+  const int container_numb{40};
+  const int iteration_numb{10};
+  TemporaryDirectory dir;
+  fixtures::DockerDaemon daemon{dir / "daemon"};
+
+  Json::Value containers{Json::arrayValue};
+  for (int ii = 0; ii < container_numb; ++ii) {
+    Json::Value container;
+    container["Id"] = "container-" + std::to_string(ii);
+    container["Image"] = "factory/image-" + std::to_string(ii);
+    container["Labels"]["com.docker.compose.project"] = "app-" + std::to_string(ii % 10);
+    container["Labels"]["com.docker.compose.service"] = "service-" + std::to_string(ii);
+    container["Labels"]["io.compose-spec.config-hash"] = std::to_string(ii);
+    if (ii % 4 == 0) {
+      container["State"] = "exited";
+      container["Status"] = "Exited (0) 2 minutes ago";
+    } else {
+      container["State"] = "running";
+      container["Status"] = "Up 2 minutes (healthy)";
+    }
+    containers.append(container);
+  }
+  Utils::writeFile(daemon.dir() / fixtures::DockerDaemon::ContainersFile, Utils::jsonToStr(containers));
+
+  const auto socket{daemon.getUnixSocket().substr(std::string("unix://").size())};
+  auto http_client{std::make_shared<CountingHttpClient>(socket)};
+  Docker::DockerClient client{http_client};
+
+  // health and exit codes are taken from the container list, so it takes one request per call
+  http_client->request_numb = 0;
+  const auto started_at{std::chrono::steady_clock::now()};
+  for (int ii = 0; ii < iteration_numb; ++ii) {
+    const auto apps{client.getRunningApps(nullptr)};
+    ASSERT_EQ(apps.size(), 10);
+    for (const auto& app : apps) {
+      for (const auto& service : app["services"]) {
+        ASSERT_EQ(service["health"].asString(), "healthy");
+      }
+    }
+  }
+  const auto batched_ms{
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started_at).count()};
+  ASSERT_EQ(http_client->request_numb, iteration_numb);
+
+  // the former approach: list containers and inspect each one whose health or exit code is checked
+  http_client->request_numb = 0;
+  const auto inspect_started_at{std::chrono::steady_clock::now()};
+  for (int ii = 0; ii < iteration_numb; ++ii) {
+    const auto listed{http_client->get("http://localhost/containers/json?all=1", HttpInterface::kNoLimit).getJson()};
+    for (const auto& container : listed) {
+      http_client->get("http://localhost/containers/" + container["Id"].asString() + "/json", HttpInterface::kNoLimit);
+    }
+  }
+  const auto inspect_ms{std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                                                              inspect_started_at)
+                            .count()};
+  ASSERT_EQ(http_client->request_numb, iteration_numb * (container_numb + 1));
+
+  LOG_INFO << "getRunningApps() of " << container_numb << " containers, " << iteration_numb
+           << " iterations: " << batched_ms << " ms, with a container inspection per container: " << inspect_ms
+           << " ms";
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
+  logger_init();
   return RUN_ALL_TESTS();
 }
@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 
+#include <chrono>
+
 #include "exec.h"
 #include "utilities/utils.h"
 
@@ -51,6 +53,37 @@ TEST(Exec, ExecTimeout) {
   }
 }
 
+TEST(Exec, StreamingExec) {
+  std::vector<std::string> lines;
+  execStreaming("printf 'line1\\nline2\\n\\nline4'", "printf failed",
+                [&lines](const std::string& line) { lines.push_back(line); });
+  ASSERT_EQ(lines, (std::vector<std::string>{"line1", "line2", "", "line4"}));
+}
+
+TEST(Exec, ExecReturnsOnChildExit) {
+  // the background process inherits the child's stdout, exec should not wait until it closes it
+  const auto start{std::chrono::steady_clock::now()};
+  std::string output;
+  exec("sleep 10 & echo done", "failed to run the command", "", &output, "20s");
+  ASSERT_EQ(output, "done\n");
+  ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+}
+
+TEST(Exec, ExecBoundedDrain) {
+  // the background process keeps writing to the inherited stdout after the child exits, exec should not read it forever
+  const auto start{std::chrono::steady_clock::now()};
+  execStreaming("yes & echo done", "failed to run the command", [](const std::string&) {}, "", "20s");
+  ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+}
+
+TEST(Exec, ExecOutputLimit) {
+  std::string output;
+  EXPECT_THROW(exec("head -c " + std::to_string(ExecMaxOutputSize + 1) + " /dev/zero", "", "", &output),
+               std::runtime_error);
+  // the limit is not applied if the output is not captured
+  exec("head -c " + std::to_string(ExecMaxOutputSize + 1) + " /dev/zero", "failed to run the command");
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
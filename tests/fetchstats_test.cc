@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+
+#include <set>
+
+#include "fetchstats.h"
+
+static const std::string Hash1{"1dd8d3a6b8ff8ccf6a2b0e9d5a13b6bf5a4e95f2c0a7bd1a3b7a5d2ec98e1f31"};
+static const std::string Hash2{"2bf60b7d1f4e3c8a9b6d5e4f3a2b1c0d9e8f7a6b5c4d3e2f1a0b9c8d7e6f5a41"};
+static const std::string Hash3{"3c2b1a0f9e8d7c6b5a4f3e2d1c0b9a8f7e6d5c4b3a2f1e0d9c8b7a6f5e4d3c21"};
+
+TEST(FetchStats, Stats) {
+  FetchStats stats;
+  stats.addExpectedBlob("sha256:" + Hash1, 1000);
+  stats.addExpectedBlob("sha256:" + Hash2, 2000);
+  stats.addExpectedBlob("sha256:" + Hash3, 4000);
+
+  // full digest and a short digest prefix, a short hex string and an unknown hash are ignored
+  stats.onOutputLine("Fetching blob sha256:" + Hash1 + " [1000/1000]");
+  stats.onOutputLine("Copying blob " + Hash2.substr(0, FetchStats::MinDigestPrefixLen) + " done");
+  stats.onOutputLine("Copying blob " + Hash3.substr(0, FetchStats::MinDigestPrefixLen - 1) + " done");
+  stats.onOutputLine("Copying blob sha256:ffffffffffffffffffff done");
+
+  const std::set<std::string> fetched_blobs{Hash1, Hash2};
+  stats.finish([&fetched_blobs](const std::string& hash) { return fetched_blobs.count(hash) > 0; });
+
+  const auto stats_json{stats.toJson()};
+  ASSERT_EQ(stats_json["bytes_total"].asUInt64(), 7000);
+  ASSERT_EQ(stats_json["bytes_done"].asUInt64(), 3000);
+  ASSERT_EQ(stats_json["blobs_total"].asUInt(), 3);
+  ASSERT_EQ(stats_json["blobs_done"].asUInt(), 2);
+  ASSERT_EQ(stats_json["slowest_blobs"].size(), 2);
+  for (const auto& blob : stats_json["slowest_blobs"]) {
+    ASSERT_TRUE(blob["digest"].asString() == "sha256:" + Hash1 || blob["digest"].asString() == "sha256:" + Hash2);
+    ASSERT_TRUE(blob["fetched"].asBool());
+  }
+}
+
+TEST(FetchStats, BlobsRegisteredAfterFetch) {
+  FetchStats stats;
+  // the blobs of a fresh App are referred to by the fetch output before they are known
+  stats.onOutputLine("Fetching blob sha256:" + Hash1 + " [1000/1000]");
+  stats.onOutputLine("Copying blob " + Hash2.substr(0, FetchStats::MinDigestPrefixLen) + " done");
+  stats.onOutputLine("Copying blob sha256:ffffffffffffffffffff done");
+
+  // the blobs that landed in the store and the ones still missing are registered once the fetch completes
+  stats.addFetchedBlob("sha256:" + Hash1, 1000);
+  stats.addFetchedBlob(Hash2, 2000);
+  stats.addExpectedBlob("sha256:" + Hash3, 4000);
+  const std::set<std::string> fetched_blobs{Hash1, Hash2};
+  stats.finish([&fetched_blobs](const std::string& hash) { return fetched_blobs.count(hash) > 0; });
+
+  const auto stats_json{stats.toJson()};
+  ASSERT_EQ(stats_json["bytes_total"].asUInt64(), 7000);
+  ASSERT_EQ(stats_json["bytes_done"].asUInt64(), 3000);
+  ASSERT_EQ(stats_json["blobs_total"].asUInt(), 3);
+  ASSERT_EQ(stats_json["blobs_done"].asUInt(), 2);
+  ASSERT_EQ(stats_json["slowest_blobs"].size(), 2);
+  for (const auto& blob : stats_json["slowest_blobs"]) {
+    ASSERT_TRUE(blob["digest"].asString() == "sha256:" + Hash1 || blob["digest"].asString() == "sha256:" + Hash2);
+    ASSERT_TRUE(blob["fetched"].asBool());
+  }
+}
+
+TEST(FetchStats, Summarize) {
+  Json::Value apps_stats;
+  apps_stats["app-01"]["bytes_total"] = 1000;
+  apps_stats["app-01"]["bytes_done"] = 1000;
+  apps_stats["app-01"]["duration_ms"] = 500;
+  apps_stats["app-02"]["bytes_total"] = 3000;
+  apps_stats["app-02"]["bytes_done"] = 1000;
+  apps_stats["app-02"]["duration_ms"] = 1500;
+
+  const auto summary{FetchStats::summarize(apps_stats)};
+  ASSERT_EQ(summary["bytes_total"].asUInt64(), 4000);
+  ASSERT_EQ(summary["bytes_done"].asUInt64(), 2000);
+  ASSERT_EQ(summary["duration_ms"].asInt64(), 2000);
+  ASSERT_EQ(summary["bytes_per_sec"].asUInt64(), 1000);
+  ASSERT_EQ(summary["apps"], apps_stats);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,6 +1,7 @@
 #include "fixtures/basehttpclient.cc"
 
 #include "libaktualizr/http/httpclient.h"
+#include "boost/algorithm/string/predicate.hpp"
 #include "boost/filesystem.hpp"
 
 namespace fixtures {
@@ -69,6 +70,12 @@ class DockerDaemon {
         return HttpResponse(resp_str, 200, CURLE_OK, "");
       }
 
+      if (std::string::npos != url.find("/images/") && boost::ends_with(url, "/json")) {
+        // the daemon mock written in Python looks up the image in `images.json`
+        ::HttpClient c{daemon_.unix_sock_.PathString()};
+        return c.get(url, maxsize);
+      }
+
       return HttpResponse(daemon_.getRunningContainers(), 200, CURLE_OK, "");
     }
 
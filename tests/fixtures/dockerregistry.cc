@@ -87,6 +87,21 @@ class DockerRegistry {
     return blob2app_.at(digest);
   }
 
+  // Limit the number of bytes sent in response to a blob request, 0 means no limit
+  void setBlobTransferLimit(size_t limit) { blob_transfer_limit_ = limit; }
+  size_t blobTransferLimit() const { return blob_transfer_limit_; }
+  void addBlobRequestRange(size_t first, size_t last) {
+    std::lock_guard<std::mutex> lock{blob_request_ranges_mutex_};
+    blob_request_ranges_.emplace_back(first, last);
+  }
+  std::vector<std::pair<size_t, size_t>> blobRequestRanges() const {
+    std::lock_guard<std::mutex> lock{blob_request_ranges_mutex_};
+    return blob_request_ranges_;
+  }
+
+  int tokenRequestNumb() const { return token_request_numb_; }
+  int credsRequestNumb() const { return creds_request_numb_; }
+
   const std::string& authURL() const { return auth_url_; }
   std::string getWwwAuthHeader(const std::string &url) const {
     if (www_auth_func_ != nullptr) {
@@ -117,6 +132,7 @@ class DockerRegistry {
       std::string resp;
       if (std::string::npos != url.find(registry_.base_url_ + "/token-auth/")) {
         // request for OAuth token
+        ++registry_.token_request_numb_;
         resp = "{\"token\":\"token\"}";
       } else if (std::string::npos != url.find(registry_.base_url_ + "/v2/")) {
         if (registry_.auth()) {
@@ -139,6 +155,7 @@ class DockerRegistry {
         }
       } else if (url == registry_.auth_url_) {
         // request for a basic auth to Device Gateway
+        ++registry_.creds_request_numb_;
         resp = "{\"Secret\":\"secret\",\"Username\":\"test-user\"}";
       } else {
         return HttpResponse(resp, 401, CURLE_OK, "");
@@ -149,7 +166,6 @@ class DockerRegistry {
     HttpResponse download(const std::string &url, curl_write_callback write_cb, curl_xferinfo_callback progress_cb, void *userp, curl_off_t from) override {
       (void)url;
       (void)progress_cb;
-      (void)from;
 
       if (registry_.auth()) {
           if (headers_in_ == nullptr || headers_in_->size() == 0) {
@@ -167,9 +183,35 @@ class DockerRegistry {
       if (data.empty()) {
         return HttpResponse("", 404, CURLE_OK, "Not Found");
       }
-      write_cb(const_cast<char*>(data.c_str()), data.size(), 1, userp);
 
-      return HttpResponse("resp", 200, CURLE_OK, "");
+      // `from` stands for the curl's resume offset, a `Range: bytes=<first>-<last>` header for a chunk request
+      size_t first{static_cast<size_t>(from)};
+      size_t last{data.size() - 1};
+      if (headers_in_ != nullptr) {
+        for (const auto& header: *headers_in_) {
+          if (boost::starts_with(header, "Range: bytes=")) {
+            const auto range{header.substr(std::string("Range: bytes=").size())};
+            first = std::stoul(range.substr(0, range.find('-')));
+            last = std::stoul(range.substr(range.find('-') + 1));
+          }
+        }
+      }
+      if (first > last || last >= data.size()) {
+        return HttpResponse("", 416, CURLE_OK, "Range Not Satisfiable");
+      }
+      const bool is_range_request{first != 0 || last != data.size() - 1};
+      registry_.addBlobRequestRange(first, last);
+
+      auto part{data.substr(first, last - first + 1)};
+      const auto transfer_limit{registry_.blobTransferLimit()};
+      if (transfer_limit > 0 && part.size() > transfer_limit) {
+        // emulate a connection drop in the middle of a transfer
+        write_cb(const_cast<char*>(part.c_str()), transfer_limit, 1, userp);
+        return HttpResponse("", is_range_request ? 206 : 200, CURLE_PARTIAL_FILE, "transfer closed");
+      }
+      write_cb(const_cast<char*>(part.c_str()), part.size(), 1, userp);
+
+      return HttpResponse("resp", is_range_request ? 206 : 200, CURLE_OK, "");
     }
    private:
     DockerRegistry& registry_;
@@ -232,6 +274,11 @@ class DockerRegistry {
 
   bool no_auth_;
   std::function<std::string(const std::string&)> www_auth_func_;
+  size_t blob_transfer_limit_{0};
+  std::atomic<int> token_request_numb_{0};
+  std::atomic<int> creds_request_numb_{0};
+  mutable std::mutex blob_request_ranges_mutex_;
+  std::vector<std::pair<size_t, size_t>> blob_request_ranges_;
 };
 
 std::string DockerRegistry::RunCmd{"./tests/docker-registry_fake.py"};
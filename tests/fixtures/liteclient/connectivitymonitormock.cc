@@ -0,0 +1,26 @@
+/**
+ * Class ConnectivityMonitorMock
+ *
+ * Emulates the network connectivity loss and restoration without monitoring the host network configuration.
+ * The local Device Gateway mock is considered unreachable while offline even though it's on a loopback interface.
+ */
+class ConnectivityMonitorMock : public ConnectivityMonitor {
+ public:
+  explicit ConnectivityMonitorMock(bool online = true)
+      : ConnectivityMonitor([this](const std::string&) { return online_.load(); }), online_{online} {
+    setDefaultRoute(online);
+  }
+
+  void start() override { started_ = true; }
+  bool isRouteAvailable(const std::string&) const override { return hasDefaultRoute(); }
+
+  void setOnline(bool online) {
+    online_ = online;
+    setDefaultRoute(online);
+  }
+  bool started() const { return started_; }
+
+ private:
+  std::atomic<bool> online_;
+  std::atomic<bool> started_{false};
+};
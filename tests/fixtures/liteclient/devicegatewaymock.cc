@@ -20,6 +20,8 @@ class DeviceGatewayMock {
         req_headers_file_{tuf_.getPath() + "/headers.json"},
         events_file_{tuf_.getPath() + "/events.json"},
         sota_toml_file_{tuf_.getPath() + "/sota.toml"},
+        tuf_stats_file_{tuf_.getPath() + "/tuf-stats.json"},
+        apps_states_file_{tuf_.getPath() + "/apps-states.json"},
         process_{
           getDeviceGatewayArgs({RunCmd,
                                 "--port", port_,
@@ -27,7 +29,9 @@ class DeviceGatewayMock {
                                 "--tuf-repo", tuf_.getPath(),
                                 "--headers-file", req_headers_file_,
                                 "--events-file", events_file_,
-                                "--sota-toml", sota_toml_file_}
+                                "--sota-toml", sota_toml_file_,
+                                "--tuf-stats-file", tuf_stats_file_,
+                                "--apps-states-file", apps_states_file_}
                                 , certDir)}
   {
     if (certDir.empty()) {
@@ -64,6 +68,32 @@ class DeviceGatewayMock {
   }
   std::string readSotaToml() const { return Utils::readFile(sota_toml_file_); }
   bool resetSotaToml() const { return boost::filesystem::remove(sota_toml_file_); }
+  // the number of TUF metadata requests served with 200 or 304 and the number of body bytes sent in total
+  Json::Value getTufStats() const {
+    if (!boost::filesystem::exists(tuf_stats_file_)) {
+      Json::Value stats;
+      stats["requests"] = 0;
+      stats["bytes"] = 0;
+      return stats;
+    }
+    return Utils::parseJSONFile(tuf_stats_file_);
+  }
+  void resetTufStats() const { boost::filesystem::remove(tuf_stats_file_); }
+  // the received apps-states reports, each one along with its `Content-Encoding`: {"encoding": ..., "body": ...}
+  Json::Value getAppsStates() const {
+    if (!boost::filesystem::exists(apps_states_file_)) {
+      return Json::Value(Json::arrayValue);
+    }
+    return Utils::parseJSONFile(apps_states_file_);
+  }
+  // make the apps-states requests fail with 500
+  void setAppsStatesFailure(bool fail) const {
+    if (fail) {
+      Utils::writeFile(apps_states_file_ + ".fail", std::string(""));
+    } else {
+      boost::filesystem::remove(apps_states_file_ + ".fail");
+    }
+  }
 
  private:
   const OSTreeRepoMock& ostree_;
@@ -73,6 +103,8 @@ class DeviceGatewayMock {
   const std::string req_headers_file_;
   const std::string events_file_;
   const std::string sota_toml_file_;
+  const std::string tuf_stats_file_;
+  const std::string apps_states_file_;
   bp::child process_;
 };
 
@@ -1,3 +1,5 @@
+#include <atomic>
+
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 #include <boost/algorithm/hex.hpp>
@@ -12,6 +14,7 @@
 #include "bootloader/bootloaderlite.h"
 #include "target.h"
 #include "crypto/crypto.h"
+#include "connectivitymonitor.h"
 
 
 namespace fixtures {
@@ -24,12 +27,14 @@ namespace fixtures {
 #include "liteclient/devicegatewaymock.cc"
 #include "liteclient/boot_flag_mgr.cc"
 #include "liteclient/mockappengine.cc"
+#include "liteclient/connectivitymonitormock.cc"
 
 
 class LiteClientMock : public LiteClient {
  public:
-  LiteClientMock(Config& config_in, const std::shared_ptr<AppEngine>& app_engine = nullptr, const std::shared_ptr<P11EngineGuard>& p11 = nullptr)
-      : LiteClient(config_in, app_engine, p11) {}
+  LiteClientMock(Config& config_in, const std::shared_ptr<AppEngine>& app_engine = nullptr, const std::shared_ptr<P11EngineGuard>& p11 = nullptr,
+                 std::shared_ptr<ConnectivityMonitor> connectivity_monitor = nullptr)
+      : LiteClient(config_in, app_engine, p11, nullptr, false, std::move(connectivity_monitor)) {}
 
   MOCK_METHOD(void, callback, (const char* msg, const Uptane::Target& install_target, const std::string& result),
               (override));
@@ -188,7 +193,7 @@ class ClientTest :virtual public ::testing::Test {
 
     tweakConf(conf);
 
-    auto client = std::make_shared<testing::NiceMock<LiteClientMock>>(conf, app_engine);
+    auto client = std::make_shared<testing::NiceMock<LiteClientMock>>(conf, app_engine, nullptr, connectivity_monitor_);
     // Recreate the report queue with the configuration needed for tests, specifically:
     // - make the worker thread not to wait before reading from DB and sending to DG the next set of events;
     // - make the report queue include just one event in a single request to DG.
@@ -596,6 +601,8 @@ class ClientTest :virtual public ::testing::Test {
   Uptane::Target initial_target_;
 
   boost::optional<std::vector<std::string>> app_shortlist_;
+  // set by a test before creating a client in order to emulate the network connectivity loss
+  std::shared_ptr<ConnectivityMonitorMock> connectivity_monitor_;
   uint32_t static_delta_size_bn_{0};
   bool static_delta_stat_{false};
 };
@@ -12,6 +12,9 @@
 #include "composeappmanager.h"
 #include "liteclient.h"
 
+#include <malloc.h>
+#include <fstream>
+#include <future>
 #include <iostream>
 #include <string>
 
@@ -334,6 +337,23 @@ TEST_F(LiteClientTest, OstreeAndAppUpdateIfOstreeDownloadFailureAndStaticDeltaSt
   UnsetFreeBlockNumb();
 }
 
+TEST_F(LiteClientTest, OstreeDownloadWaitsForConnectivity) {
+  connectivity_monitor_ = std::make_shared<fixtures::ConnectivityMonitorMock>(false);
+  auto client = createLiteClient();
+  ASSERT_FALSE(connectivity_monitor_->started());
+  auto new_target = createTarget();
+  ASSERT_TRUE(client->checkForUpdatesBegin());
+
+  // each download attempt fails, a retry is held until connectivity is restored rather than made in a second
+  getOsTreeRepo().removeCommitObject(new_target.sha256Hash());
+  auto download{std::async(std::launch::async, [&client, &new_target]() { return client->download(new_target, ""); })};
+  ASSERT_EQ(download.wait_for(std::chrono::seconds(5)), std::future_status::timeout);
+  connectivity_monitor_->setOnline(true);
+  ASSERT_EQ(download.wait_for(std::chrono::seconds(30)), std::future_status::ready);
+  ASSERT_EQ(download.get().status, DownloadResult::Status::DownloadFailed);
+  ASSERT_TRUE(targetsMatch(client->getCurrent(), getInitialTarget()));
+}
+
 TEST_F(LiteClientTest, AppUpdateDownloadFailure) {
   // boot device
   auto client = createLiteClient();
@@ -425,7 +445,7 @@ TEST_F(LiteClientTest, CheckEmptyTargets) {
   ASSERT_TRUE(targetsMatch(client->getCurrent(), getInitialTarget()));
 
   // make sure getting targets doesn't crash if called before updating metadata
-  ASSERT_EQ(client->allTargets().size(), 0);
+  ASSERT_EQ(client->allTargets()->size(), 0);
 
   createTarget();
 
@@ -437,7 +457,105 @@ TEST_F(LiteClientTest, CheckEmptyTargets) {
       LOG_ERROR << "Unable to use local copy of TUF data";
     }
   }
-  ASSERT_GT(client->allTargets().size(), 0);
+  ASSERT_GT(client->allTargets()->size(), 0);
+}
+
+TEST_F(LiteClientTest, TargetListDigestCache) {
+  auto client = createLiteClient(InitialVersion::kOff);
+  ASSERT_TRUE(std::get<0>(client->updateImageMeta()));
+  const auto digest{client->getTargetListDigest()};
+  ASSERT_FALSE(digest.empty());
+  ASSERT_EQ(digest, LiteClient::loadTargetListDigest(client->storage));
+
+  // the stored targets metadata are not loaded again as long as the stored snapshot metadata are the same
+  std::string targets;
+  ASSERT_TRUE(client->storage->loadNonRoot(&targets, Uptane::RepositoryType::Image(), Uptane::Role::Targets()));
+  auto targets_json{Utils::parseJSON(targets)};
+  targets_json["signed"]["targets"].clear();
+  client->storage->storeNonRoot(Utils::jsonToCanonicalStr(targets_json), Uptane::RepositoryType::Image(),
+                                Uptane::Role::Targets());
+  ASSERT_NE(digest, LiteClient::loadTargetListDigest(client->storage));
+  ASSERT_EQ(digest, client->getTargetListDigest());
+  client->storage->storeNonRoot(targets, Uptane::RepositoryType::Image(), Uptane::Role::Targets());
+
+  // new snapshot metadata invalidate the cached digest
+  createTarget();
+  ASSERT_TRUE(std::get<0>(client->updateImageMeta()));
+  const auto new_digest{client->getTargetListDigest()};
+  ASSERT_NE(digest, new_digest);
+  ASSERT_EQ(new_digest, LiteClient::loadTargetListDigest(client->storage));
+}
+
+TEST_F(LiteClientTest, TargetListCache) {
+  auto client = createLiteClient(InitialVersion::kOff);
+  ASSERT_TRUE(std::get<0>(client->updateImageMeta()));
+  const auto targets{client->allTargets()};
+  ASSERT_FALSE(targets->empty());
+
+  // the same view is returned as long as the version of the targets metadata is the same
+  ASSERT_EQ(targets, client->allTargets());
+  ASSERT_TRUE(std::get<0>(client->updateImageMeta()));
+  ASSERT_EQ(targets, client->allTargets());
+
+  // new targets metadata invalidate the view, the former one stays valid
+  const auto target_numb{targets->size()};
+  createTarget();
+  client->notifyTufUpdateStarted();
+  ASSERT_TRUE(std::get<0>(client->updateImageMeta()));
+  client->notifyTufUpdateFinished();
+  ASSERT_FALSE(client->targets_view_);
+  const auto new_targets{client->allTargets()};
+  ASSERT_NE(targets, new_targets);
+  ASSERT_EQ(new_targets->size(), target_numb + 1);
+  ASSERT_EQ(targets->size(), target_numb);
+}
+
+// Returns the resident set size of the process in bytes after the freed heap memory is returned to the system
+static int64_t residentSetSize() {
+  malloc_trim(0);
+  std::ifstream status{"/proc/self/status"};
+  std::string line;
+  while (std::getline(status, line)) {
+    if (boost::starts_with(line, "VmRSS:")) {
+      return std::stoll(line.substr(std::string("VmRSS:").size())) * 1024;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Benchmarks the memory held by LiteClient during a TUF metadata update of factories with a growing number of Targets:
+ * the growth of the resident set size is logged for each number, and it's checked that no copy of the Target list is
+ * held until the update ends.
+ */
+TEST_F(LiteClientTest, TufUpdateMemory) {
+  auto client = createLiteClient(InitialVersion::kOff);
+  int target_numb{0};
+  for (const int factory_target_numb : {250, 500, 1000, 2000}) {
+    for (; target_numb < factory_target_numb - 1; ++target_numb) {
+      getTufRepo().addTarget("target-" + std::to_string(target_numb), getInitialTarget().sha256Hash(), hw_id,
+                             std::to_string(target_numb + 2));
+    }
+    ASSERT_TRUE(std::get<0>(client->updateImageMeta()));
+    std::string meta;
+    ASSERT_TRUE(client->storage->loadNonRoot(&meta, Uptane::RepositoryType::Image(), Uptane::Role::Targets()));
+    getTufRepo().addTarget("target-" + std::to_string(target_numb), getInitialTarget().sha256Hash(), hw_id,
+                           std::to_string(target_numb + 2));
+    ++target_numb;
+
+    const auto rss_before{residentSetSize()};
+    client->notifyTufUpdateStarted();
+    const auto rss_started{residentSetSize()};
+    ASSERT_TRUE(std::get<0>(client->updateImageMeta()));
+    client->notifyTufUpdateFinished();
+    const auto rss_finished{residentSetSize()};
+    LOG_INFO << "TUF update of " << target_numb << " Targets, targets metadata: " << meta.size()
+             << " bytes, RSS growth: " << rss_started - rss_before << " bytes when started, "
+             << rss_finished - rss_before << " bytes when finished";
+    // a parsed copy of the Target list takes more memory than its JSON
+    ASSERT_LT(rss_started - rss_before, static_cast<int64_t>(meta.size()));
+    ASSERT_GE(client->allTargets()->size(), target_numb);
+  }
 }
 
 TEST_P(LiteClientTestMultiPacman, OstreeUpdateIfSameVersion) {
@@ -1,5 +1,9 @@
 #include <gtest/gtest.h>
 
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <chrono>
+
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 #include <limits>
@@ -269,6 +273,58 @@ TEST_F(RestorableAppEngineTest, FetchCheckAndRefetch) {
   }
 }
 
+TEST_F(RestorableAppEngineTest, FetchAndCheckBlobIndex) {
+  auto app = registry.addApp(fixtures::ComposeApp::create("app-01"));
+  ASSERT_TRUE(app_engine->fetch(app));
+  ASSERT_TRUE(app_engine->isFetched(app));
+
+  const Docker::Uri uri{Docker::Uri::parseUri(app.uri)};
+  const auto index_file{storeRoot() / Docker::BlobIndex::Filename};
+  ASSERT_TRUE(boost::filesystem::exists(index_file));
+  ASSERT_TRUE(Utils::parseJSONFile(index_file).isMember(uri.digest.hash()));
+
+  // already verified blobs are not re-hashed, but their change is still detected
+  ASSERT_TRUE(app_engine->isFetched(app));
+  const auto manifest_file{storeRoot() / "apps" / uri.app / uri.digest.hash() / Docker::Manifest::Filename};
+  const auto manifest_size{boost::filesystem::file_size(manifest_file)};
+  Utils::writeFile(manifest_file, std::string(manifest_size, ' '));
+  ASSERT_FALSE(app_engine->isFetched(app));
+  ASSERT_FALSE(Utils::parseJSONFile(index_file).isMember(uri.digest.hash()));
+
+  ASSERT_TRUE(app_engine->fetch(app));
+  ASSERT_TRUE(app_engine->isFetched(app));
+  ASSERT_TRUE(Utils::parseJSONFile(index_file).isMember(uri.digest.hash()));
+}
+
+TEST_F(RestorableAppEngineTest, FetchAndPrune) {
+  auto app = registry.addApp(fixtures::ComposeApp::create("app-01"));
+  ASSERT_TRUE(app_engine->fetch(app));
+  auto updated_app = registry.addApp(fixtures::ComposeApp::create("app-01", "service-01", "image-02"));
+  ASSERT_TRUE(app_engine->fetch(updated_app));
+
+  const Docker::Uri uri{Docker::Uri::parseUri(app.uri)};
+  const auto app_version{Docker::BlobRefTable::getAppVersion(uri.app, uri.digest.hash())};
+  const auto refs_file{storeRoot() / Docker::BlobRefTable::Filename};
+  ASSERT_TRUE(boost::filesystem::exists(refs_file));
+  ASSERT_TRUE(Utils::parseJSONFile(refs_file)["apps"].isMember(app_version));
+
+  // the dry run reports the blobs of the previous App version and doesn't remove anything
+  auto restorable_engine{std::dynamic_pointer_cast<Docker::RestorableAppEngine>(app_engine)};
+  const auto reclaimable{restorable_engine->getReclaimableSpace({updated_app})};
+  ASSERT_GT(reclaimable.blob_numb, 0);
+  ASSERT_GT(reclaimable.bytes, 0);
+  ASSERT_TRUE(app_engine->isFetched(app));
+
+  app_engine->prune({updated_app});
+  ASSERT_FALSE(app_engine->isFetched(app));
+  ASSERT_TRUE(app_engine->isFetched(updated_app));
+  const auto refs_json{Utils::parseJSONFile(refs_file)};
+  ASSERT_FALSE(refs_json["apps"].isMember(app_version));
+  ASSERT_TRUE(refs_json["garbage"].empty());
+  ASSERT_FALSE(refs_json["sweep_required"].asBool());
+  ASSERT_EQ(restorable_engine->getReclaimableSpace({updated_app}).blob_numb, 0);
+}
+
 TEST_F(RestorableAppEngineTest, FetchAndInstall) {
   auto app = registry.addApp(fixtures::ComposeApp::create("app-02"));
   ASSERT_TRUE(app_engine->fetch(app));
@@ -284,6 +340,22 @@ TEST_F(RestorableAppEngineTest, FetchAndInstall) {
   ASSERT_FALSE(app_engine->isRunning(app));
 }
 
+TEST_F(RestorableAppEngineTest, FetchAndInstallLoadedImage) {
+  auto app = registry.addApp(fixtures::ComposeApp::create("app-02"));
+  ASSERT_TRUE(app_engine->fetch(app));
+  const auto install_res{app_engine->install(app)};
+  ASSERT_EQ(install_res, true) << install_res.err;
+  // the image has been loaded into the docker store already, so it's not loaded again
+  daemon_.setImagePullFailFlag(true);
+  const auto reinstall_res{app_engine->install(app)};
+  ASSERT_EQ(reinstall_res, true) << reinstall_res.err;
+  // the image is loaded again if it has been removed from the docker store
+  boost::filesystem::remove(daemon_.dir() / "images.json");
+  ASSERT_FALSE(app_engine->install(app));
+  daemon_.setImagePullFailFlag(false);
+  ASSERT_TRUE(app_engine->install(app));
+}
+
 TEST_F(RestorableAppEngineTest, FetchAndRun) {
   auto app = registry.addApp(fixtures::ComposeApp::create("app-03"));
   ASSERT_TRUE(app_engine->fetch(app));
@@ -643,6 +715,142 @@ TEST_F(RestorableAppEngineTest, VerifySkopeoTmpFileRemoval) {
   ASSERT_TRUE(it == end);
 }
 
+TEST(RestorableAppEngine, ContentHash) {
+  TemporaryDirectory test_dir;
+  {
+    // content spanning a few hash read chunks and not aligned to the chunk size
+    const auto blob{test_dir / "blob"};
+    std::string content;
+    while (content.size() < 3 * Docker::RestorableAppEngine::HashReadChunkSize + 17) {
+      content += Utils::randomUuid();
+    }
+    Utils::writeFile(blob, content);
+    ASSERT_EQ(Docker::RestorableAppEngine::getContentHash(blob),
+              boost::algorithm::to_lower_copy(boost::algorithm::hex(Crypto::sha256digest(content))));
+  }
+  {
+    const auto blob{test_dir / "empty-blob"};
+    Utils::writeFile(blob, std::string());
+    ASSERT_EQ(Docker::RestorableAppEngine::getContentHash(blob),
+              "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+  }
+  EXPECT_THROW(Docker::RestorableAppEngine::getContentHash(test_dir / "non-existing-blob"), std::runtime_error);
+}
+
+TEST(RestorableAppEngine, ContentHashOfLargeBlobMemoryUsage) {
+  // Hashing a large blob should not increase the peak RSS by the blob size
+  const uint64_t blob_size{256 * 1024 * 1024};
+  TemporaryDirectory test_dir;
+  const auto blob{test_dir / "blob"};
+  Utils::writeFile(blob, std::string());
+  boost::filesystem::resize_file(blob, blob_size);
+
+  struct rusage usage_before {};
+  getrusage(RUSAGE_SELF, &usage_before);
+  const auto start{std::chrono::steady_clock::now()};
+  Docker::RestorableAppEngine::getContentHash(blob);
+  const auto duration{std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start)};
+  struct rusage usage_after {};
+  getrusage(RUSAGE_SELF, &usage_after);
+
+  LOG_INFO << "Hashed " << blob_size << " bytes in " << duration.count()
+           << " ms; peak RSS growth: " << (usage_after.ru_maxrss - usage_before.ru_maxrss) << " KB";
+  // ru_maxrss is in kilobytes
+  ASSERT_LT(usage_after.ru_maxrss - usage_before.ru_maxrss, 16 * 1024);
+}
+
+TEST(RestorableAppEngine, ShareFile) {
+  TemporaryDirectory test_dir;
+  const auto src{test_dir / "src-blob"};
+  const std::string content{"some blob content"};
+  Utils::writeFile(src, content);
+
+  // a reflink or a hardlink, depending on whether the file system supports reflinks
+  ASSERT_TRUE(Docker::RestorableAppEngine::shareFile(src, test_dir / "dst-blob"));
+  ASSERT_EQ(Utils::readFile(test_dir / "dst-blob"), content);
+  ASSERT_FALSE(boost::filesystem::exists(test_dir / "dst-blob.tmp"));
+  // the blob is already present in the store
+  ASSERT_TRUE(Docker::RestorableAppEngine::shareFile(src, test_dir / "dst-blob"));
+  // nothing to share, the blob is to be copied
+  ASSERT_FALSE(Docker::RestorableAppEngine::shareFile(test_dir / "non-existing-blob", test_dir / "dst-blob-2"));
+  ASSERT_FALSE(boost::filesystem::exists(test_dir / "dst-blob-2"));
+  ASSERT_FALSE(boost::filesystem::exists(test_dir / "dst-blob-2.tmp"));
+
+  // tmpfs doesn't support reflinks, so the blob is hardlinked
+  struct ShmDir {
+    ~ShmDir() { boost::filesystem::remove_all(path); }
+    const boost::filesystem::path path{"/dev/shm/aklite-test-" + Utils::randomUuid()};
+  } shm;
+  const auto& shm_dir{shm.path};
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(shm_dir, ec);
+  if (ec) {
+    GTEST_SKIP() << "Failed to create a tmpfs directory: " << ec.message();
+  }
+  Utils::writeFile(shm_dir / "src-blob", content);
+  ASSERT_TRUE(Docker::RestorableAppEngine::shareFile(shm_dir / "src-blob", shm_dir / "dst-blob"));
+  ASSERT_EQ(boost::filesystem::hard_link_count(shm_dir / "src-blob"), 2);
+  ASSERT_FALSE(boost::filesystem::exists(shm_dir / "dst-blob.tmp"));
+
+  // neither a reflink nor a hardlink can be made across volumes, so the blob is to be copied
+  struct stat shm_stat {};
+  struct stat test_dir_stat {};
+  ASSERT_EQ(stat(shm_dir.c_str(), &shm_stat), 0);
+  ASSERT_EQ(stat(test_dir.Path().c_str(), &test_dir_stat), 0);
+  if (shm_stat.st_dev != test_dir_stat.st_dev) {
+    ASSERT_FALSE(Docker::RestorableAppEngine::shareFile(shm_dir / "src-blob", test_dir / "dst-blob-3"));
+    ASSERT_FALSE(boost::filesystem::exists(test_dir / "dst-blob-3"));
+    ASSERT_FALSE(boost::filesystem::exists(test_dir / "dst-blob-3.tmp"));
+  }
+}
+
+TEST(RestorableAppEngine, UpdateSizeOfSharedBlobs) {
+  TemporaryDirectory store_dir;
+  const std::string stored_blob{std::string(64, '1')};
+  const std::string shared_blob{std::string(64, '2')};
+  const std::string missing_blob{std::string(64, '3')};
+  Utils::writeFile(store_dir / stored_blob, std::string("stored blob"));
+
+  Json::Value layers{Json::arrayValue};
+  int64_t size{1000};
+  for (const auto& hash : {stored_blob, shared_blob, missing_blob}) {
+    Json::Value layer;
+    layer["digest"] = "sha256:" + hash;
+    layer["size"] = Json::Value::Int64(size);
+    layers.append(layer);
+    size *= 2;
+  }
+  // the shared blob doesn't take space in the store, but it is extracted to the docker store
+  uint64_t store_size;
+  uint64_t missing_size;
+  std::tie(store_size, missing_size) = Docker::RestorableAppEngine::getAppUpdateSize(layers, store_dir.Path());
+  ASSERT_EQ(store_size, 6000);
+  ASSERT_EQ(missing_size, 6000);
+  std::tie(store_size, missing_size) =
+      Docker::RestorableAppEngine::getAppUpdateSize(layers, store_dir.Path(), {shared_blob});
+  ASSERT_EQ(store_size, 4000);
+  ASSERT_EQ(missing_size, 6000);
+
+  Json::Value layers_meta;
+  int64_t archive_size{1000};
+  for (const auto& hash : {stored_blob, shared_blob, missing_blob}) {
+    auto& layer{layers_meta["sha256:" + hash]};
+    layer["archive_size"] = Json::Value::Int64(archive_size);
+    layer["size"] = Json::Value::Int64(archive_size * 3);
+    layer["usage"] = Json::Value::Int64(archive_size * 4);
+    archive_size *= 2;
+  }
+  uint64_t docker_size;
+  std::tie(store_size, docker_size) =
+      Docker::RestorableAppEngine::getPreciseAppUpdateSize(layers_meta, store_dir.Path());
+  ASSERT_EQ(store_size, 6000);
+  ASSERT_EQ(docker_size, 24000);
+  std::tie(store_size, docker_size) =
+      Docker::RestorableAppEngine::getPreciseAppUpdateSize(layers_meta, store_dir.Path(), {shared_blob});
+  ASSERT_EQ(store_size, 4000);
+  ASSERT_EQ(docker_size, 24000);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   logger_init();
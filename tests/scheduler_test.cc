@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "scheduler.h"
+
+TEST(Scheduler, RunDueTasks) {
+  Scheduler scheduler;
+  std::vector<std::string> runs;
+  scheduler.addTask("periodic", std::chrono::hours(1), std::chrono::milliseconds(0),
+                    [&runs]() { runs.emplace_back("periodic"); });
+  scheduler.addTask("on-demand", std::chrono::milliseconds(0), std::chrono::milliseconds(0),
+                    [&runs]() { runs.emplace_back("on-demand"); });
+
+  // a periodic task is due immediately, an on-demand task only once it's triggered
+  scheduler.runDueTasks();
+  ASSERT_EQ(runs, std::vector<std::string>{"periodic"});
+  scheduler.runDueTasks();
+  ASSERT_EQ(runs.size(), 1);
+
+  scheduler.trigger("on-demand");
+  scheduler.waitForDueTask();
+  scheduler.runDueTasks();
+  ASSERT_EQ(runs, (std::vector<std::string>{"periodic", "on-demand"}));
+
+  scheduler.trigger("periodic");
+  scheduler.runDueTasks();
+  ASSERT_EQ(runs, (std::vector<std::string>{"periodic", "on-demand", "periodic"}));
+}
+
+TEST(Scheduler, WaitForDueTask) {
+  Scheduler scheduler;
+  int runs{0};
+  scheduler.addTask("periodic", std::chrono::milliseconds(50), std::chrono::milliseconds(50), [&runs]() { ++runs; });
+  scheduler.runDueTasks();
+
+  const auto start{std::chrono::steady_clock::now()};
+  scheduler.waitForDueTask();
+  const auto waited{std::chrono::steady_clock::now() - start};
+  ASSERT_GE(waited, std::chrono::milliseconds(50));
+  ASSERT_LT(waited, std::chrono::seconds(5));
+  scheduler.runDueTasks();
+  ASSERT_EQ(runs, 2);
+}
+
+TEST(Scheduler, JitterFirstRun) {
+  Scheduler scheduler;
+  int runs{0};
+  scheduler.addTask(
+      "periodic", std::chrono::hours(1), std::chrono::milliseconds(200), [&runs]() { ++runs; }, true);
+  const auto start{std::chrono::steady_clock::now()};
+  scheduler.runDueTasks();
+  // the first run is due within the jitter, it may happen to be due immediately
+  if (runs == 0) {
+    scheduler.waitForDueTask();
+    scheduler.runDueTasks();
+  }
+  ASSERT_EQ(runs, 1);
+  ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+
+  // a triggered task is run immediately regardless of the jitter
+  scheduler.trigger("periodic");
+  scheduler.runDueTasks();
+  ASSERT_EQ(runs, 2);
+}
+
+TEST(Scheduler, TriggerFromAnotherThread) {
+  Scheduler scheduler;
+  int runs{0};
+  scheduler.addTask("on-demand", std::chrono::milliseconds(0), std::chrono::milliseconds(0), [&runs]() { ++runs; });
+
+  std::thread trigger_thread{[&scheduler]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    scheduler.trigger("on-demand");
+  }};
+  scheduler.waitForDueTask();
+  trigger_thread.join();
+  scheduler.runDueTasks();
+  ASSERT_EQ(runs, 1);
+}
+
+TEST(Scheduler, Watch) {
+  Scheduler scheduler;
+  int runs{0};
+  scheduler.addTask("on-demand", std::chrono::milliseconds(0), std::chrono::milliseconds(0), [&runs]() { ++runs; });
+
+  const int fd{::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)};
+  ASSERT_NE(fd, -1);
+  scheduler.addWatch(fd, [fd, &scheduler]() {
+    uint64_t value;
+    if (::read(fd, &value, sizeof(value)) == sizeof(value)) {
+      scheduler.trigger("on-demand");
+    }
+  });
+
+  const uint64_t value{1};
+  ASSERT_EQ(::write(fd, &value, sizeof(value)), sizeof(value));
+  scheduler.waitForDueTask();
+  scheduler.runDueTasks();
+  ASSERT_EQ(runs, 1);
+  ::close(fd);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
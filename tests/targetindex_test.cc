@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tuf/targetindex.h"
+
+using aklite::tuf::TargetIndex;
+using aklite::tuf::TufTarget;
+
+static TufTarget makeTarget(const std::string& hwid, int version, const std::vector<std::string>& tags,
+                            const std::string& format = "OSTREE") {
+  Json::Value custom;
+  custom["targetFormat"] = format;
+  custom[TufTarget::HardwareIDsField][0] = hwid;
+  custom[TufTarget::TagsField] = Json::arrayValue;
+  for (const auto& tag : tags) {
+    custom[TufTarget::TagsField].append(tag);
+  }
+  return {hwid + "-lmp-" + std::to_string(version), std::string(64, 'a' + version % 6), version, custom};
+}
+
+static std::vector<int> versions(const std::vector<TufTarget>& targets) {
+  std::vector<int> ret;
+  for (const auto& t : targets) {
+    ret.push_back(t.Version());
+  }
+  return ret;
+}
+
+TEST(TargetIndex, Find) {
+  const std::vector<TufTarget> targets{
+      makeTarget("intel", 5, {"main"}),          makeTarget("intel", 2, {"main", "devel"}),
+      makeTarget("arm", 3, {"main"}),            makeTarget("intel", 4, {"devel"}),
+      makeTarget("intel", 1, {}),                makeTarget("intel", 7, {"main"}, "BINARY"),
+      makeTarget("arm-mcu", 6, {"main", "main"}),
+  };
+  const TargetIndex index{targets};
+
+  ASSERT_EQ(index.Targets().size(), targets.size());
+  ASSERT_EQ(versions(index.Find("intel", {"main"})), std::vector<int>({2, 5}));
+  ASSERT_EQ(versions(index.Find("intel", {"devel"})), std::vector<int>({2, 4}));
+  ASSERT_EQ(versions(index.Find("intel", {"main", "devel"})), std::vector<int>({2, 4, 5}));
+  ASSERT_EQ(versions(index.Find("intel", {})), std::vector<int>({1, 2, 4, 5}));
+  ASSERT_EQ(versions(index.Find("intel", {"main"}, {"arm", "arm-mcu", "intel"})), std::vector<int>({2, 3, 5, 6}));
+  ASSERT_EQ(versions(index.Find("arm-mcu", {"main"})), std::vector<int>({6}));
+  ASSERT_TRUE(index.Find("intel", {"unknown"}).empty());
+  ASSERT_TRUE(index.Find("unknown", {"main"}).empty());
+  ASSERT_TRUE(TargetIndex().Find("intel", {"main"}).empty());
+}
+
+TEST(TargetIndex, SameVersion) {
+  // Targets of the same version are kept in the order they are listed in the targets metadata
+  const TargetIndex index{{makeTarget("intel", 3, {"main"}), makeTarget("arm", 3, {"main"}),
+                           makeTarget("intel", 3, {"main", "devel"})}};
+  const auto found{index.Find("intel", {"devel", "main"}, {"arm"})};
+  ASSERT_EQ(found.size(), 3);
+  ASSERT_EQ(found[0].Custom(), index.Targets()[0].Custom());
+  ASSERT_EQ(found[1].Custom(), index.Targets()[1].Custom());
+  ASSERT_EQ(found[2].Custom(), index.Targets()[2].Custom());
+}
+
+TEST(TargetIndex, TargetsMeta) {
+  // an index of the targets metadata provides the same Targets as an index of their TufTarget copies
+  Json::Value meta;
+  meta["signed"]["_type"] = "Targets";
+  meta["signed"]["version"] = 2;
+  meta["signed"]["expires"] = "2038-01-19T03:14:06Z";
+  std::vector<TufTarget> targets{makeTarget("intel", 3, {"main"}), makeTarget("arm", 2, {"main"}),
+                                 makeTarget("intel", 1, {"main", "devel"})};
+  for (const auto& t : targets) {
+    auto& target_json{meta["signed"]["targets"][t.Name()]};
+    target_json["hashes"]["sha256"] = t.Sha256Hash();
+    target_json["length"] = 0;
+    target_json["custom"] = t.Custom();
+    target_json["custom"]["version"] = std::to_string(t.Version());
+  }
+  const TargetIndex meta_index{std::make_shared<const Uptane::Targets>(meta)};
+  const TargetIndex index{targets};
+
+  ASSERT_EQ(meta_index.Size(), targets.size());
+  ASSERT_EQ(versions(meta_index.Find("intel", {"main"})), std::vector<int>({1, 3}));
+  const auto found{meta_index.Find("intel", {"devel", "main"}, {"arm"})};
+  const auto expected{index.Find("intel", {"devel", "main"}, {"arm"})};
+  ASSERT_EQ(found.size(), 3);
+  ASSERT_EQ(expected.size(), 3);
+  for (size_t ii = 0; ii < found.size(); ++ii) {
+    ASSERT_EQ(found[ii].Name(), expected[ii].Name());
+    ASSERT_EQ(found[ii].Sha256Hash(), expected[ii].Sha256Hash());
+    ASSERT_EQ(found[ii].Version(), expected[ii].Version());
+    ASSERT_EQ(found[ii].HardwareId(), expected[ii].HardwareId());
+  }
+  ASSERT_EQ(versions(meta_index.Targets()).size(), targets.size());
+  ASSERT_TRUE(TargetIndex(std::shared_ptr<const Uptane::Targets>()).Find("intel", {"main"}).empty());
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
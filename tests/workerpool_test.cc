@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "workerpool.h"
+
+TEST(WorkerPool, ResultOrder) {
+  const std::size_t count{100};
+  std::vector<std::size_t> results(count);
+  forEachConcurrently(count, 4, [&results](std::size_t ii) {
+    // the later items finish first
+    std::this_thread::sleep_for(std::chrono::microseconds((count - ii) * 10));
+    results[ii] = ii * ii;
+  });
+  for (std::size_t ii = 0; ii < count; ++ii) {
+    ASSERT_EQ(results[ii], ii * ii);
+  }
+}
+
+TEST(WorkerPool, WorkerNumb) {
+  const int concurrency{3};
+  std::atomic<int> running{0};
+  std::atomic<int> max_running{0};
+  std::mutex mutex;
+  std::set<std::thread::id> threads;
+  forEachConcurrently(20, concurrency, [&](std::size_t) {
+    const auto now_running{++running};
+    int max{max_running};
+    while (now_running > max && !max_running.compare_exchange_weak(max, now_running)) {
+    }
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      threads.insert(std::this_thread::get_id());
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    --running;
+  });
+  ASSERT_LE(max_running, concurrency);
+  ASSERT_GT(max_running, 1);
+  ASSERT_LE(threads.size(), concurrency);
+  ASSERT_EQ(threads.count(std::this_thread::get_id()), 0);
+
+  // no more workers than items
+  threads.clear();
+  forEachConcurrently(2, 8, [&](std::size_t) {
+    std::lock_guard<std::mutex> lock{mutex};
+    threads.insert(std::this_thread::get_id());
+  });
+  ASSERT_LE(threads.size(), 2);
+}
+
+TEST(WorkerPool, Sequential) {
+  // no worker is started if there is no concurrency or a single item
+  std::vector<std::size_t> order;
+  std::set<std::thread::id> threads;
+  const auto func = [&](std::size_t ii) {
+    threads.insert(std::this_thread::get_id());
+    order.push_back(ii);
+  };
+  forEachConcurrently(3, 1, func);
+  forEachConcurrently(1, 4, func);
+  ASSERT_EQ(order, std::vector<std::size_t>({0, 1, 2, 0}));
+  ASSERT_EQ(threads, std::set<std::thread::id>({std::this_thread::get_id()}));
+}
+
+TEST(WorkerPool, LowestIndexError) {
+  std::atomic<std::size_t> processed{0};
+  try {
+    forEachConcurrently(10, 4, [&processed](std::size_t ii) {
+      ++processed;
+      if (ii == 7 || ii == 3) {
+        throw std::runtime_error(std::to_string(ii));
+      }
+    });
+    FAIL() << "the error is not re-thrown";
+  } catch (const std::runtime_error& exc) {
+    ASSERT_EQ(std::string(exc.what()), "3");
+  }
+  // an error doesn't stop processing of the other items
+  ASSERT_EQ(processed, 10);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,4 +1,7 @@
 #include <gtest/gtest.h>
+
+#include <chrono>
+
 #include "docker/composeinfo.h"
 #include "logging/logging.h"
 #include "utilities/utils.h"
@@ -95,6 +98,48 @@ TEST_F(Yaml2JsonTest, input_yaml_invalid) {
   }
 }
 
+TEST_F(Yaml2JsonTest, parse_latency) {
+  const std::string yaml{"tests/template.yaml"};
+  const int iterations{50};
+  const auto yaml_content{Utils::readFile(yaml)};
+  using Clock = std::chrono::steady_clock;
+
+  // forking `fy-tool` is how a yaml file used to be parsed, it is the baseline
+  Json::Value forked_root;
+  const auto forked_start{Clock::now()};
+  for (int ii = 0; ii < iterations; ++ii) {
+    std::string data;
+    ASSERT_EQ(Utils::shell("/usr/bin/fy-tool --mode json " + yaml, &data, true), EXIT_SUCCESS) << data;
+    std::istringstream sin(data);
+    sin >> forked_root;
+  }
+  const auto forked_time{Clock::now() - forked_start};
+
+  Json::Value in_process_root;
+  const auto in_process_start{Clock::now()};
+  for (int ii = 0; ii < iterations; ++ii) {
+    in_process_root = Yaml2Json::parse(yaml_content, yaml);
+  }
+  const auto in_process_time{Clock::now() - in_process_start};
+
+  Json::Value cached_root;
+  const auto cached_start{Clock::now()};
+  for (int ii = 0; ii < iterations; ++ii) {
+    cached_root = Yaml2Json(yaml).root_;
+  }
+  const auto cached_time{Clock::now() - cached_start};
+
+  ASSERT_EQ(in_process_root, forked_root);
+  ASSERT_EQ(cached_root, forked_root);
+
+  const auto per_parse_us = [iterations](const Clock::duration& total) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(total).count() / iterations;
+  };
+  LOG_INFO << "yaml parse latency, forked fy-tool: " << per_parse_us(forked_time)
+           << " us, in-process: " << per_parse_us(in_process_time) << " us, in-process cached: "
+           << per_parse_us(cached_time) << " us";
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();